@@ -29,15 +29,154 @@
  * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
  * -------------------------------------------------------------------------- */
 
+
 #include "lepton/CompiledExpression.h"
+#include "lepton/FastMath.h"
 #include "lepton/Operation.h"
 #include "lepton/ParsedExpression.h"
+#include <cmath>
+#include <limits>
 #include <utility>
 #include <vector>
 
 using namespace Lepton;
 using namespace std;
 
+namespace {
+
+/**
+ * Get whether the value of a node may be a matrix.
+ */
+bool isMatrixValued(const ExpressionTreeNode& node) {
+    switch (node.getOperation().getId()) {
+        case Operation::MATRIX:
+        case Operation::PROOTS:
+        case Operation::EIG:
+            return true;
+        case Operation::SOLVE:
+            return (node.getChildren().size() > 2); // A column vector unless there is one unknown
+        case Operation::DET:
+        case Operation::DOT:
+            return false;
+        default:
+            break;
+    }
+    for (int i = 0; i < (int) node.getChildren().size(); i++)
+        if (isMatrixValued(node.getChildren()[i]))
+            return true;
+    return false;
+}
+
+/**
+ * Get whether a node has to be evaluated as a whole by ParsedExpression instead of as a scalar step.
+ */
+bool needsTreeEvaluation(const ExpressionTreeNode& node) {
+    Operation::Id id = node.getOperation().getId();
+    if (id == Operation::FNINT || id == Operation::SIGMA || id == Operation::PROD || id == Operation::LIM || id == Operation::SOLVE || id == Operation::PROOTS || id == Operation::ODE)
+        return true;
+    if (isMatrixValued(node))
+        return true;
+    for (int i = 0; i < (int) node.getChildren().size(); i++)
+        if (isMatrixValued(node.getChildren()[i]))
+            return true;
+    return false;
+}
+
+/**
+ * Find the variables read by a node, leaving out the ones bound inside it by fnInt, sigma, prod, lim, proots, solve and ode.
+ */
+void findFreeVariables(const ExpressionTreeNode& node, set<string>& bound, set<string>& variables) {
+    const Operation& op = node.getOperation();
+    const vector<ExpressionTreeNode>& children = node.getChildren();
+    if (op.getId() == Operation::VARIABLE) {
+        if (bound.find(op.getName()) == bound.end())
+            variables.insert(op.getName());
+        return;
+    }
+    if (op.getId() == Operation::FNINT || op.getId() == Operation::SIGMA || op.getId() == Operation::PROD || op.getId() == Operation::LIM || op.getId() == Operation::PROOTS) {
+        // The first child is the body and the second names the variable it binds.  The limits are outside the binding.
+        for (int i = 2; i < (int) children.size(); i++)
+            findFreeVariables(children[i], bound, variables);
+        string name = children[1].getOperation().getName();
+        bool added = bound.insert(name).second;
+        findFreeVariables(children[0], bound, variables);
+        if (added)
+            bound.erase(name);
+        return;
+    }
+    if (op.getId() == Operation::ODE) {
+        // The second and third children name x and y, which are bound in the first.
+        for (int i = 3; i < (int) children.size(); i++)
+            findFreeVariables(children[i], bound, variables);
+        vector<string> added;
+        for (int i = 1; i < 3; i++)
+            if (children[i].getOperation().getId() == Operation::VARIABLE && bound.insert(children[i].getOperation().getName()).second)
+                added.push_back(children[i].getOperation().getName());
+        findFreeVariables(children[0], bound, variables);
+        for (const string& name : added)
+            bound.erase(name);
+        return;
+    }
+    if (op.getId() == Operation::SOLVE) {
+        // The second half of the children names the variables bound in the first half.  Their current values
+        // are only the starting guesses, which do not have to exist.
+        int n = children.size()/2;
+        vector<string> added;
+        for (int i = n; i < (int) children.size(); i++)
+            if (children[i].getOperation().getId() == Operation::VARIABLE && bound.insert(children[i].getOperation().getName()).second)
+                added.push_back(children[i].getOperation().getName());
+        for (int i = 0; i < n; i++)
+            findFreeVariables(children[i], bound, variables);
+        for (const string& name : added)
+            bound.erase(name);
+        return;
+    }
+    for (int i = 0; i < (int) children.size(); i++)
+        findFreeVariables(children[i], bound, variables);
+}
+
+// Conversions used by the scalar evaluator.  Functions without an exact reduced precision form are computed in float
+// with the FastMath approximations.
+
+inline float toFloat(float x) {
+    return x;
+}
+
+inline float toFloat(Fixed x) {
+    return x.toFloat();
+}
+
+inline double toDouble(float x) {
+    return x;
+}
+
+inline double toDouble(Fixed x) {
+    return x.toDouble();
+}
+
+template <class T>
+T fromFloat(float x);
+
+template <>
+inline float fromFloat<float>(float x) {
+    return x;
+}
+
+template <>
+inline Fixed fromFloat<Fixed>(float x) {
+    return Fixed(x);
+}
+
+inline float squareRoot(float x) {
+    return FastMath::sqrt(x);
+}
+
+inline Fixed squareRoot(Fixed x) {
+    return x.sqrt();
+}
+
+} // namespace
+
 CompiledExpression::CompiledExpression() {
 }
 
@@ -58,15 +197,24 @@ CompiledExpression::CompiledExpression(const CompiledExpression& expression) {
 }
 
 CompiledExpression& CompiledExpression::operator=(const CompiledExpression& expression) {
+    if (this == &expression)
+        return *this;
+    for (int i = 0; i < (int) operation.size(); i++)
+        if (operation[i] != NULL)
+            delete operation[i];
     arguments = expression.arguments;
     target = expression.target;
+    stepValue = expression.stepValue;
+    treeNodes = expression.treeNodes;
+    treeNodeIndex = expression.treeNodeIndex;
     variableIndices = expression.variableIndices;
     variableNames = expression.variableNames;
-    workspace.resize(expression.workspace.size());
-    argValues.resize(expression.argValues.size());
+    workspace = expression.workspace;
+    workspaceFloat.clear();
+    workspaceFixed.clear();
     operation.resize(expression.operation.size());
     for (int i = 0; i < (int) operation.size(); i++)
-        operation[i] = expression.operation[i]->clone();
+        operation[i] = (expression.operation[i] == NULL ? NULL : expression.operation[i]->clone());
     return *this;
 }
 
@@ -74,47 +222,79 @@ void CompiledExpression::compileExpression(const ExpressionTreeNode& node, vecto
     if (findTempIndex(node, temps) != -1)
         return; // We have already processed a node identical to this one.
     
-    // Process the child nodes.
+    // Process the child nodes.  A node that must be evaluated as a whole only needs slots for the variables it reads.
     
+    bool evaluateAsTree = needsTreeEvaluation(node);
     vector<int> args;
-    for (int i = 0; i < node.getChildren().size(); i++) {
-        compileExpression(node.getChildren()[i], temps);
-        args.push_back(findTempIndex(node.getChildren()[i], temps));
+    if (evaluateAsTree) {
+        set<string> bound, variables;
+        findFreeVariables(node, bound, variables);
+        for (set<string>::const_iterator iter = variables.begin(); iter != variables.end(); ++iter)
+            addVariable(*iter, temps);
+    }
+    else {
+        for (int i = 0; i < node.getChildren().size(); i++) {
+            compileExpression(node.getChildren()[i], temps);
+            args.push_back(findTempIndex(node.getChildren()[i], temps));
+        }
     }
     
     // Process this node.
     
-    if (node.getOperation().getId() == Operation::VARIABLE) {
-        variableIndices[node.getOperation().getName()] = (int) workspace.size();
-        variableNames.insert(node.getOperation().getName());
+    const Operation& op = node.getOperation();
+    if (!evaluateAsTree && op.getId() == Operation::VARIABLE) {
+        variableIndices[op.getName()] = (int) workspace.size();
+        variableNames.insert(op.getName());
     }
     else {
-        int stepIndex = (int) arguments.size();
-        arguments.push_back(vector<int>());
+        arguments.push_back(args);
         target.push_back((int) workspace.size());
-        operation.push_back(node.getOperation().clone());
-        if (args.size() == 0)
-            arguments[stepIndex].push_back(0); // The value won't actually be used.  We just need something there.
+        StepValue value;
+        value.asDouble = 0.0;
+        if (evaluateAsTree) {
+            operation.push_back(NULL);
+            treeNodeIndex.push_back((int) treeNodes.size());
+            treeNodes.push_back(node);
+        }
         else {
-            // If the arguments are sequential, we can just pass a pointer to the first one.
-            
-            bool sequential = true;
-            for (int i = 1; i < args.size(); i++)
-                if (args[i] != args[i-1]+1)
-                    sequential = false;
-            if (sequential)
-                arguments[stepIndex].push_back(args[0]);
-            else {
-                arguments[stepIndex] = args;
-                if (args.size() > argValues.size())
-                    argValues.resize(args.size(), 0.0);
+            operation.push_back(op.clone());
+            treeNodeIndex.push_back(-1);
+            switch (op.getId()) {
+                case Operation::CONSTANT:
+                    value.asDouble = dynamic_cast<const Operation::Constant&>(op).getValue();
+                    break;
+                case Operation::ADD_CONSTANT:
+                    value.asDouble = dynamic_cast<const Operation::AddConstant&>(op).getValue();
+                    break;
+                case Operation::MULTIPLY_CONSTANT:
+                    value.asDouble = dynamic_cast<const Operation::MultiplyConstant&>(op).getValue();
+                    break;
+                case Operation::POWER_CONSTANT:
+                    value.asDouble = dynamic_cast<const Operation::PowerConstant&>(op).getValue();
+                    break;
+                case Operation::SIN:
+                case Operation::COS:
+                case Operation::TAN:
+                case Operation::ATAN:
+                    // The factor the argument is multiplied by in degree mode.
+                    value.asDouble = dynamic_cast<const Operation::TrigonometricFunction&>(op).usesDegrees() ? 3.14159265358979323846/180 : 1.0;
+                    break;
+                default:
+                    break;
             }
         }
+        value.asFloat = (float) value.asDouble;
+        value.asFixed = Fixed(value.asDouble);
+        stepValue.push_back(value);
     }
     temps.push_back(make_pair(node, workspace.size()));
     workspace.push_back(0.0);
 }
 
+void CompiledExpression::addVariable(const string& name, vector<pair<ExpressionTreeNode, int> >& temps) {
+    compileExpression(ExpressionTreeNode(new Operation::Variable(name)), temps);
+}
+
 int CompiledExpression::findTempIndex(const ExpressionTreeNode& node, vector<pair<ExpressionTreeNode, int> >& temps) {
     for (int i = 0; i < (int) temps.size(); i++)
         if (temps[i].first == node)
@@ -133,28 +313,166 @@ double& CompiledExpression::getVariableReference(const string& name) {
     return workspace[index->second];
 }
 
+double CompiledExpression::evaluateStep(int step) const {
+    Result result;
+    if (operation[step] == NULL) {
+        for (map<string, int>::const_iterator iter = variableIndices.begin(); iter != variableIndices.end(); ++iter)
+            treeVariables[iter->first] = workspace[iter->second];
+        result = ParsedExpression::publicEvaluate(treeNodes[treeNodeIndex[step]], treeVariables);
+    }
+    else {
+        const vector<int>& stepArgs = arguments[step];
+        Args args;
+        args.inputs.resize(max((int) stepArgs.size(), 1));
+        for (int i = 0; i < (int) stepArgs.size(); i++)
+            args.inputs[i] = InputArgType(workspace[stepArgs[i]]);
+        result = operation[step]->evaluate(args, treeVariables);
+    }
+    if (!result.isReal())
+        return numeric_limits<double>::quiet_NaN();
+    return result.getReal();
+}
+
 double CompiledExpression::evaluate() const {
     // Loop over the operations and evaluate each one.
     
-    for (int step = 0; step < operation.size(); step++) {
+    for (int step = 0; step < (int) operation.size(); step++)
+        workspace[target[step]] = evaluateStep(step);
+    return workspace[workspace.size()-1];
+}
+
+template <>
+float CompiledExpression::getStepValue<float>(const StepValue& value) {
+    return value.asFloat;
+}
+
+template <>
+Fixed CompiledExpression::getStepValue<Fixed>(const StepValue& value) {
+    return value.asFixed;
+}
+
+template <class T>
+T CompiledExpression::evaluateScalar(vector<T>& values) const {
+    values.resize(workspace.size());
+    for (map<string, int>::const_iterator iter = variableIndices.begin(); iter != variableIndices.end(); ++iter)
+        values[iter->second] = T(workspace[iter->second]);
+    for (int step = 0; step < (int) operation.size(); step++) {
         const vector<int>& args = arguments[step];
-        if (args.size() == 1) {
-            vector<InputArgType> vec(1);
-            vec[0] = workspace[args[0]];
-            Args args;
-            args.inputs = vec;
-            workspace[target[step]] = operation[step]->evaluate(args, dummyVariables).getReal();
+        const StepValue& value = stepValue[step];
+        T& result = values[target[step]];
+        if (operation[step] == NULL) {
+            result = T(evaluateStep(step));
+            continue;
         }
-        else {
-            for (int i = 0; i < args.size(); i++)
-                argValues[i] = workspace[args[i]];
-            
-            vector<InputArgType> vec(1);
-            vec[0] = argValues[0];
-            Args args;
-            args.inputs = vec;
-            workspace[target[step]] = operation[step]->evaluate(args, dummyVariables).getReal();
+        switch (operation[step]->getId()) {
+            case Operation::CONSTANT:
+                result = getStepValue<T>(value);
+                break;
+            case Operation::ADD:
+                result = values[args[0]]+values[args[1]];
+                break;
+            case Operation::SUBTRACT:
+                result = values[args[0]]-values[args[1]];
+                break;
+            case Operation::MULTIPLY:
+                result = values[args[0]]*values[args[1]];
+                break;
+            case Operation::DIVIDE:
+                result = values[args[0]]/values[args[1]];
+                break;
+            case Operation::NEGATE:
+                result = -values[args[0]];
+                break;
+            case Operation::SQUARE:
+                result = values[args[0]]*values[args[0]];
+                break;
+            case Operation::CUBE:
+                result = values[args[0]]*values[args[0]]*values[args[0]];
+                break;
+            case Operation::RECIPROCAL:
+                result = T(1)/values[args[0]];
+                break;
+            case Operation::ADD_CONSTANT:
+                result = values[args[0]]+getStepValue<T>(value);
+                break;
+            case Operation::MULTIPLY_CONSTANT:
+                result = values[args[0]]*getStepValue<T>(value);
+                break;
+            case Operation::POWER_CONSTANT:
+            {
+                int exponent = (int) value.asDouble;
+                if (exponent == value.asDouble) {
+                    // Integer powers can be computed much more quickly by repeated multiplication.
+                    
+                    T base = values[args[0]];
+                    if (exponent < 0) {
+                        exponent = -exponent;
+                        base = T(1)/base;
+                    }
+                    result = T(1);
+                    while (exponent != 0) {
+                        if ((exponent&1) == 1)
+                            result = result*base;
+                        base = base*base;
+                        exponent = exponent>>1;
+                    }
+                }
+                else
+                    result = fromFloat<T>(FastMath::pow(toFloat(values[args[0]]), value.asFloat));
+                break;
+            }
+            case Operation::POWER:
+                result = fromFloat<T>(FastMath::pow(toFloat(values[args[0]]), toFloat(values[args[1]])));
+                break;
+            case Operation::SQRT:
+                result = squareRoot(values[args[0]]);
+                break;
+            case Operation::EXP:
+                result = fromFloat<T>(FastMath::exp(toFloat(values[args[0]])));
+                break;
+            case Operation::LN:
+                result = fromFloat<T>(FastMath::log(toFloat(values[args[0]])));
+                break;
+            case Operation::SIN:
+                result = fromFloat<T>(FastMath::sin(toFloat(values[args[0]])*value.asFloat));
+                break;
+            case Operation::COS:
+                result = fromFloat<T>(FastMath::cos(toFloat(values[args[0]])*value.asFloat));
+                break;
+            case Operation::TAN:
+                result = fromFloat<T>(FastMath::tan(toFloat(values[args[0]])*value.asFloat));
+                break;
+            case Operation::ATAN:
+                result = fromFloat<T>(FastMath::atan(toFloat(values[args[0]])*value.asFloat));
+                break;
+            case Operation::ABS:
+                result = (values[args[0]] < T(0) ? -values[args[0]] : values[args[0]]);
+                break;
+            case Operation::MIN:
+                result = (values[args[1]] < values[args[0]] ? values[args[1]] : values[args[0]]);
+                break;
+            case Operation::MAX:
+                result = (values[args[0]] < values[args[1]] ? values[args[1]] : values[args[0]]);
+                break;
+            case Operation::STEP:
+                result = (values[args[0]] >= T(0) ? T(1) : T(0));
+                break;
+            default:
+                // There is no reduced precision version of this step, so evaluate it in double.
+                
+                for (int i = 0; i < (int) args.size(); i++)
+                    workspace[args[i]] = toDouble(values[args[i]]);
+                result = T(evaluateStep(step));
+                break;
         }
     }
-    return workspace[workspace.size()-1];
+    return values[values.size()-1];
+}
+
+float CompiledExpression::evaluateFloat() const {
+    return evaluateScalar(workspaceFloat);
+}
+
+Fixed CompiledExpression::evaluateFixed() const {
+    return evaluateScalar(workspaceFixed);
 }
@@ -0,0 +1,134 @@
+#include "lepton/EvaluationContext.h"
+
+using namespace Lepton;
+
+static uint64_t (*clockSource)() = nullptr;
+static bool (*breakCheck)() = nullptr;
+
+EvaluationContext::EvaluationContext() : budgetDepth(0), operationsUsed(0), maxOperations(0), nextCheck(0), deadline(0), integrationError(0), randomSeeded(false) {
+#if LEPTON_THREADS > 1
+    sharedOperations = nullptr;
+    sharedReported = 0;
+#endif
+}
+
+EvaluationContext& EvaluationContext::current() {
+#if LEPTON_THREADS > 1
+    static thread_local EvaluationContext context;
+#else
+    static EvaluationContext context;
+#endif
+    return context;
+}
+
+void EvaluationContext::setClock(uint64_t (*clock)()) {
+    clockSource = clock;
+}
+
+void EvaluationContext::setBreakCheck(bool (*breakRequested)()) {
+    breakCheck = breakRequested;
+}
+
+void EvaluationContext::beginBudget(uint32_t maxOperations, uint64_t timeLimitUs) {
+    if (budgetDepth++ > 0)
+        return;
+    operationsUsed = 0;
+    integrationError = 0;
+    nextCheck = CHECK_INTERVAL;
+    this->maxOperations = maxOperations;
+    deadline = (timeLimitUs != 0 && clockSource != nullptr) ? clockSource() + timeLimitUs : 0;
+#if LEPTON_THREADS > 1
+    sharedOperations = nullptr;
+    sharedReported = 0;
+#endif
+}
+
+#if LEPTON_THREADS > 1
+void EvaluationContext::beginBudget(const EvaluationContext& parent, std::atomic<uint32_t>& shared) {
+    bool first = (budgetDepth == 0);
+    beginBudget(parent.budgetDepth > 0 ? parent.maxOperations : 0, 0);
+    if (first && parent.budgetDepth > 0) {
+        deadline = parent.deadline;
+        sharedOperations = &shared;
+    }
+}
+#endif
+
+void EvaluationContext::endBudget() {
+    if (budgetDepth > 0)
+        budgetDepth--;
+}
+
+void EvaluationContext::checkBudget() {
+    nextCheck = operationsUsed + CHECK_INTERVAL;
+    uint32_t used = operationsUsed;
+#if LEPTON_THREADS > 1
+    if (sharedOperations != nullptr) {
+        uint32_t unreported = operationsUsed-sharedReported;
+        used = sharedOperations->fetch_add(unreported)+unreported;
+        sharedReported = operationsUsed;
+    }
+#endif
+    if ((maxOperations != 0 && used > maxOperations) ||
+        (deadline != 0 && clockSource() > deadline) ||
+        (breakCheck != nullptr && breakCheck()))
+        stop();
+}
+
+void EvaluationContext::stop() {
+    // Drop the budget so the code unwinding from the break can still evaluate if it needs to.
+    budgetDepth = 0;
+    throw EvaluationBreak();
+}
+
+void EvaluationContext::seedRandom(uint64_t seed) {
+    // Spread the seed over the state with splitmix64, so that similar seeds give unrelated sequences and
+    // the all zero state, which xoshiro never leaves, cannot practically occur.
+
+    for (int i = 0; i < 4; i += 2) {
+        seed += 0x9E3779B97F4A7C15ULL;
+        uint64_t z = seed;
+        z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27))*0x94D049BB133111EBULL;
+        z ^= z >> 31;
+        randomState[i] = (uint32_t) z;
+        randomState[i+1] = (uint32_t) (z >> 32);
+    }
+    randomSeeded = true;
+}
+
+void EvaluationContext::seedFromClock() {
+    seedRandom(clockSource != nullptr ? clockSource() : 0);
+}
+
+uint64_t EvaluationContext::randomBelow(uint64_t bound, uint32_t threshold) {
+    if (bound == 0) // The whole 64 bit range
+        return ((uint64_t) nextRandom() << 32) | nextRandom();
+    if (bound <= 0x100000000ULL) {
+        // Lemire's method: the high word of a 32x32 bit product is in [0, bound), and rejecting the few low
+        // words below threshold makes every value equally likely.
+
+        uint64_t product = (uint64_t) nextRandom()*bound;
+        while ((uint32_t) product < threshold)
+            product = (uint64_t) nextRandom()*bound;
+        return product >> 32;
+    }
+    uint64_t mask = bound-1;
+    for (int shift = 1; shift < 64; shift *= 2)
+        mask |= mask >> shift;
+    uint64_t value;
+    do {
+        value = (((uint64_t) nextRandom() << 32) | nextRandom()) & mask;
+    } while (value >= bound);
+    return value;
+}
+
+static uint32_t rejectionThreshold(uint64_t bound) {
+    // 2^32 mod bound, the number of low words that would make some results more likely than others
+    return (bound != 0 && bound < 0x100000000ULL ? (uint32_t) (0x100000000ULL % bound) : 0);
+}
+
+int64_t EvaluationContext::randomInteger(int64_t low, int64_t high) {
+    uint64_t bound = (uint64_t) high - (uint64_t) low + 1;
+    return (int64_t) ((uint64_t) low + randomBelow(bound, rejectionThreshold(bound)));
+}
@@ -37,25 +37,25 @@ using namespace Lepton;
 using namespace std;
 
 ExpressionTreeNode::ExpressionTreeNode(Operation* operation, const vector<ExpressionTreeNode>& children) : operation(operation), children(children) {
-    if (operation->getNumArguments() != children.size())
+    if (operation->getNumArguments() >= 0 && operation->getNumArguments() != (int) children.size())
         throw Exception("Parse error: wrong number of arguments to function: "+operation->getName());
 }
 
 ExpressionTreeNode::ExpressionTreeNode(Operation* operation, const ExpressionTreeNode& child1, const ExpressionTreeNode& child2) : operation(operation) {
     children.push_back(child1);
     children.push_back(child2);
-    if (operation->getNumArguments() != children.size())
+    if (operation->getNumArguments() >= 0 && operation->getNumArguments() != (int) children.size())
         throw Exception("Parse error: wrong number of arguments to function: "+operation->getName());
 }
 
 ExpressionTreeNode::ExpressionTreeNode(Operation* operation, const ExpressionTreeNode& child) : operation(operation) {
     children.push_back(child);
-    if (operation->getNumArguments() != children.size())
+    if (operation->getNumArguments() >= 0 && operation->getNumArguments() != (int) children.size())
         throw Exception("Parse error: wrong number of arguments to function: "+operation->getName());
 }
 
 ExpressionTreeNode::ExpressionTreeNode(Operation* operation) : operation(operation) {
-    if (operation->getNumArguments() != children.size())
+    if (operation->getNumArguments() >= 0 && operation->getNumArguments() != (int) children.size())
         throw Exception("Parse error: wrong number of arguments to function: "+operation->getName());
 }
 
@@ -93,7 +93,7 @@ bool ExpressionTreeNode::operator==(const ExpressionTreeNode& node) const {
 ExpressionTreeNode& ExpressionTreeNode::operator=(const ExpressionTreeNode& node) {
     if (operation != NULL)
         delete operation;
-    operation = node.getOperation().clone();
+    operation = (node.operation == NULL ? NULL : node.operation->clone());
     children = node.getChildren();
     return *this;
 }
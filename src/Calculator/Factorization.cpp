@@ -0,0 +1,386 @@
+#include "lepton/Factorization.h"
+#include "lepton/EvaluationContext.h"
+#include "lepton/Exception.h"
+#include "lepton/SmallMatrix.h"
+#include <algorithm>
+#include <vector>
+#if LEPTON_THREADS > 1
+#include <mutex>
+#endif
+
+using namespace Lepton;
+using namespace std;
+
+// The cached factorizations, the most recently used first.
+
+static vector<shared_ptr<const Factorization> > cache;
+#if LEPTON_THREADS > 1
+static mutex cacheLock;
+#endif
+
+/**
+ * Get the largest absolute row sum of a matrix, which is its infinity norm.
+ */
+static double infinityNorm(const Eigen::MatrixXd& a) {
+    return (a.size() == 0 ? 0 : a.cwiseAbs().rowwise().sum().maxCoeff());
+}
+
+/**
+ * Get whether every element of a square matrix below its diagonal, or above it if upper is false, is zero.
+ */
+static bool isTriangular(const Eigen::MatrixXd& a, bool upper) {
+    for (int j = 0; j < a.cols(); j++)
+        for (int i = (upper ? j+1 : 0); i < (upper ? a.rows() : j); i++)
+            if (a(i, j) != 0)
+                return false;
+    return true;
+}
+
+Factorization::Factorization(const SharedMatrix& matrix) : matrix(matrix), symmetric(false), det(0), diagonalized(false) {
+#if LEPTON_SPARSE
+    if (matrix.isSparse()) {
+        factorSparse();
+        return;
+    }
+#endif
+    const Eigen::MatrixXd& a = matrix.get();
+    if (a.rows() != a.cols()) {
+        method = QR;
+        qr.compute(a);
+        return;
+    }
+    bool upper = isTriangular(a, true);
+    bool lower = isTriangular(a, false);
+    symmetric = ((upper && lower) || a == a.transpose());
+    if (upper || lower) {
+        // Substitution is backward stable however badly conditioned the matrix is, so only a zero on the
+        // diagonal, which makes it singular, needs QR.
+
+        det = a.diagonal().prod();
+        if ((a.diagonal().array() == 0).any()) {
+            method = QR;
+            qr.compute(a);
+            return;
+        }
+        method = (upper && lower ? DIAGONAL : upper ? UPPER : LOWER);
+        return;
+    }
+    if (a.rows() <= SmallMatrix::MAX_SIZE) {
+        det = SmallMatrix::determinant(a);
+        if (SmallMatrix::inverse(a, smallInverse) && infinityNorm(a)*infinityNorm(smallInverse) <= MAX_CONDITION) {
+            method = INVERSE;
+            return;
+        }
+    }
+    else {
+        if (symmetric) {
+            llt.compute(a);
+            if (llt.info() == Eigen::Success && llt.rcond() >= 1/MAX_CONDITION) {
+                method = LLT;
+                double root = llt.matrixLLT().diagonal().prod();
+                det = root*root;
+                return;
+            }
+            ldlt.compute(a);
+            if (ldlt.info() == Eigen::Success && (ldlt.isPositive() || ldlt.isNegative()) && ldlt.rcond() >= 1/MAX_CONDITION) {
+                method = LDLT;
+                det = ldlt.vectorD().prod(); // The permutations cancel, so this is the product of the pivots
+                return;
+            }
+        }
+        lu.compute(a);
+        det = lu.determinant();
+        if (lu.rcond() >= 1/MAX_CONDITION) {
+            method = LU;
+            return;
+        }
+    }
+    method = QR;
+    qr.compute(a);
+}
+
+#if LEPTON_SPARSE
+// Entries of the incomplete LU factors preconditioning BiCGSTAB that are smaller than this, relative to
+// their row, are dropped.
+
+static const double DROP_TOLERANCE = 1e-3;
+
+/**
+ * Get the number of nonzeros in the Cholesky factor of a square matrix with the pattern of a+a^T, in the
+ * fill reducing order the sparse factorizations use.  This is exact for Cholesky and a fair estimate for
+ * LU.  It is the symbolic part of the factorization, which takes time in proportion to the count but only
+ * O(n) memory beyond the pattern, so it is cheap next to finding out by factoring.
+ */
+static double predictedFill(const Eigen::SparseMatrix<double>& a) {
+    int n = a.rows();
+    Eigen::SparseMatrix<double> pattern = a.cwiseAbs();
+    pattern = pattern+Eigen::SparseMatrix<double>(pattern.transpose());
+    Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> inverseOrder;
+    Eigen::AMDOrdering<int>()(pattern, inverseOrder);
+    Eigen::SparseMatrix<double> permuted(n, n);
+    permuted.selfadjointView<Eigen::Upper>() = pattern.selfadjointView<Eigen::Lower>().twistedBy(inverseOrder.inverse());
+
+    // Row k of the factor holds every node reachable in the elimination tree from a nonzero above the
+    // diagonal in column k.
+
+    vector<int> parent(n), visited(n);
+    double count = n;
+    for (int k = 0; k < n; k++) {
+        parent[k] = -1;
+        visited[k] = k;
+        for (Eigen::SparseMatrix<double>::InnerIterator element(permuted, k); element; ++element) {
+            int i = element.index();
+            if (i < k) {
+                for (; visited[i] != k; i = parent[i]) {
+                    if (parent[i] == -1)
+                        parent[i] = k;
+                    count++;
+                    visited[i] = k;
+                }
+            }
+        }
+    }
+    return count;
+}
+
+void Factorization::factorSparse() {
+    const Eigen::SparseMatrix<double>& a = matrix.getSparse();
+    sparse.reset(new Sparse());
+    sparse->gmresReady = false;
+    if (a.rows() != a.cols()) {
+        method = SPARSE_QR;
+        sparse->qr.compute(a);
+        return;
+    }
+    symmetric = a.isApprox(Eigen::SparseMatrix<double>(a.transpose()), 0.0);
+    if (predictedFill(a) <= MAX_SPARSE_FILL*(double) a.nonZeros()) {
+        if (symmetric) {
+            sparse->llt.compute(a);
+            if (sparse->llt.info() == Eigen::Success) {
+                method = SPARSE_LLT;
+                det = sparse->llt.determinant();
+                return;
+            }
+        }
+        sparse->lu.compute(a);
+        if (sparse->lu.info() == Eigen::Success) {
+            method = SPARSE_LU;
+            det = sparse->lu.determinant();
+            return;
+        }
+
+        // LU fails on a structurally or numerically singular matrix.
+
+        method = SPARSE_QR;
+        sparse->qr.compute(a);
+        return;
+    }
+    if (symmetric) {
+        method = CG;
+        sparse->cg.setTolerance(ITERATIVE_TOLERANCE);
+        sparse->cg.compute(a);
+    }
+    else {
+        method = BICGSTAB;
+        sparse->bicgstab.setTolerance(ITERATIVE_TOLERANCE);
+        sparse->bicgstab.preconditioner().setDroptol(DROP_TOLERANCE);
+        sparse->bicgstab.compute(a);
+    }
+}
+
+Eigen::MatrixXd Factorization::solveIteratively(const Eigen::MatrixXd& b) const {
+    // The solvers record how the last solve went in themselves, so only one solve may run at a time.
+
+    lock_guard<mutex> guard(sparse->lock);
+    Eigen::MatrixXd x;
+    if (method == CG) {
+        x = sparse->cg.solve(b);
+        if (sparse->cg.info() == Eigen::Success)
+            return x;
+    }
+    else {
+        x = sparse->bicgstab.solve(b);
+        if (sparse->bicgstab.info() == Eigen::Success)
+            return x;
+    }
+
+    // GMRES cannot break down the way BiCGSTAB can, and does not need the matrix to be definite as CG does,
+    // so it is set up the first time either of them fails.
+
+    if (!sparse->gmresReady) {
+        sparse->gmres.setTolerance(ITERATIVE_TOLERANCE);
+        sparse->gmres.compute(matrix.getSparse());
+        sparse->gmresReady = true;
+    }
+    x = sparse->gmres.solve(b);
+    if (sparse->gmres.info() != Eigen::Success)
+        throw Exception("Math Error: solver did not converge");
+    return x;
+}
+#endif
+
+bool Factorization::matches(const SharedMatrix& other) const {
+    // Every stored value has its own version, so this does not need to look at the matrix itself, which
+    // for a sparse one would mean converting it.
+
+    return (matrix.getVersion() == other.getVersion());
+}
+
+shared_ptr<const Factorization> Factorization::find(const SharedMatrix& matrix) {
+    if (matrix.getVersion() == 0)
+        return make_shared<Factorization>(matrix); // Not stored, so it will not be seen again
+#if LEPTON_THREADS > 1
+    lock_guard<mutex> guard(cacheLock);
+#endif
+    for (int i = 0; i < (int) cache.size(); i++) {
+        if (cache[i]->matches(matrix)) {
+            shared_ptr<const Factorization> result = cache[i];
+            cache.erase(cache.begin()+i);
+            cache.insert(cache.begin(), result);
+            return result;
+        }
+    }
+    shared_ptr<const Factorization> result = make_shared<Factorization>(matrix);
+    cache.insert(cache.begin(), result);
+    if ((int) cache.size() > CACHE_SIZE)
+        cache.pop_back();
+    return result;
+}
+
+void Factorization::forget(const SharedMatrix& matrix) {
+#if LEPTON_THREADS > 1
+    lock_guard<mutex> guard(cacheLock);
+#endif
+    for (int i = 0; i < (int) cache.size(); i++) {
+        if (cache[i]->matches(matrix)) {
+            cache.erase(cache.begin()+i);
+            return;
+        }
+    }
+}
+
+double Factorization::determinant() const {
+    if (method == CG || method == BICGSTAB)
+        throw Exception("Error: Matrix is too large");
+    return det;
+}
+
+const Factorization::Eigendecomposition* Factorization::getEigendecomposition() const {
+#if LEPTON_THREADS > 1
+    lock_guard<mutex> guard(eigendecompositionLock);
+#endif
+    if (diagonalized)
+        return eigendecomposition.get();
+    diagonalized = true;
+    const Eigen::MatrixXd& a = matrix.get();
+    if (a.rows() != a.cols() || a.rows() == 0)
+        return NULL;
+    unique_ptr<Eigendecomposition> result(new Eigendecomposition());
+    if (method == DIAGONAL) {
+        result->values = a.diagonal().cast<complex<double> >();
+        result->vectors = Eigen::MatrixXcd::Identity(a.rows(), a.cols());
+        result->inverseVectors = result->vectors;
+    }
+    else if (symmetric) {
+        // The eigenvectors of a symmetric matrix are orthonormal, so they are inverted by transposing.
+
+        Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> solver(a);
+        if (solver.info() != Eigen::Success)
+            return NULL;
+        result->values = solver.eigenvalues().cast<complex<double> >();
+        result->vectors = solver.eigenvectors().cast<complex<double> >();
+        result->inverseVectors = result->vectors.adjoint();
+    }
+    else {
+        Eigen::EigenSolver<Eigen::MatrixXd> solver(a);
+        if (solver.info() != Eigen::Success)
+            return NULL;
+        Eigen::PartialPivLU<Eigen::MatrixXcd> vectorsLu(solver.eigenvectors());
+        if (!(vectorsLu.rcond() >= 1/MAX_CONDITION))
+            return NULL;
+        result->values = solver.eigenvalues();
+        result->vectors = solver.eigenvectors();
+        result->inverseVectors = vectorsLu.inverse();
+    }
+    eigendecomposition = move(result);
+    return eigendecomposition.get();
+}
+
+Eigen::MatrixXd Factorization::solve(const Eigen::MatrixXd& b) const {
+    switch (method) {
+        case DIAGONAL:
+            return matrix.get().diagonal().cwiseInverse().asDiagonal()*b;
+        case UPPER:
+            return matrix.get().triangularView<Eigen::Upper>().solve(b);
+        case LOWER:
+            return matrix.get().triangularView<Eigen::Lower>().solve(b);
+        case INVERSE:
+            return SmallMatrix::multiply(smallInverse, b);
+        case LLT:
+            return llt.solve(b);
+        case LDLT:
+            return ldlt.solve(b);
+        case LU:
+            return lu.solve(b);
+#if LEPTON_SPARSE
+        case SPARSE_LLT:
+            return sparse->llt.solve(b);
+        case SPARSE_LU:
+            return sparse->lu.solve(b);
+        case SPARSE_QR:
+            return sparse->qr.solve(b);
+        case CG:
+        case BICGSTAB:
+            return solveIteratively(b);
+#endif
+        default:
+            return qr.solve(b);
+    }
+}
+
+Eigen::MatrixXd Factorization::inverse() const {
+    if (matrix.rows() != matrix.cols())
+        throw Exception("Error: Not a square matrix");
+    switch (method) {
+        case DIAGONAL:
+            return matrix.get().diagonal().cwiseInverse().asDiagonal();
+        case INVERSE:
+            return smallInverse;
+        case QR:
+            if (!qr.isInvertible())
+                throw Exception("Math Error: matrix is singular");
+            return qr.inverse();
+#if LEPTON_SPARSE
+        case SPARSE_QR:
+            if (sparse->qr.rank() < matrix.rows())
+                throw Exception("Math Error: matrix is singular");
+            return solve(Eigen::MatrixXd::Identity(matrix.rows(), matrix.cols()));
+#endif
+        default:
+            return solve(Eigen::MatrixXd::Identity(matrix.rows(), matrix.cols()));
+    }
+}
+
+vector<complex<double> > Factorization::eigenvalues() const {
+    const Eigen::MatrixXd& a = matrix.get();
+    if (a.rows() != a.cols())
+        throw Exception("Error: Not a square matrix");
+    Eigen::VectorXcd values;
+    if (method == DIAGONAL || method == UPPER || method == LOWER)
+        values = a.diagonal().cast<complex<double> >();
+    else if (getEigendecomposition() != NULL)
+        values = getEigendecomposition()->values;
+    else {
+        // Not diagonalizable, but the eigenvalues alone still come from the Schur form.
+
+        Eigen::EigenSolver<Eigen::MatrixXd> solver(a, false);
+        if (solver.info() != Eigen::Success)
+            throw Exception("Math Error: eigenvalues did not converge");
+        values = solver.eigenvalues();
+    }
+    vector<complex<double> > result(values.data(), values.data()+values.size());
+    sort(result.begin(), result.end(), [](const complex<double>& x, const complex<double>& y) {
+        return (x.real() != y.real() ? x.real() < y.real() : x.imag() < y.imag());
+    });
+    return result;
+}
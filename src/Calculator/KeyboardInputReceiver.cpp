@@ -5,6 +5,10 @@
 #include <map>
 #include <vector>
 
+// Budget for evaluating the expression being stored, the ON key cancels sooner
+#define STORE_MAX_OPERATIONS 2000000
+#define STORE_TIME_LIMIT_US (30*1000*1000)
+
 // {"Y = ", "GRAPH", "left", "up", "right",
 //  "2ND", "X,theta", "GRAPH_FN", "GRAPH_CTRL", "down",
 //  "SPEC", "log10", "ln", "d/dx", "integral",
@@ -21,7 +25,8 @@ const uint8_t KeyboardInputReceiver::buttonCols[] = {15, 14, 7, 6, 5}; // {18, 1
 
 KeyboardInputReceiver::KeyboardInputReceiver(Screen *screen) : secondaryMode(false),
                                                               expression(""),
-                                                              screen__(screen) {
+                                                              screen__(screen),
+                                                              customFunctions(NULL) {
     pinSetup();
     initializeKeyMappings();
 }
@@ -69,6 +74,7 @@ void KeyboardInputReceiver::initializeKeyMappings() {
     primaryPrintableKeys[22] = "(";
     primaryPrintableKeys[23] = ")";
     primaryPrintableKeys[24] = "ans";
+    primaryPrintableKeys[25] = "solve(";
     primaryPrintableKeys[32] = "9";
     primaryPrintableKeys[31] = "8";
     primaryPrintableKeys[30] = "7";
@@ -89,7 +95,9 @@ void KeyboardInputReceiver::initializeKeyMappings() {
     secondaryPrintableKeys[11] = "*10^";
     secondaryPrintableKeys[12] = "*e^";
     secondaryPrintableKeys[13] = "lim(";
+    secondaryPrintableKeys[14] = "proots(";
     secondaryPrintableKeys[15] = "prod(";
+    secondaryPrintableKeys[16] = "ode(";
     secondaryPrintableKeys[17] = "PI";
     secondaryPrintableKeys[18] = "asin(";
     secondaryPrintableKeys[19] = "acos(";
@@ -121,6 +129,7 @@ void KeyboardInputReceiver::initializeKeyMappings() {
     primaryMenuKeys[19] = "LOGIC";
     primaryMenuKeys[27] = "MODE";
 
+    secondaryMenuKeys[0] = "Y-VARS";
     secondaryMenuKeys[25] = "MATRIX";
 }
 
@@ -231,6 +240,16 @@ int KeyboardInputReceiver::getButtonKeyIndex(int64_t &startTime) {
     }
 }
 
+// Check a single key without waiting or debouncing, used to interrupt long computations
+bool KeyboardInputReceiver::isKeyDown(int keyIndex) {
+    int row = keyIndex / N;
+    int col = keyIndex % N;
+    gpio_put(buttonRows[row], 1);
+    bool isDown = gpio_get(buttonCols[col]);
+    gpio_put(buttonRows[row], 0);
+    return isDown;
+}
+
 void KeyboardInputReceiver::buildExpression(int keyIndex) {
     if (secondaryMode && secondaryPrintableKeys.find(keyIndex) != secondaryPrintableKeys.end()) {
         expressionComponents.push_back(secondaryPrintableKeys[keyIndex]);
@@ -262,6 +281,11 @@ std::string KeyboardInputReceiver::getkeyIndexValue(int keyIndex) {
     }
 }
 
+// Functions that expressions stored with STO may call, such as the Y= functions
+void KeyboardInputReceiver::setCustomFunctions(const std::map<std::string, Lepton::CustomFunction*>* functions) {
+    customFunctions = functions;
+}
+
 // Evaluates expressionToStore and adds it to the variables map with associated variable name
 bool KeyboardInputReceiver::storeValue(std::string expressionToStore, std::map<std::string, double> &variables) {
     if (expressionToStore == "") {
@@ -285,7 +309,19 @@ bool KeyboardInputReceiver::storeValue(std::string expressionToStore, std::map<s
         }
     }
     std::string variableName = secondaryPrintableKeys[keyIndex];
-    double valueToStore = Lepton::Parser().parse(expressionToStore).evaluate(variables).getReal();
+    double valueToStore;
+    try {
+        Lepton::EvaluationBudget budget(STORE_MAX_OPERATIONS, STORE_TIME_LIMIT_US);
+        Lepton::ParsedExpression parsed = (customFunctions != NULL) ? Lepton::Parser().parse(expressionToStore, *customFunctions) : Lepton::Parser().parse(expressionToStore);
+        valueToStore = parsed.evaluate(variables).getReal();
+    } catch (const Lepton::EvaluationBreak& e) {
+        screen__->clearImage();
+        screen__->drawWrappingString(1, 1, expression + " -> Break", &Font16, BLACK, WHITE);
+        screen__->printImage();
+        toggleSecondaryMode();
+        sleep_ms(550);
+        return false;
+    }
     variables[variableName] = valueToStore;
 
     std::cout << variableName << std::endl;
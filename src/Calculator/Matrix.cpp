@@ -1,20 +1,151 @@
 #include "Matrix.h"
+#include "lepton/Factorization.h"
+#if LEPTON_SPARSE
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#endif
 
-std::map<std::string, Eigen::MatrixXd> matrixMap;
+std::map<std::string, SharedMatrix> matrixMap;
+
+static uint32_t lastVersion = 0;
+
+Eigen::MatrixXd& SharedMatrix::edit() {
+#if LEPTON_SPARSE
+    if (sparse) {
+        value = std::make_shared<Eigen::MatrixXd>(sparse->getDense());
+        sparse.reset();
+    }
+#endif
+    if (!value)
+        value = std::make_shared<Eigen::MatrixXd>();
+    else if (value.use_count() > 1)
+        value = std::make_shared<Eigen::MatrixXd>(*value);
+    if (version != 0)
+        version = ++lastVersion;
+    return *value;
+}
+
+/**
+ * Put a new value in the map, dropping what was cached for the one it replaces.
+ */
+static void storeValue(const std::string& matrixName, SharedMatrix value) {
+    // Expressions still holding the old value keep it, so the new one goes in a new handle.
+    std::map<std::string, SharedMatrix>::iterator old = matrixMap.find(matrixName);
+    if (old != matrixMap.end())
+        Lepton::Factorization::forget(old->second);
+    matrixMap[matrixName] = std::move(value);
+}
 
 //TO DO: should we prealloate entries in map and do error checking for names;
-void storeMatrixValue(std::string matrixName, Eigen::MatrixXd matrixValue) {
-    matrixMap[matrixName] = matrixValue;
+void storeMatrixValue(const std::string& matrixName, Eigen::MatrixXd matrixValue) {
+    storeValue(matrixName, SharedMatrix(std::move(matrixValue), ++lastVersion));
 }
 
-void deleteMatrixValue(std::string matrixName) {
-    matrixMap.erase(matrixName);
+void deleteMatrixValue(const std::string& matrixName) {
+    std::map<std::string, SharedMatrix>::iterator old = matrixMap.find(matrixName);
+    if (old != matrixMap.end()) {
+        Lepton::Factorization::forget(old->second);
+        matrixMap.erase(old);
+    }
 }
 
-Eigen::MatrixXd getMatrixValue(std::string matrixName) {
-    if (matrixMap.find(matrixName) != matrixMap.end()) {
-        return matrixMap[matrixName];
+const SharedMatrix& getMatrixValue(const std::string& matrixName) {
+    std::map<std::string, SharedMatrix>::const_iterator value = matrixMap.find(matrixName);
+    if (value != matrixMap.end()) {
+        return value->second;
     }
 
     throw Lepton::Exception("Error: Undefined matrix value");
-}
\ No newline at end of file
+}
+#if LEPTON_SPARSE
+const Eigen::MatrixXd& SharedMatrix::SparseValue::getDense() {
+    std::call_once(densified, [this]() { dense = matrix; });
+    return dense;
+}
+
+void storeMatrixValue(const std::string& matrixName, Eigen::SparseMatrix<double> matrixValue) {
+    matrixValue.makeCompressed();
+    storeValue(matrixName, SharedMatrix(std::move(matrixValue), ++lastVersion));
+}
+
+/**
+ * Read the next line of a Matrix Market file that is not a comment or blank.
+ */
+static bool readDataLine(std::istream& in, std::string& line) {
+    while (std::getline(in, line))
+        if (line.find_first_not_of(" \t\r") != std::string::npos && line[0] != '%')
+            return true;
+    return false;
+}
+
+void loadMatrixValue(const std::string& matrixName, const std::string& fileName) {
+    std::ifstream in(fileName);
+    if (!in)
+        throw Lepton::Exception("Error: Cannot open "+fileName);
+    const Lepton::Exception invalid("Error: Invalid Matrix Market file "+fileName);
+
+    // The header is "%%MatrixMarket matrix <format> <field> <symmetry>", in any case.
+
+    std::string line, banner, object, format, field, symmetry;
+    if (!std::getline(in, line))
+        throw invalid;
+    std::transform(line.begin(), line.end(), line.begin(), ::tolower);
+    std::istringstream header(line);
+    header >> banner >> object >> format >> field >> symmetry;
+    if (banner != "%%matrixmarket" || object != "matrix" || (format != "coordinate" && format != "array"))
+        throw invalid;
+    if (field != "real" && field != "integer" && field != "double" && !(field == "pattern" && format == "coordinate"))
+        throw Lepton::Exception("Error: Only real Matrix Market files are supported");
+    if (symmetry != "general" && symmetry != "symmetric" && symmetry != "skew-symmetric")
+        throw Lepton::Exception("Error: Only real Matrix Market files are supported");
+    bool symmetric = (symmetry != "general");
+    double mirrorSign = (symmetry == "skew-symmetric" ? -1.0 : 1.0);
+
+    long rows, cols, entries = 0;
+    if (!readDataLine(in, line))
+        throw invalid;
+    std::istringstream size(line);
+    // A header claiming more entries than the matrix has places is rejected before reserving room for
+    // them.  The product is taken in double, since it may not fit in a long.
+
+    if (!(size >> rows >> cols) || (format == "coordinate" && !(size >> entries)) || rows < 0 || cols < 0 || entries < 0 ||
+            (symmetric && rows != cols) || (double) entries > (double) rows*cols)
+        throw invalid;
+
+    if (format == "array") {
+        // Column major, and only the lower triangle if it is symmetric.
+
+        Eigen::MatrixXd dense = Eigen::MatrixXd::Zero(rows, cols);
+        for (long j = 0; j < cols; j++)
+            for (long i = (symmetric ? j : 0); i < rows; i++) {
+                if (symmetry == "skew-symmetric" && i == j)
+                    continue;
+                if (!readDataLine(in, line) || !(std::istringstream(line) >> dense(i, j)))
+                    throw invalid;
+                if (symmetric)
+                    dense(j, i) = mirrorSign*dense(i, j);
+            }
+        storeMatrixValue(matrixName, std::move(dense));
+        return;
+    }
+    std::vector<Eigen::Triplet<double> > triplets;
+    triplets.reserve(symmetric ? 2*entries : entries);
+    for (long k = 0; k < entries; k++) {
+        long i, j;
+        double value = 1.0;
+        if (!readDataLine(in, line))
+            throw invalid;
+        std::istringstream entry(line);
+        if (!(entry >> i >> j) || (field != "pattern" && !(entry >> value)) || i < 1 || i > rows || j < 1 || j > cols)
+            throw invalid;
+        triplets.push_back(Eigen::Triplet<double>(i-1, j-1, value));
+        if (symmetric && i != j)
+            triplets.push_back(Eigen::Triplet<double>(j-1, i-1, mirrorSign*value));
+    }
+    Eigen::SparseMatrix<double> sparse(rows, cols);
+    sparse.setFromTriplets(triplets.begin(), triplets.end()); // Repeated entries are summed
+    storeMatrixValue(matrixName, std::move(sparse));
+}
+#endif
@@ -0,0 +1,79 @@
+#include "lepton/MatrixPower.h"
+#include "lepton/Exception.h"
+#include "lepton/Factorization.h"
+#include "lepton/SmallMatrix.h"
+#include <cmath>
+#include <complex>
+
+using namespace Lepton;
+using namespace std;
+
+// The largest exponent that fits in the bits repeated squaring works through.
+
+static const double MAX_INTEGER_EXPONENT = 4611686018427387904.0; // 2^62
+
+// How large the imaginary part of V*D^p*V^-1 may be, relative to the real part, and still be taken as
+// rounding error.  Beyond it the power is not real, as for a fractional power of a negative eigenvalue.
+
+static const double IMAGINARY_TOLERANCE = 1e-8;
+
+/**
+ * Get base^exponent by repeated squaring.
+ */
+static Eigen::MatrixXd powerBySquaring(Eigen::MatrixXd base, uint64_t exponent) {
+    Eigen::MatrixXd result;
+    bool first = true;
+    while (true) {
+        if ((exponent&1) == 1) {
+            result = (first ? base : SmallMatrix::multiply(result, base));
+            first = false;
+        }
+        exponent >>= 1;
+        if (exponent == 0)
+            return result;
+        base = SmallMatrix::multiply(base, base);
+    }
+}
+
+/**
+ * Get V*D^p*V^-1 from an eigendecomposition.
+ *
+ * @return false if the power is not real
+ */
+static bool diagonalPower(const Factorization::Eigendecomposition& eigen, double exponent, Eigen::MatrixXd& result) {
+    Eigen::VectorXcd powers(eigen.values.size());
+    for (int i = 0; i < powers.size(); i++)
+        powers[i] = pow(eigen.values[i], exponent);
+    Eigen::MatrixXcd power = eigen.vectors*powers.asDiagonal()*eigen.inverseVectors;
+    if (!(power.imag().norm() <= IMAGINARY_TOLERANCE*power.real().norm()))
+        return false;
+    result = power.real();
+    return true;
+}
+
+Eigen::MatrixXd MatrixPower::evaluate(const SharedMatrix& matrix, double exponent) {
+    const Eigen::MatrixXd& a = matrix.get();
+    if (a.rows() != a.cols())
+        throw Exception("Error: Not a square matrix");
+    if (exponent == 0 || a.rows() == 0)
+        return Eigen::MatrixXd::Identity(a.rows(), a.cols());
+    bool integer = (exponent == floor(exponent) && abs(exponent) <= MAX_INTEGER_EXPONENT);
+    shared_ptr<const Factorization> factorization;
+    if (exponent < 0 || !integer || abs(exponent) > MAX_SQUARING_EXPONENT) {
+        factorization = Factorization::find(matrix);
+        if (exponent < 0 && factorization->determinant() == 0)
+            throw Exception("Math Error: matrix is singular");
+    }
+    if (!integer || abs(exponent) > MAX_SQUARING_EXPONENT) {
+        const Factorization::Eigendecomposition* eigen = factorization->getEigendecomposition();
+        Eigen::MatrixXd result;
+        if (eigen != NULL && diagonalPower(*eigen, exponent, result))
+            return result;
+    }
+    if (integer) {
+        if (exponent > 0)
+            return powerBySquaring(a, (uint64_t) exponent);
+        return powerBySquaring(factorization->inverse(), (uint64_t) -exponent);
+    }
+    return a.pow(exponent);
+}
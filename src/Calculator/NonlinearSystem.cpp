@@ -0,0 +1,166 @@
+#include "lepton/NonlinearSystem.h"
+#include "lepton/EvaluationContext.h"
+#include "lepton/Exception.h"
+#include "lepton/Operation.h"
+#include "lepton/ParsedExpression.h"
+#include <unsupported/Eigen/NonLinearOptimization>
+#include <algorithm>
+#include <cmath>
+
+using namespace Lepton;
+using namespace std;
+
+// A point is a solution if |f| there is within this fraction of |f| at the guess (or of 1 if that is
+// smaller).  Where the solver stalls at a minimum of |f| that is not a root, |f| stays near its size
+// at the guess.
+
+static const double RESIDUAL_TOLERANCE = 1e-8;
+
+namespace {
+
+/**
+ * Adapts a NonlinearSystem to the functor HybridNonLinearSolver expects.  A negative return stops it.
+ */
+
+struct SystemFunctor {
+    NonlinearSystem& system;
+    int operator()(const Eigen::VectorXd& x, Eigen::VectorXd& values) const {
+        return (system.evaluate(x.data(), values.data()) ? 0 : -1);
+    }
+    int df(const Eigen::VectorXd& x, Eigen::MatrixXd& jacobian) const {
+        return (system.evaluateJacobian(x.data(), jacobian.data()) ? 0 : -1);
+    }
+};
+
+/**
+ * Get whether every function in an expression has a real derivative.  The others return 0 for now.
+ */
+bool hasKnownDerivative(const ExpressionTreeNode& node) {
+    switch (node.getOperation().getId()) {
+        case Operation::FACTORIAL:
+        case Operation::GCD:
+        case Operation::LCM:
+        case Operation::FNINT:
+        case Operation::SIGMA:
+        case Operation::PROD:
+        case Operation::LIM:
+        case Operation::NPR:
+        case Operation::NCR:
+        case Operation::SOLVE:
+        case Operation::ODE:
+            return false;
+        default:
+            break;
+    }
+    for (const ExpressionTreeNode& child : node.getChildren())
+        if (!hasKnownDerivative(child))
+            return false;
+    return true;
+}
+
+}
+
+NonlinearSystem::NonlinearSystem(const vector<ExpressionTreeNode>& nodes, const vector<string>& unknowns, const map<string, double>& variables) :
+        unknowns(unknowns), variables(variables), jacobianKnown(true) {
+    int n = unknowns.size();
+    equations.resize(n);
+    equationInputs.resize(n);
+    for (int i = 0; i < n; i++) {
+        equations[i] = ParsedExpression(nodes[i]).createCompiledExpression();
+        bindVariables(equations[i], equationInputs[i]);
+        if (!hasKnownDerivative(nodes[i]))
+            jacobianKnown = false;
+    }
+    if (!jacobianKnown)
+        return;
+    try {
+        derivatives.resize(n*n);
+        derivativeInputs.resize(n*n);
+        for (int j = 0; j < n; j++)
+            for (int i = 0; i < n; i++) {
+                derivatives[i+j*n] = ParsedExpression(nodes[i]).differentiate(unknowns[j]).createCompiledExpression();
+                bindVariables(derivatives[i+j*n], derivativeInputs[i+j*n]);
+            }
+    }
+    catch (Exception& ex) {
+        // Some functions, such as sequences, have no derivative.
+
+        jacobianKnown = false;
+        derivatives.clear();
+        derivativeInputs.clear();
+    }
+}
+
+void NonlinearSystem::bindVariables(CompiledExpression& compiled, vector<double*>& references) {
+    references.assign(unknowns.size(), NULL);
+    for (const string& name : compiled.getVariables()) {
+        vector<string>::const_iterator unknown = find(unknowns.begin(), unknowns.end(), name);
+        if (unknown != unknowns.end()) {
+            references[unknown-unknowns.begin()] = &compiled.getVariableReference(name);
+            continue;
+        }
+        map<string, double>::const_iterator value = variables.find(name);
+        if (value == variables.end())
+            throw Exception("No value specified for variable "+name);
+        compiled.getVariableReference(name) = value->second;
+    }
+}
+
+double NonlinearSystem::evaluate(CompiledExpression& compiled, const vector<double*>& references, const double* x) {
+    EvaluationContext::current().consume();
+    for (int j = 0; j < (int) references.size(); j++)
+        if (references[j] != NULL)
+            *references[j] = x[j];
+    return compiled.evaluate();
+}
+
+bool NonlinearSystem::evaluate(const double* x, double* values) {
+    for (int i = 0; i < (int) equations.size(); i++) {
+        values[i] = evaluate(equations[i], equationInputs[i], x);
+        if (values[i] != values[i])
+            return false;
+    }
+    return true;
+}
+
+bool NonlinearSystem::evaluateJacobian(const double* x, double* jacobian) {
+    for (int i = 0; i < (int) derivatives.size(); i++) {
+        jacobian[i] = evaluate(derivatives[i], derivativeInputs[i], x);
+        if (jacobian[i] != jacobian[i])
+            return false;
+    }
+    return true;
+}
+
+bool NonlinearSystem::attempt(vector<double>& x) {
+    int n = unknowns.size();
+    Eigen::VectorXd point = Eigen::Map<Eigen::VectorXd>(x.data(), n);
+    Eigen::VectorXd values(n);
+    if (!evaluate(point.data(), values.data()))
+        return false;
+    double tolerance = RESIDUAL_TOLERANCE*max(1.0, values.norm());
+    SystemFunctor functor = {*this};
+    Eigen::HybridNonLinearSolver<SystemFunctor> solver(functor);
+    solver.parameters.maxfev = MAX_EVALUATIONS;
+    Eigen::HybridNonLinearSolverSpace::Status status = (jacobianKnown ? solver.solve(point) : solver.solveNumericalDiff(point));
+    if (status == Eigen::HybridNonLinearSolverSpace::ImproperInputParameters || status == Eigen::HybridNonLinearSolverSpace::UserAsked)
+        return false;
+    if (!(solver.fnorm <= tolerance))
+        return false;
+    Eigen::VectorXd::Map(x.data(), n) = point;
+    return true;
+}
+
+bool NonlinearSystem::solve(vector<double>& x) {
+    vector<double> guess = x;
+    for (int start = 0; start < 3; start++) {
+        for (int j = 0; j < (int) x.size(); j++) {
+            double shift = max(1.0, abs(guess[j]));
+            x[j] = (start == 0 ? guess[j] : start == 1 ? guess[j]+shift : guess[j]-shift);
+        }
+        if (attempt(x))
+            return true;
+    }
+    x = guess;
+    return false;
+}
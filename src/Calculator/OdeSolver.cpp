@@ -0,0 +1,158 @@
+#include "lepton/OdeSolver.h"
+#include "lepton/EvaluationContext.h"
+#include "lepton/Exception.h"
+#include "lepton/ParsedExpression.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+using namespace Lepton;
+using namespace std;
+
+// The relative and absolute error solve() allows in each step.  The global error is usually within a small
+// multiple of it.
+
+static const double SOLVE_TOLERANCE = 1e-11;
+static const double EPSILON = numeric_limits<double>::epsilon();
+
+// The Dormand-Prince tableau.  The weights of the fifth order solution are the last row of A, and E is
+// the difference between them and the fourth order weights.
+
+static const double C2 = 1.0/5, C3 = 3.0/10, C4 = 4.0/5, C5 = 8.0/9;
+static const double A21 = 1.0/5;
+static const double A31 = 3.0/40, A32 = 9.0/40;
+static const double A41 = 44.0/45, A42 = -56.0/15, A43 = 32.0/9;
+static const double A51 = 19372.0/6561, A52 = -25360.0/2187, A53 = 64448.0/6561, A54 = -212.0/729;
+static const double A61 = 9017.0/3168, A62 = -355.0/33, A63 = 46732.0/5247, A64 = 49.0/176, A65 = -5103.0/18656;
+static const double A71 = 35.0/384, A73 = 500.0/1113, A74 = 125.0/192, A75 = -2187.0/6784, A76 = 11.0/84;
+static const double E1 = 71.0/57600, E3 = -71.0/16695, E4 = 71.0/1920, E5 = -17253.0/339200, E6 = 22.0/525, E7 = -1.0/40;
+
+// Coefficients of the dense output, from Hairer, Norsett and Wanner's DOPRI5.
+
+static const double D1 = -12715105075.0/11282082432, D3 = 87487479700.0/32700410799, D4 = -10690763975.0/1880347072,
+        D5 = 701980252875.0/199316789632, D6 = -1453857185.0/822651844, D7 = 69997945.0/29380423;
+
+OdeSolver::OdeSolver(const ExpressionTreeNode& node, const string& x, const string& y, const map<string, double>& variables) {
+    expression = ParsedExpression(node).createCompiledExpression();
+    xReference = yReference = NULL;
+    for (const string& name : expression.getVariables()) {
+        if (name == x)
+            xReference = &expression.getVariableReference(name);
+        else if (name == y)
+            yReference = &expression.getVariableReference(name);
+        else {
+            map<string, double>::const_iterator value = variables.find(name);
+            if (value == variables.end())
+                throw Exception("No value specified for variable "+name);
+            expression.getVariableReference(name) = value->second;
+        }
+    }
+}
+
+double OdeSolver::evaluate(double x, double y) {
+    EvaluationContext::current().consume();
+    if (xReference != NULL)
+        *xReference = x;
+    if (yReference != NULL)
+        *yReference = y;
+    return expression.evaluate();
+}
+
+double OdeSolver::initialStep(double x, double y, double f, double direction, double absolute, double relative) {
+    // Hairer and Wanner's estimate: a step that moves y by about 1% of its size, then checked against an
+    // Euler step to see how fast f changes.
+
+    double scale = absolute + relative*abs(y);
+    double d0 = abs(y)/scale, d1 = abs(f)/scale;
+    double h0 = (d0 < 1e-5 || d1 < 1e-5 ? 1e-6 : 0.01*d0/d1);
+    double f1 = evaluate(x+direction*h0, y+direction*h0*f);
+    double d2 = abs(f1-f)/scale/h0;
+    double largest = max(d1, d2);
+    double h1 = (largest <= 1e-15 ? max(1e-6, h0*1e-3) : pow(0.01/largest, 0.2));
+    double h = min(100*h0, h1);
+    return (h == h ? h : 1e-6);
+}
+
+void OdeSolver::integrate(double start, double value, const double* points, int count, double absolute, double relative, double* values) {
+    int next = 0;
+    while (next < count && points[next] == start)
+        values[next++] = value;
+    if (next == count)
+        return;
+    double direction = (points[count-1] > start ? 1 : -1);
+    double x = start, y = value;
+    double k1 = evaluate(x, y);
+    double h = (k1 == k1 ? direction*initialStep(x, y, k1, direction, absolute, relative) : 0);
+    bool rejected = false;
+    for (int step = 0; step < MAX_STEPS && next < count && k1 == k1; step++) {
+        // Land exactly on the last point, and stop if the step has become too small to move x.
+
+        if (direction*(x+h-points[count-1]) > 0)
+            h = points[count-1]-x;
+        if (!(abs(h) > 16*EPSILON*abs(x)) || h == 0)
+            break;
+        double k2 = evaluate(x+C2*h, y+h*A21*k1);
+        double k3 = evaluate(x+C3*h, y+h*(A31*k1+A32*k2));
+        double k4 = evaluate(x+C4*h, y+h*(A41*k1+A42*k2+A43*k3));
+        double k5 = evaluate(x+C5*h, y+h*(A51*k1+A52*k2+A53*k3+A54*k4));
+        double k6 = evaluate(x+h, y+h*(A61*k1+A62*k2+A63*k3+A64*k4+A65*k5));
+        double next5 = y+h*(A71*k1+A73*k3+A74*k4+A75*k5+A76*k6);
+        double k7 = evaluate(x+h, next5);
+        double error = abs(h*(E1*k1+E3*k3+E4*k4+E5*k5+E6*k6+E7*k7))/(absolute + relative*max(abs(y), abs(next5)));
+        if (!(error <= 1)) {
+            // Shrink the step, by a factor of 5 if the error could not be measured.
+
+            h *= (error == error ? max(0.2, 0.9*pow(error, -0.2)) : 0.2);
+            rejected = true;
+            continue;
+        }
+
+        // y(x+theta*h) = r1 + theta*(r2 + (1-theta)*(r3 + theta*(r4 + (1-theta)*r5))).
+
+        double r2 = next5-y;
+        double r3 = h*k1-r2;
+        double r4 = r2-h*k7-r3;
+        double r5 = h*(D1*k1+D3*k3+D4*k4+D5*k5+D6*k6+D7*k7);
+        double end = x+h;
+        for (; next < count && direction*(points[next]-end) <= 0; next++) {
+            double theta = (points[next]-x)/h, rest = 1-theta;
+            values[next] = y + theta*(r2 + rest*(r3 + theta*(r4 + rest*r5)));
+        }
+        x = end;
+        y = next5;
+        k1 = k7;
+        if (!(abs(y) < numeric_limits<double>::infinity()))
+            break;
+        double growth = (error == 0 ? 10 : min(10.0, max(0.2, 0.9*pow(error, -0.2))));
+        h *= (rejected ? min(1.0, growth) : growth);
+        rejected = false;
+    }
+    for (; next < count; next++)
+        values[next] = numeric_limits<double>::quiet_NaN();
+}
+
+double OdeSolver::solve(double start, double value, double end) {
+    double result;
+    integrate(start, value, &end, 1, SOLVE_TOLERANCE, SOLVE_TOLERANCE, &result);
+    return result;
+}
+
+void OdeSolver::sample(double start, double value, double first, double spacing, int count, double absolute, double relative, double* values) {
+    // Split the points at start, and integrate outwards from it in each direction.
+
+    vector<double> points(count);
+    for (int i = 0; i < count; i++)
+        points[i] = first+i*spacing;
+    int split = 0;
+    while (split < count && points[split] < start)
+        split++;
+    if (split < count)
+        integrate(start, value, &points[split], count-split, absolute, relative, &values[split]);
+    if (split > 0) {
+        vector<double> below(points.rend()-split, points.rend()), belowValues(split);
+        integrate(start, value, below.data(), split, absolute, relative, belowValues.data());
+        for (int i = 0; i < split; i++)
+            values[i] = belowValues[split-1-i];
+    }
+}
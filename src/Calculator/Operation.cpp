@@ -32,7 +32,15 @@
 
 #include "lepton/Operation.h"
 #include "lepton/ExpressionTreeNode.h"
+#include "lepton/NonlinearSystem.h"
+#include "lepton/OdeSolver.h"
+#include "lepton/PolynomialRoots.h"
+#include "lepton/Summation.h"
+#include "lepton/UnivariateFunction.h"
+#include <algorithm>
+#include <cmath>
 #include <complex>
+#include <limits>
 
 using namespace Lepton;
 using namespace std;
@@ -51,6 +59,261 @@ Result Operation::Erfc::evaluate(Args& args, const map<string, double>& variable
     return erfc(args.inputs[0].getReal());
 }
 
+// The largest n for which n! is finite as a double.
+
+static const int MAX_FACTORIAL = 170;
+
+// nPr and nCr with at most this many factors are multiplied out, which is exact whenever the result and
+// the partial products are below 2^53.
+
+static const int MAX_FACTORS = 30;
+
+/**
+ * Get n! for n in [0, MAX_FACTORIAL].  The values up to 22! are exact, and the rest are within a few ulps.
+ */
+
+static double factorialTable(int n) {
+    // A function local static is filled exactly once, even when sums are evaluated on several threads.
+
+    static const struct Table {
+        double values[MAX_FACTORIAL+1];
+        Table() {
+            values[0] = 1;
+            for (int i = 1; i <= MAX_FACTORIAL; i++)
+                values[i] = values[i-1]*i;
+        }
+    } table;
+    return table.values[n];
+}
+
+static bool isInteger(double x) {
+    return x == floor(x);
+}
+
+/**
+ * Get x!, which is gamma(x+1) for x that is not an integer.
+ */
+
+static double factorial(double x) {
+    if (isInteger(x)) {
+        if (x < 0)
+            throw Exception("Math Error: Factorial of a negative number does not exist");
+        return (x <= MAX_FACTORIAL ? factorialTable((int) x) : numeric_limits<double>::infinity());
+    }
+    return tgamma(x+1);
+}
+
+/**
+ * Get x!/y!.  Where both overflow but are positive, their logarithms are subtracted instead.
+ */
+
+static double factorialRatio(double x, double y) {
+    if (isInteger(x) && isInteger(y) && x >= 0 && y >= 0 && x <= MAX_FACTORIAL && y <= MAX_FACTORIAL)
+        return factorialTable((int) x)/factorialTable((int) y);
+    if (x > MAX_FACTORIAL && y > -1)
+        return exp(lgamma(x+1)-lgamma(y+1));
+    return factorial(x)/factorial(y);
+}
+
+Result Operation::Factorial::evaluate(Args& args, const map<string, double>& variables) const {
+    if (isMatrix(args.inputs[0])) {
+        throw Exception("Matrices are not supported with factorial");
+    }
+
+    // Computation with complex numbers involves integral calculations for the gamma function
+    if (args.inputs[0].getImag() != 0) {
+        throw Exception("Error: Factorial for complex numbers is not supported");
+    }
+    return Result(factorial(args.inputs[0].getReal()));
+}
+
+Result Operation::Npr::evaluate(Args& args, const map<string, double>& variables) const {
+    if (isMatrix(args.inputs[0]) || isMatrix(args.inputs[1])) {
+        throw Exception("Matrices are not supported with nPr");
+    }
+    if (args.inputs[0].getImag() != 0 || args.inputs[1].getImag() != 0) {
+        throw Exception("NPR with complex numbers not supported");
+    }
+    double n = args.inputs[0].getReal();
+    double r = args.inputs[1].getReal();
+    if (isInteger(n) && isInteger(r)) {
+        if (n < 0 || r < 0)
+            throw Exception("Math Error: nPr is not defined for negative numbers");
+        if (r > n)
+            return Result(0.0);
+    }
+    if (isInteger(r) && r >= 0 && r <= MAX_FACTORS) {
+        // n*(n-1)*...*(n-r+1)
+
+        double result = 1;
+        for (int i = 0; i < r; i++)
+            result *= n-i;
+        return Result(result);
+    }
+    return Result(factorialRatio(n, n-r));
+}
+
+Result Operation::Ncr::evaluate(Args& args, const map<string, double>& variables) const {
+    if (isMatrix(args.inputs[0]) || isMatrix(args.inputs[1])) {
+        throw Exception("Matrices are not supported with nCr");
+    }
+    if (args.inputs[0].getImag() != 0 || args.inputs[1].getImag() != 0) {
+        throw Exception("NCR with complex numbers not supported");
+    }
+    double n = args.inputs[0].getReal();
+    double r = args.inputs[1].getReal();
+    bool integers = (isInteger(n) && isInteger(r));
+    if (integers) {
+        if (n < 0 || r < 0)
+            throw Exception("Math Error: nCr is not defined for negative numbers");
+        if (r > n)
+            return Result(0.0);
+        r = min(r, n-r);
+    }
+    if (isInteger(r) && r >= 0 && r <= MAX_FACTORS) {
+        // Multiplying by (n-r+i)/i in turn keeps every partial result a whole binomial coefficient.
+
+        double result = 1;
+        for (int i = 1; i <= r; i++)
+            result = result*(n-r+i)/i;
+        return Result(result);
+    }
+    if (!integers)
+        return Result(factorialRatio(n, n-r)/factorial(r));
+    if (n <= MAX_FACTORIAL)
+        return Result(factorialTable((int) n)/(factorialTable((int) r)*factorialTable((int) (n-r))));
+    return Result(exp(lgamma(n+1)-lgamma(r+1)-lgamma(n-r+1)));
+}
+
+Result Operation::Rand::evaluate(Args& args, const map<string, double>& variables) const {
+    if (isMatrix(args.inputs[0]) || isMatrix(args.inputs[1])) {
+        throw Exception("Matrices are not supported with RNG");
+    }
+    if (args.inputs[0].getImag() != 0 || args.inputs[1].getImag() != 0) {
+        throw Exception("Complex numbers not supported with RNG");
+    }
+    double low = trunc(args.inputs[0].getReal());
+    double high = trunc(args.inputs[1].getReal());
+    if (!(abs(low) < 9.2233720368547758e18 && abs(high) < 9.2233720368547758e18))
+        throw Exception("RNG limits must be below 2^63");
+    if (low > high)
+        throw Exception("RNG minimum must not be above its maximum");
+    return Result((double) EvaluationContext::current().randomInteger((int64_t) low, (int64_t) high));
+}
+
+Result Operation::Lim::evaluate(Args& args, const map<string, double>& variables) const {
+    if (isMatrix(args.inputs[0]) || isMatrix(args.inputs[1])) {
+        throw Exception("Matrices are not supported with lim");
+    }
+    // An infinite point such as 1/0 has a NaN imaginary part, which abs() > 0 lets through.
+    if (abs(args.inputs[0].getImag()) > 0 || args.inputs[1].getImag() != 0) {
+        throw Exception("Limit point must be purely real");
+    }
+    double side = args.inputs[1].getReal();
+    UnivariateFunction function(args.node, args.variableName, variables);
+    double error;
+    double result = function.findLimit(args.inputs[0].getReal(), (side > 0 ? 1 : side < 0 ? -1 : 0), error);
+    if (result != result)
+        throw Exception("Math Error: limit does not exist");
+    return Result(result);
+}
+
+Result Operation::Solve::evaluate(Args& args, const map<string, double>& variables) const {
+    const vector<ExpressionTreeNode>& children = args.node.getChildren();
+    int n = children.size()/2;
+    if (children.size()%2 != 0 || n == 0 || n > NonlinearSystem::MAX_UNKNOWNS) {
+        throw Exception("solve needs 1 to 10 equations followed by as many variables");
+    }
+    vector<ExpressionTreeNode> equations(children.begin(), children.begin()+n);
+    vector<string> unknowns;
+    vector<double> x;
+    for (int i = n; i < 2*n; i++) {
+        const Operation& op = children[i].getOperation();
+        if (op.getId() != VARIABLE || find(unknowns.begin(), unknowns.end(), op.getName()) != unknowns.end()) {
+            throw Exception("solve needs different variables to solve for");
+        }
+        unknowns.push_back(op.getName());
+        map<string, double>::const_iterator value = variables.find(op.getName());
+        x.push_back(value == variables.end() ? 0.0 : value->second);
+    }
+    NonlinearSystem system(equations, unknowns, variables);
+    if (!system.solve(x))
+        throw Exception("Math Error: no solution found");
+    if (n == 1)
+        return Result(x[0]);
+    return Result(Eigen::MatrixXd(Eigen::Map<Eigen::VectorXd>(x.data(), n)));
+}
+
+Result Operation::Ode::evaluate(Args& args, const map<string, double>& variables) const {
+    for (int i = 0; i < 3; i++) {
+        if (isMatrix(args.inputs[i])) {
+            throw Exception("Matrices are not supported with ode");
+        }
+        if (args.inputs[i].getImag() != 0) {
+            throw Exception("ode needs finite real values");
+        }
+    }
+    const vector<ExpressionTreeNode>& children = args.node.getChildren();
+    if (children[1].getOperation().getId() != VARIABLE || children[2].getOperation().getId() != VARIABLE) {
+        throw Exception("ode needs the names of x and y");
+    }
+    OdeSolver solver(children[0], children[1].getOperation().getName(), children[2].getOperation().getName(), variables);
+    double result = solver.solve(args.inputs[0].getReal(), args.inputs[1].getReal(), args.inputs[2].getReal());
+    if (result != result)
+        throw Exception("Math Error: solution is undefined");
+    return Result(result);
+}
+
+Result Operation::Proots::evaluate(Args& args, const map<string, double>& variables) const {
+    PolynomialRoots polynomial(args.node, args.variableName, variables);
+    if (polynomial.getDegree() == 0)
+        throw Exception("Math Error: polynomial has no roots");
+    vector<complex<double> > roots = polynomial.findRoots();
+    Eigen::MatrixXd result(roots.size(), 2);
+    for (int i = 0; i < (int) roots.size(); i++) {
+        result(i, 0) = roots[i].real();
+        result(i, 1) = roots[i].imag();
+    }
+    return Result(result);
+}
+
+Result Operation::FnInt::evaluate(Args& args, const map<string, double>& variables) const {
+    if (isMatrix(args.inputs[0]) || isMatrix(args.inputs[1])) {
+        throw Exception("Matrices are not supported with fnInt");
+    }
+    // An infinite limit such as 1/0 has a NaN imaginary part, which abs() > 0 lets through.
+    if (abs(args.inputs[0].getImag()) > 0 || abs(args.inputs[1].getImag()) > 0) {
+        throw Exception("Integration limits must be purely real");
+    }
+    UnivariateFunction integrand(args.node, args.variableName, variables);
+    double error;
+    double result = integrand.integrate(args.inputs[0].getReal(), args.inputs[1].getReal(), error);
+    EvaluationContext::current().reportIntegrationError(error);
+    return Result(result);
+}
+
+Result Operation::Sigma::evaluate(Args& args, const map<string, double>& variables) const {
+    if (isMatrix(args.inputs[0]) || isMatrix(args.inputs[1])) {
+        throw Exception("Matrices are not supported with sigma");
+    }
+    if (args.inputs[0].getImag() != 0 || args.inputs[1].getImag() != 0) {
+        throw Exception("Summation limits must be purely real");
+    }
+    Summation summation(args.node, args.variableName, variables);
+    return Result(summation.sum(args.inputs[0].getReal(), args.inputs[1].getReal()));
+}
+
+Result Operation::Prod::evaluate(Args& args, const map<string, double>& variables) const {
+    if (isMatrix(args.inputs[0]) || isMatrix(args.inputs[1])) {
+        throw Exception("Matrices are not supported with prod");
+    }
+    if (args.inputs[0].getImag() != 0 || args.inputs[1].getImag() != 0) {
+        throw Exception("prod limits must be purely real");
+    }
+    Summation summation(args.node, args.variableName, variables);
+    return Result(summation.product(args.inputs[0].getReal(), args.inputs[1].getReal()));
+}
+
 ExpressionTreeNode Operation::ComplexNumber::differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const {
     return ExpressionTreeNode(new Operation::Constant(0.0));
 }
@@ -59,6 +322,10 @@ ExpressionTreeNode Operation::Constant::differentiate(const std::vector<Expressi
     return ExpressionTreeNode(new Operation::Constant(0.0));
 }
 
+ExpressionTreeNode Operation::Integer::differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const {
+    return ExpressionTreeNode(new Operation::Constant(0.0));
+}
+
 ExpressionTreeNode Operation::Variable::differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const {
     if (variable == name)
         return ExpressionTreeNode(new Operation::Constant(1.0));
@@ -92,6 +359,14 @@ ExpressionTreeNode Operation::SolveSOLE::differentiate(const std::vector<Express
     return ExpressionTreeNode(new Operation::SolveSOLE(), childDerivs[0], childDerivs[1]);
 }
 
+ExpressionTreeNode Operation::Eig::differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const {
+    return ExpressionTreeNode(new Operation::Eig(), childDerivs[0]);
+}
+
+ExpressionTreeNode Operation::Inv::differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const {
+    return ExpressionTreeNode(new Operation::Inv(), childDerivs[0]);
+}
+
 ExpressionTreeNode Operation::Custom::differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const {
     if (function->getNumArguments() == 0)
         return ExpressionTreeNode(new Operation::Constant(0.0));
@@ -236,6 +511,30 @@ ExpressionTreeNode Operation::Prod::differentiate(const std::vector<ExpressionTr
 
 }
 
+ExpressionTreeNode Operation::Lim::differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const {
+    // TO DO: compute the correct derivate of a Lim. Set arbitary derivative for now to speed up development.
+    return ExpressionTreeNode(new Operation::Constant(0.0));
+
+}
+
+ExpressionTreeNode Operation::Solve::differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const {
+    // TO DO: compute the correct derivate of a Solve. Set arbitary derivative for now to speed up development.
+    return ExpressionTreeNode(new Operation::Constant(0.0));
+
+}
+
+ExpressionTreeNode Operation::Ode::differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const {
+    // TO DO: compute the correct derivate of an Ode. Set arbitary derivative for now to speed up development.
+    return ExpressionTreeNode(new Operation::Constant(0.0));
+
+}
+
+ExpressionTreeNode Operation::Proots::differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const {
+    // The roots do not depend on the bound variable.
+    return ExpressionTreeNode(new Operation::Constant(0.0));
+
+}
+
 ExpressionTreeNode Operation::Npr::differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const {
     // TO DO: compute the correct derivate of NPR. Set arbitary derivative for now to speed up development.
     return ExpressionTreeNode(new Operation::Constant(0.0));
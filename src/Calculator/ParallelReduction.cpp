@@ -0,0 +1,98 @@
+#include "lepton/ParallelReduction.h"
+#include <algorithm>
+#if LEPTON_THREADS > 1
+#include <unsupported/Eigen/CXX11/ThreadPool>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#endif
+
+using namespace Lepton;
+using namespace std;
+
+#if LEPTON_THREADS > 1
+
+static int threadCount = LEPTON_THREADS;
+
+/**
+ * Get the pool the chunks run on, which is started the first time it is needed.
+ */
+static Eigen::NonBlockingThreadPool& threadPool() {
+    static Eigen::NonBlockingThreadPool pool(threadCount);
+    return pool;
+}
+
+#endif
+
+int ParallelReduction::chunkCount(double count) {
+    if (!(count >= 2*MIN_CHUNK_SIZE))
+        return 1;
+    return (int) min((double) MAX_CHUNKS, floor(count/MIN_CHUNK_SIZE));
+}
+
+void ParallelReduction::setThreadCount(int threads) {
+#if LEPTON_THREADS > 1
+    threadCount = max(1, threads);
+#else
+    (void) threads;
+#endif
+}
+
+void ParallelReduction::run(int chunks, const function<void(int)>& task) {
+#if LEPTON_THREADS > 1
+    Eigen::NonBlockingThreadPool& pool = threadPool();
+    if (chunks > 1 && pool.CurrentThreadId() < 0) {
+        EvaluationContext& parent = EvaluationContext::current();
+        vector<exception_ptr> errors(chunks);
+        vector<uint32_t> used(chunks, 0);
+        vector<double> integrationErrors(chunks, 0.0);
+        mutex lock;
+        condition_variable finished;
+        int remaining = chunks;
+        atomic<uint32_t> shared(parent.getOperationsUsed());
+        for (int i = 0; i < chunks; i++) {
+            pool.Schedule([&, i]() {
+                EvaluationContext& context = EvaluationContext::current();
+                context.beginBudget(parent, shared);
+                try {
+                    task(i);
+                }
+                catch (...) {
+                    errors[i] = current_exception();
+                }
+                used[i] = context.getOperationsUsed();
+                integrationErrors[i] = context.getIntegrationError();
+                context.endBudget();
+                lock_guard<mutex> guard(lock);
+                if (--remaining == 0)
+                    finished.notify_one();
+            });
+        }
+        {
+            unique_lock<mutex> guard(lock);
+            finished.wait(guard, [&]() { return remaining == 0; });
+        }
+        uint32_t total = 0;
+        for (int i = 0; i < chunks; i++) {
+            total += used[i];
+            if (integrationErrors[i] > 0)
+                parent.reportIntegrationError(integrationErrors[i]);
+        }
+        for (int i = 0; i < chunks; i++) {
+            if (!errors[i])
+                continue;
+            try {
+                rethrow_exception(errors[i]);
+            }
+            catch (EvaluationBreak&) {
+                parent.stop(); // The break ended the chunk's budget, so end the caller's as well
+            }
+        }
+        parent.consume(total);
+        return;
+    }
+#endif
+    for (int i = 0; i < chunks; i++)
+        task(i);
+}
@@ -32,6 +32,7 @@
 #include "lepton/ParsedExpression.h"
 #include "lepton/CompiledExpression.h"
 #include "lepton/Operation.h"
+#include <cmath>
 #include <limits>
 #include <vector>
 #include <iostream>
@@ -67,8 +68,12 @@ Result ParsedExpression::publicEvaluate(const ExpressionTreeNode& node, const ma
 Result ParsedExpression::evaluate(const ExpressionTreeNode& node, const map<string, double>& variables) {
     int numArgsToNotEvaluate = 0;
     std::string opName = node.getOperation().getName();
-    if (opName == "fnInt" || opName == "sigma" || opName == "prod") {
+    if (opName == "fnInt" || opName == "sigma" || opName == "prod" || opName == "lim" || opName == "proots") {
         numArgsToNotEvaluate = 2;
+    } else if (opName == "solve") {
+        numArgsToNotEvaluate = node.getChildren().size();
+    } else if (opName == "ode") {
+        numArgsToNotEvaluate = 3;
     }
 
     Args args;
@@ -87,14 +92,173 @@ Result ParsedExpression::evaluate(const ExpressionTreeNode& node, const map<stri
         }
     }
 
-    args.inputs = inputsVec;
-    if (opName == "fnInt" || opName == "sigma" || opName == "prod") {
+    args.inputs = std::move(inputsVec);
+    if (opName == "fnInt" || opName == "sigma" || opName == "prod" || opName == "lim" || opName == "proots") {
         args.node = node.getChildren()[0];
         args.variableName = node.getChildren()[1].getOperation().getName();
+    } else if (opName == "solve" || opName == "ode") {
+        args.node = node;
     }
     return node.getOperation().evaluate(args, variables);
 }
 
+int64_t ParsedExpression::evaluateInteger(const map<string, int64_t>& variables) const {
+    return evaluateInteger(getRootNode(), variables);
+}
+
+// Programmer mode arithmetic wraps around at 64 bits like the hardware does.  It is done on unsigned values,
+// since signed overflow is undefined (and traps with -ftrapv), then converted back to two's complement.
+
+static int64_t wrap(uint64_t value) {
+    return (int64_t) value;
+}
+
+static uint64_t magnitude(int64_t value) {
+    return (value < 0 ? 0-(uint64_t) value : value);
+}
+
+static uint64_t integerGCD(uint64_t a, uint64_t b) {
+    while (b != 0) {
+        uint64_t r = a%b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+int64_t ParsedExpression::evaluateInteger(const ExpressionTreeNode& node, const map<string, int64_t>& variables) {
+    const Operation& op = node.getOperation();
+    const vector<ExpressionTreeNode>& children = node.getChildren();
+    switch (op.getId()) {
+        case Operation::INTEGER:
+            return dynamic_cast<const Operation::Integer&>(op).getValue();
+        case Operation::CONSTANT:
+        case Operation::COMPLEX_NUMBER:
+        {
+            Args args;
+            Result value = op.evaluate(args, map<string, double>());
+            double real = value.getReal();
+            if (value.getImag() != 0 || real != std::floor(real) || !(std::abs(real) < 9.2233720368547758e18))
+                throw Exception("Programmer mode only supports integers: "+op.getName());
+            return (int64_t) real;
+        }
+        case Operation::VARIABLE:
+        {
+            map<string, int64_t>::const_iterator iter = variables.find(op.getName());
+            if (iter == variables.end())
+                throw Exception("No integer value for variable "+op.getName());
+            return iter->second;
+        }
+        default:
+            break;
+    }
+    vector<int64_t> args(children.size());
+    for (int i = 0; i < (int) children.size(); i++)
+        args[i] = evaluateInteger(children[i], variables);
+    switch (op.getId()) {
+        case Operation::ADD:
+            return wrap((uint64_t) args[0] + (uint64_t) args[1]);
+        case Operation::SUBTRACT:
+            return wrap((uint64_t) args[0] - (uint64_t) args[1]);
+        case Operation::MULTIPLY:
+            return wrap((uint64_t) args[0] * (uint64_t) args[1]);
+        case Operation::NEGATE:
+            return wrap(0-(uint64_t) args[0]);
+        case Operation::DIVIDE:
+            if (args[1] == 0)
+                throw Exception("Division by zero");
+            if (args[1] == -1)
+                return wrap(0-(uint64_t) args[0]); // INT64_MIN/-1 overflows
+            return args[0]/args[1];
+        case Operation::MODULUS:
+            if (args[1] == 0)
+                throw Exception("Division by zero");
+            if (args[1] == -1)
+                return 0;
+            return args[0]%args[1];
+        case Operation::POWER:
+        {
+            // Negative exponents truncate towards zero like division does.
+
+            uint64_t base = args[0];
+            int64_t exponent = args[1];
+            if (exponent < 0) {
+                if (args[0] == 1)
+                    return 1;
+                if (args[0] == -1)
+                    return ((exponent & 1) != 0 ? -1 : 1);
+                if (args[0] == 0)
+                    throw Exception("Division by zero");
+                return 0;
+            }
+            uint64_t result = 1;
+            while (exponent != 0) {
+                if ((exponent & 1) != 0)
+                    result *= base;
+                base *= base;
+                exponent >>= 1;
+            }
+            return wrap(result);
+        }
+        case Operation::SQUARE:
+            return wrap((uint64_t) args[0] * (uint64_t) args[0]);
+        case Operation::CUBE:
+            return wrap((uint64_t) args[0] * (uint64_t) args[0] * (uint64_t) args[0]);
+        case Operation::AND:
+            return args[0] & args[1];
+        case Operation::OR:
+            return args[0] | args[1];
+        case Operation::XOR:
+            return args[0] ^ args[1];
+        case Operation::NOT:
+            return ~args[0];
+        case Operation::LOGICAL_LEFT_SHIFT:
+            if (args[1] < 0 || args[1] >= 64)
+                return 0;
+            return wrap((uint64_t) args[0] << args[1]);
+        case Operation::LOGICAL_RIGHT_SHIFT:
+            if (args[1] < 0 || args[1] >= 64)
+                return 0;
+            return wrap((uint64_t) args[0] >> args[1]);
+        case Operation::ABS:
+            return wrap(magnitude(args[0]));
+        case Operation::MIN:
+            return min(args[0], args[1]);
+        case Operation::MAX:
+            return max(args[0], args[1]);
+        case Operation::GCD:
+        {
+            uint64_t result = 0;
+            for (int64_t arg : args)
+                result = integerGCD(result, magnitude(arg));
+            return wrap(result);
+        }
+        case Operation::LCM:
+        {
+            uint64_t result = 1;
+            for (int64_t arg : args) {
+                if (arg == 0)
+                    return 0;
+                result = result/integerGCD(result, magnitude(arg))*magnitude(arg);
+            }
+            return wrap(result);
+        }
+        case Operation::FACTORIAL:
+        {
+            if (args[0] < 0)
+                throw Exception("Factorial is not defined for negative numbers");
+            if (args[0] > 20)
+                throw Exception("Factorial is too large for 64 bits");
+            int64_t result = 1;
+            for (int64_t i = 2; i <= args[0]; i++)
+                result *= i;
+            return result;
+        }
+        default:
+            throw Exception(op.getName()+" is not supported in programmer mode");
+    }
+}
+
 ParsedExpression ParsedExpression::optimize() const {
     ExpressionTreeNode result = precalculateConstantSubexpressions(getRootNode());
     while (true) {
@@ -137,12 +301,18 @@ ExpressionTreeNode ParsedExpression::precalculateConstantSubexpressions(const Ex
     for (int i = 0; i < (int) children.size(); i++)
         children[i] = precalculateConstantSubexpressions(node.getChildren()[i]);
     ExpressionTreeNode result = ExpressionTreeNode(node.getOperation().clone(), children);
-    if (node.getOperation().getId() == Operation::VARIABLE)
-        return result;
+    Operation::Id id = node.getOperation().getId();
+    if (id == Operation::VARIABLE || id == Operation::MATRIX || id == Operation::RAND || id == Operation::INTEGER)
+        return result; // Matrices can be changed after parsing, RNG must give a new value each time, and integers must stay exact.
     for (int i = 0; i < (int) children.size(); i++)
         if (children[i].getOperation().getId() != Operation::CONSTANT)
             return result;
-    return ExpressionTreeNode(new Operation::Constant(real(evaluate(result, map<string, double>()).complexVal)));
+    Result value = evaluate(result, map<string, double>());
+    if (value.dataTypeEnum == DataTypeEnum::matrix)
+        return result;
+    if (value.getImag() != 0)
+        return ExpressionTreeNode(new Operation::ComplexNumber(value.getReal(), value.getImag()));
+    return ExpressionTreeNode(new Operation::Constant(value.getReal()));
 }
 
 ExpressionTreeNode ParsedExpression::substituteSimplerExpression(const ExpressionTreeNode& node) {
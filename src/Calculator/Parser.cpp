@@ -51,6 +51,8 @@ static const int Precedence[] = {0, 0, 1, 1, 3};
 static const Operation::Id OperationId[] = {Operation::ADD, Operation::SUBTRACT, Operation::MULTIPLY, Operation::DIVIDE, Operation::POWER};
 static set<string> disabledFeatures;
 static bool isDegree = false;
+static bool isIntegerMode = false;
+static unsigned int modeVersion = 0;
 
 class Lepton::ParseToken {
 public:
@@ -78,6 +80,8 @@ void Parser::addFeatureToDisable(string featureName) {
 }
 
 void Parser::setAngleUnit(bool degreeSet) {
+    if (degreeSet != isDegree)
+        modeVersion++;
     isDegree = degreeSet;
 }
 
@@ -85,6 +89,20 @@ bool Parser::getAngleUnit() {
     return isDegree;
 }
 
+void Parser::setIntegerMode(bool integerMode) {
+    if (integerMode != isIntegerMode)
+        modeVersion++;
+    isIntegerMode = integerMode;
+}
+
+bool Parser::getIntegerMode() {
+    return isIntegerMode;
+}
+
+unsigned int Parser::getModeVersion() {
+    return modeVersion;
+}
+
 void Parser::clearFeaturesToDisable() {
     disabledFeatures.clear();
 }
@@ -102,6 +120,57 @@ string Parser::trim(const string& expression) {
     return expression.substr(start, end-start+1);
 }
 
+// returns the base of an integer literal with a 0x, 0b or 0o prefix, or 0 if it has none
+static int getIntegerLiteralBase(const string& text, int start) {
+    if (text[start] != '0' || start+1 >= (int) text.size())
+        return 0;
+    switch (text[start+1]) {
+        case 'x': case 'X':
+            return 16;
+        case 'b': case 'B':
+            return 2;
+        case 'o': case 'O':
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+static int getDigitValue(char c) {
+    if (c >= '0' && c <= '9')
+        return c-'0';
+    if (c >= 'a' && c <= 'f')
+        return c-'a'+10;
+    if (c >= 'A' && c <= 'F')
+        return c-'A'+10;
+    return 16;
+}
+
+bool Parser::isIntegerLiteral(const string& text) {
+    if (getIntegerLiteralBase(text, 0) != 0)
+        return true;
+    return isIntegerMode && text.find_first_not_of(Digits) == string::npos;
+}
+
+int64_t Parser::parseIntegerLiteral(const string& text) {
+    // Literals up to 2^64-1 are accepted and stored in two's complement, so 0xFFFFFFFFFFFFFFFF is -1.
+
+    int base = getIntegerLiteralBase(text, 0);
+    int start = 2;
+    if (base == 0) {
+        base = 10;
+        start = 0;
+    }
+    uint64_t value = 0;
+    for (int pos = start; pos < (int) text.size(); pos++) {
+        uint64_t digit = getDigitValue(text[pos]);
+        if (value > (UINT64_MAX-digit)/base)
+            throw Exception("Parse error: integer too large: "+text);
+        value = value*base + digit;
+    }
+    return (int64_t) value;
+}
+
 // returns a vector of tokens for a string that has real numbers, decimal points, and imaginary numbers
 std::vector<ParseToken> Parser::parseRealAndImaginary(string numberString) {
     vector<ParseToken> tokens;
@@ -224,7 +293,24 @@ std::vector<ParseToken> Parser::getNextToken(const string& expression, int &star
         start += (int) expression.substr(start, string::npos).size();
         return tokensToReturn;
     }
-    if (c == '.' || Digits.find(c) != string::npos || c == 'i') {
+    int base = getIntegerLiteralBase(expression, start);
+    if (base != 0) {
+        // An integer in hexadecimal, binary, or octal
+
+        int pos;
+        for (pos = start+2; pos < (int) expression.size() && getDigitValue(expression[pos]) < base; pos++)
+            ;
+        if (pos == start+2)
+            throw Exception("Parse error: missing digits after "+expression.substr(start, 2));
+        tokensToReturn.push_back(ParseToken(expression.substr(start, pos-start), ParseToken::Number));
+        start = pos;
+        return tokensToReturn;
+    }
+    // An i followed by a letter other than an exponent starts a function name such as inv, not a number.
+
+    bool imaginaryUnit = (c == 'i' && !(start+1 < (int) expression.size() && isalpha(expression[start+1]) &&
+            expression[start+1] != 'e' && expression[start+1] != 'E'));
+    if (c == '.' || Digits.find(c) != string::npos || imaginaryUnit) {
         // A number
         if (c == 'i' && disabledFeatures.find("Disable complex") != disabledFeatures.end()) {
             throw DisabledFeatureException("Complex numbers");
@@ -371,6 +457,9 @@ ExpressionTreeNode Parser::parsePrecedence(const vector<ParseToken>& tokens, int
         // The parser currently only return tokens that are unit imaginary numbers
         result = ExpressionTreeNode(new Operation::ComplexNumber(0, 1));
         pos++;
+    } else if (token.getType() == ParseToken::Number && isIntegerLiteral(token.getText())) {
+        result = ExpressionTreeNode(new Operation::Integer(parseIntegerLiteral(token.getText())));
+        pos++;
     } else if (token.getType() == ParseToken::Number) {
         double value;
         stringstream(token.getText()) >> value;
@@ -412,6 +501,8 @@ ExpressionTreeNode Parser::parsePrecedence(const vector<ParseToken>& tokens, int
             throw Exception("Parse error: unbalanced parentheses");
         pos++;
         Operation* op = getFunctionOperation(token.getText(), customFunctions);
+        if (op->getId() == Operation::LIM && args.size() == 3)
+            args.push_back(ExpressionTreeNode(new Operation::Constant(0.0))); // Approach from both sides
 
         try {
             result = ExpressionTreeNode(op, args);
@@ -482,6 +573,10 @@ Operation* Parser::getFunctionOperation(const std::string& name, const map<strin
         opMap["fnInt"] = Operation::FNINT;
         opMap["sigma"] = Operation::SIGMA;
         opMap["prod"] = Operation::PROD;
+        opMap["lim"] = Operation::LIM;
+        opMap["solve"] = Operation::SOLVE;
+        opMap["proots"] = Operation::PROOTS;
+        opMap["ode"] = Operation::ODE;
         opMap["nPr"] = Operation::NPR;
         opMap["nCr"] = Operation::NCR;     
         opMap["sin"] = Operation::SIN;
@@ -530,6 +625,8 @@ Operation* Parser::getFunctionOperation(const std::string& name, const map<strin
         opMap["dot"] = Operation::DOT;
         opMap["cross"] = Operation::CROSS;
         opMap["solveSOLE"] = Operation::SOLVE_SOLE;
+        opMap["eig"] = Operation::EIG;
+        opMap["inv"] = Operation::INV;
         opMap["MOD"] = Operation::MODULUS;
     }
     string trimmed = name.substr(0, name.size()-1);
@@ -566,6 +663,14 @@ Operation* Parser::getFunctionOperation(const std::string& name, const map<strin
             return new Operation::Sigma();
         case Operation::PROD:
             return new Operation::Prod();
+        case Operation::LIM:
+            return new Operation::Lim();
+        case Operation::SOLVE:
+            return new Operation::Solve();
+        case Operation::PROOTS:
+            return new Operation::Proots();
+        case Operation::ODE:
+            return new Operation::Ode();
         case Operation::NPR:
             return new Operation::Npr();
         case Operation::NCR:
@@ -662,6 +767,10 @@ Operation* Parser::getFunctionOperation(const std::string& name, const map<strin
             return new Operation::Cross();
         case Operation::SOLVE_SOLE:
             return new Operation::SolveSOLE();
+        case Operation::EIG:
+            return new Operation::Eig();
+        case Operation::INV:
+            return new Operation::Inv();
         case Operation::MODULUS:
             return new Operation::Modulus();
         default:
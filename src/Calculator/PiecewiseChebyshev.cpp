@@ -0,0 +1,214 @@
+#include "lepton/PiecewiseChebyshev.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace Lepton;
+using namespace std;
+
+// Where the fit is compared with the function, in [-1, 1].  It is between two sample points, since the
+// fit is exact at the samples themselves.
+
+static const double CHECK_POINT = 0.3;
+
+// A degree DEGREE/2 fit whose last coefficients are at least this fraction of its largest one is not
+// converging, so the piece is split without taking the rest of the samples.
+
+static const double NOT_CONVERGING = 0.2;
+
+/**
+ * Get cos(pi*m/DEGREE) for m in [0, 2*DEGREE), which gives both the sample points and the terms of the
+ * transform from samples to coefficients.
+ */
+
+static double cosine(int m) {
+    static double table[2*PiecewiseChebyshev::DEGREE];
+    static bool initialized = false;
+    if (!initialized) {
+        for (int i = 0; i < 2*PiecewiseChebyshev::DEGREE; i++)
+            table[i] = cos(M_PI*i/PiecewiseChebyshev::DEGREE);
+        initialized = true;
+    }
+    return table[m];
+}
+
+/**
+ * Compute the coefficients of the polynomial of the given degree interpolating values[j*stride] for j in
+ * [0, degree].  This is a discrete cosine transform, where the first and last samples and coefficients
+ * count half.  Since the sample points for DEGREE/2 are every other one of those for DEGREE, a stride of
+ * 2 fits the lower degree.
+ */
+
+static vector<double> transform(const double* values, int stride, int degree) {
+    vector<double> coefficients(degree+1);
+    for (int k = 0; k <= degree; k++) {
+        double sum = 0.5*(values[0] + ((k & 1) == 0 ? values[degree*stride] : -values[degree*stride]));
+        for (int j = 1; j < degree; j++)
+            sum += values[j*stride]*cosine((j*k*stride) % (2*PiecewiseChebyshev::DEGREE));
+        coefficients[k] = sum*2.0/degree;
+    }
+    coefficients[0] *= 0.5;
+    coefficients[degree] *= 0.5;
+    return coefficients;
+}
+
+PiecewiseChebyshev::PiecewiseChebyshev() : tolerance(numeric_limits<double>::infinity()) {
+}
+
+void PiecewiseChebyshev::fit(const function<double(double)>& function, double start, double end, double tolerance, double refinement, double minWidth) {
+    // Only the pieces no longer accurate enough are dropped, so their gaps get fitted again below.
+
+    bool crowded = ((int) pieces.size() > MAX_PIECES/2);
+    vector<Piece> kept;
+    for (const Piece& piece : pieces)
+        if (piece.error <= tolerance && !(crowded && (piece.end <= start || piece.start >= end)))
+            kept.push_back(piece);
+    pieces.swap(kept);
+    this->tolerance = tolerance/refinement;
+
+    // Walk through the pieces in order, fitting each gap between them.  The new pieces are only merged in
+    // at the end, including when fitting is stopped part way.
+
+    vector<Piece> added;
+    auto merge = [&]() {
+        pieces.insert(pieces.end(), added.begin(), added.end());
+        sort(pieces.begin(), pieces.end(), [](const Piece& a, const Piece& b) { return a.start < b.start; });
+    };
+    try {
+        double cursor = start;
+        double lowLimit = -numeric_limits<double>::infinity();
+        for (const Piece& piece : pieces) {
+            if (piece.end <= cursor) {
+                lowLimit = piece.end;
+                continue;
+            }
+            if (piece.start >= end)
+                break;
+            if (piece.start > cursor)
+                fitGap(function, cursor, piece.start, lowLimit, piece.start, minWidth, added);
+            cursor = piece.end;
+            lowLimit = piece.end;
+        }
+        if (cursor < end) {
+            double highLimit = numeric_limits<double>::infinity();
+            for (const Piece& piece : pieces)
+                if (piece.start >= cursor) {
+                    highLimit = piece.start;
+                    break;
+                }
+            fitGap(function, cursor, end, lowLimit, highLimit, minWidth, added);
+        }
+    }
+    catch (...) {
+        merge();
+        throw;
+    }
+    merge();
+}
+
+void PiecewiseChebyshev::fitGap(const function<double(double)>& function, double start, double end, double lowLimit, double highLimit,
+        double minWidth, vector<Piece>& added) const {
+    // A narrow gap, left by moving the view a little, is widened into the space no piece covers yet so that
+    // it can still be approximated.
+
+    if (end-start < minWidth) {
+        end = min(start+minWidth, highLimit);
+        start = max(end-minWidth, lowLimit);
+    }
+    fitPiece(function, start, end, minWidth, added);
+}
+
+void PiecewiseChebyshev::fitPiece(const function<double(double)>& function, double start, double end, double minWidth, vector<Piece>& added) const {
+    Piece piece;
+    piece.start = start;
+    piece.end = end;
+    piece.error = 0;
+    double middle = 0.5*(start+end);
+    double halfWidth = 0.5*(end-start);
+    if (end-start >= minWidth) {
+        // For a smooth function the coefficients shrink quickly, so the last two bound the error.  The check
+        // between the samples catches functions that only look smooth at the sample points.
+
+        auto accept = [&](vector<double>& coefficients) {
+            int degree = (int) coefficients.size()-1;
+            double tail = abs(coefficients[degree-1]) + abs(coefficients[degree]);
+            if (tail > 0.75*tolerance)
+                return false;
+            double check = abs(evaluateSeries(coefficients, CHECK_POINT)-function(middle+halfWidth*CHECK_POINT));
+            if (!(check <= 0.75*tolerance))
+                return false;
+            double dropped = 0;
+            while (coefficients.size() > 1 && dropped+abs(coefficients.back()) <= 0.25*tolerance) {
+                dropped += abs(coefficients.back());
+                coefficients.pop_back();
+            }
+            piece.coefficients = coefficients;
+            piece.error = max(tail, check)+dropped;
+            added.push_back(piece);
+            return true;
+        };
+
+        // Take every other sample first, which is often enough on its own.
+
+        double values[DEGREE+1];
+        bool promising = true; // Every sample so far is finite, and the fit could still converge
+        for (int j = 0; j <= DEGREE && promising; j += 2) {
+            values[j] = function(middle+halfWidth*cosine(j));
+            promising = (values[j]-values[j] == 0);
+        }
+        if (promising) {
+            vector<double> coefficients = transform(values, 2, DEGREE/2);
+            if (accept(coefficients))
+                return;
+            double largest = 0;
+            for (int k = 1; k <= DEGREE/2; k++)
+                largest = max(largest, abs(coefficients[k]));
+            promising = (abs(coefficients[DEGREE/2-1]) + abs(coefficients[DEGREE/2]) < NOT_CONVERGING*largest);
+        }
+        for (int j = 1; j < DEGREE && promising; j += 2) {
+            values[j] = function(middle+halfWidth*cosine(j));
+            promising = (values[j]-values[j] == 0);
+        }
+        if (promising) {
+            vector<double> coefficients = transform(values, 1, DEGREE);
+            if (accept(coefficients))
+                return;
+        }
+        if (end-start >= 2*minWidth && (int) (pieces.size()+added.size()) + 2 <= MAX_PIECES) {
+            fitPiece(function, start, middle, minWidth, added);
+            fitPiece(function, middle, end, minWidth, added);
+            return;
+        }
+    }
+    added.push_back(piece);
+}
+
+bool PiecewiseChebyshev::evaluate(double x, double& value) const {
+    vector<Piece>::const_iterator next = upper_bound(pieces.begin(), pieces.end(), x,
+            [](double x, const Piece& piece) { return x < piece.start; });
+    if (next == pieces.begin())
+        return false;
+    const Piece& piece = *(next-1);
+    if (x > piece.end || piece.coefficients.empty())
+        return false;
+    double t = (2*x-piece.start-piece.end)/(piece.end-piece.start);
+    value = evaluateSeries(piece.coefficients, max(-1.0, min(1.0, t)));
+    return true;
+}
+
+void PiecewiseChebyshev::clear() {
+    pieces.clear();
+    tolerance = numeric_limits<double>::infinity();
+}
+
+double PiecewiseChebyshev::evaluateSeries(const vector<double>& coefficients, double t) {
+    // Clenshaw's recurrence, which sums the series without computing each Chebyshev polynomial.
+
+    double next = 0, afterNext = 0;
+    for (int k = (int) coefficients.size()-1; k > 0; k--) {
+        double current = coefficients[k] + 2*t*next - afterNext;
+        afterNext = next;
+        next = current;
+    }
+    return coefficients[0] + t*next - afterNext;
+}
@@ -0,0 +1,213 @@
+#include "lepton/PolynomialRoots.h"
+#include "lepton/Exception.h"
+#include "lepton/Operation.h"
+#include "lepton/ParsedExpression.h"
+#include <unsupported/Eigen/Polynomials>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace Lepton;
+using namespace std;
+
+namespace {
+
+typedef vector<complex<double> > Coefficients;
+
+Coefficients multiply(const Coefficients& a, const Coefficients& b) {
+    Coefficients result(a.size()+b.size()-1, 0.0);
+    for (int i = 0; i < (int) a.size(); i++)
+        for (int j = 0; j < (int) b.size(); j++)
+            result[i+j] += a[i]*b[j];
+    return result;
+}
+
+/**
+ * Get the value and derivative of a polynomial with Horner's rule.
+ */
+void evaluatePolynomial(const Coefficients& coefficients, complex<double> x, complex<double>& value, complex<double>& derivative) {
+    value = coefficients.back();
+    derivative = 0;
+    for (int k = coefficients.size()-2; k >= 0; k--) {
+        derivative = derivative*x + value;
+        value = value*x + coefficients[k];
+    }
+}
+
+/**
+ * Find the roots of a polynomial of degree at least 1 with Eigen's companion matrix solver.  Real
+ * coefficients use the real eigenvalue solver, which is faster and returns complex roots in exact
+ * conjugate pairs.
+ */
+vector<complex<double> > companionRoots(const Coefficients& coefficients) {
+    int size = coefficients.size();
+    bool real = true;
+    for (const complex<double>& c : coefficients)
+        if (c.imag() != 0)
+            real = false;
+    vector<complex<double> > roots(size-1);
+    if (real) {
+        Eigen::VectorXd polynomial(size);
+        for (int k = 0; k < size; k++)
+            polynomial[k] = coefficients[k].real();
+        Eigen::PolynomialSolver<double, Eigen::Dynamic> solver(polynomial);
+        Eigen::VectorXcd::Map(roots.data(), size-1) = solver.roots();
+    }
+    else {
+        Eigen::VectorXcd polynomial = Eigen::VectorXcd::Map(coefficients.data(), size);
+        Eigen::PolynomialSolver<complex<double>, Eigen::Dynamic> solver(polynomial);
+        Eigen::VectorXcd::Map(roots.data(), size-1) = solver.roots();
+    }
+    return roots;
+}
+
+bool byRealPart(const complex<double>& a, const complex<double>& b) {
+    return (a.real() != b.real() ? a.real() < b.real() : a.imag() < b.imag());
+}
+
+}
+
+PolynomialRoots::PolynomialRoots(const ExpressionTreeNode& node, const string& variable, const map<string, double>& variables) :
+        variable(variable), variables(variables) {
+    if (!expand(node, coefficients))
+        throw Exception("proots needs a polynomial in "+variable);
+    for (const complex<double>& c : coefficients)
+        if (!(abs(c) < numeric_limits<double>::infinity()))
+            throw Exception("Math Error: coefficients must be finite");
+
+    // Terms that cancel exactly, as in x^2-x^2, leave zero leading coefficients.
+
+    while (coefficients.size() > 1 && coefficients.back() == 0.0)
+        coefficients.pop_back();
+    if (coefficients.size() == 1 && coefficients[0] == 0.0)
+        throw Exception("Math Error: every value is a root");
+}
+
+bool PolynomialRoots::varies(const ExpressionTreeNode& subtree) const {
+    const Operation& op = subtree.getOperation();
+    if (op.getId() == Operation::VARIABLE && op.getName() == variable)
+        return true;
+    for (const ExpressionTreeNode& child : subtree.getChildren())
+        if (varies(child))
+            return true;
+    return false;
+}
+
+bool PolynomialRoots::expand(const ExpressionTreeNode& subtree, Coefficients& result) const {
+    if (!varies(subtree)) {
+        result.assign(1, ParsedExpression::publicEvaluate(subtree, variables).getComplex());
+        return true;
+    }
+    const Operation& op = subtree.getOperation();
+    const vector<ExpressionTreeNode>& children = subtree.getChildren();
+    Coefficients first, second;
+    switch (op.getId()) {
+        case Operation::VARIABLE:
+            result.assign(2, 0.0);
+            result[1] = 1;
+            return true;
+        case Operation::ADD:
+        case Operation::SUBTRACT: {
+            if (!expand(children[0], first) || !expand(children[1], second))
+                return false;
+            double sign = (op.getId() == Operation::ADD ? 1 : -1);
+            result.assign(max(first.size(), second.size()), 0.0);
+            for (int k = 0; k < (int) first.size(); k++)
+                result[k] += first[k];
+            for (int k = 0; k < (int) second.size(); k++)
+                result[k] += sign*second[k];
+            return true;
+        }
+        case Operation::NEGATE:
+        case Operation::MULTIPLY_CONSTANT: {
+            if (!expand(children[0], result))
+                return false;
+            double scale = (op.getId() == Operation::NEGATE ? -1 : dynamic_cast<const Operation::MultiplyConstant&>(op).getValue());
+            for (complex<double>& c : result)
+                c *= scale;
+            return true;
+        }
+        case Operation::ADD_CONSTANT:
+            if (!expand(children[0], result))
+                return false;
+            result[0] += dynamic_cast<const Operation::AddConstant&>(op).getValue();
+            return true;
+        case Operation::MULTIPLY:
+            if (!expand(children[0], first) || !expand(children[1], second) || first.size()+second.size()-2 > MAX_DEGREE)
+                return false;
+            result = multiply(first, second);
+            return true;
+        case Operation::DIVIDE: {
+            if (varies(children[1]) || !expand(children[0], result))
+                return false;
+            complex<double> divisor = ParsedExpression::publicEvaluate(children[1], variables).getComplex();
+            for (complex<double>& c : result)
+                c /= divisor;
+            return true;
+        }
+        case Operation::SQUARE:
+        case Operation::CUBE:
+        case Operation::POWER_CONSTANT:
+        case Operation::POWER: {
+            double exponent;
+            if (op.getId() == Operation::SQUARE || op.getId() == Operation::CUBE)
+                exponent = (op.getId() == Operation::SQUARE ? 2 : 3);
+            else if (op.getId() == Operation::POWER_CONSTANT)
+                exponent = dynamic_cast<const Operation::PowerConstant&>(op).getValue();
+            else if (!varies(children[1])) {
+                complex<double> value = ParsedExpression::publicEvaluate(children[1], variables).getComplex();
+                exponent = (value.imag() == 0 ? value.real() : -1);
+            }
+            else
+                return false;
+            if (!(exponent >= 0 && exponent <= MAX_DEGREE && exponent == floor(exponent)) || !expand(children[0], first))
+                return false;
+            if ((first.size()-1)*exponent > MAX_DEGREE)
+                return false;
+            result.assign(1, 1.0);
+            for (int power = (int) exponent; power > 0; power /= 2) {
+                if (power%2 == 1)
+                    result = multiply(result, first);
+                if (power > 1)
+                    first = multiply(first, first);
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+complex<double> PolynomialRoots::polish(complex<double> root) const {
+    complex<double> value, derivative;
+    evaluatePolynomial(coefficients, root, value, derivative);
+    for (int step = 0; step < NEWTON_STEPS && value != 0.0 && derivative != 0.0; step++) {
+        // Stop as soon as a step does not help, as it will not near a multiple root.
+
+        complex<double> next = root - value/derivative;
+        complex<double> nextValue, nextDerivative;
+        evaluatePolynomial(coefficients, next, nextValue, nextDerivative);
+        if (!(abs(nextValue) < abs(value)))
+            break;
+        root = next;
+        value = nextValue;
+        derivative = nextDerivative;
+    }
+    return root;
+}
+
+vector<complex<double> > PolynomialRoots::findRoots() const {
+    // Roots at 0 are exact, so only the rest of the polynomial goes to the eigenvalue solver.
+
+    int zeros = 0;
+    while (coefficients[zeros] == 0.0)
+        zeros++;
+    vector<complex<double> > roots(zeros, 0.0);
+    if (zeros < getDegree()) {
+        vector<complex<double> > others = companionRoots(Coefficients(coefficients.begin()+zeros, coefficients.end()));
+        for (const complex<double>& root : others)
+            roots.push_back(polish(root));
+    }
+    sort(roots.begin(), roots.end(), byRealPart);
+    return roots;
+}
@@ -0,0 +1,82 @@
+#include "lepton/SmallMatrix.h"
+#include <Eigen/LU>
+
+using namespace Lepton;
+using namespace std;
+
+namespace {
+
+template <int N>
+double fixedDeterminant(const Eigen::MatrixXd& a) {
+    return Eigen::Map<const Eigen::Matrix<double, N, N> >(a.data()).determinant();
+}
+
+template <int N, int M>
+Eigen::MatrixXd fixedProduct(const Eigen::MatrixXd& a, const Eigen::MatrixXd& b) {
+    Eigen::Map<const Eigen::Matrix<double, N, N> > left(a.data());
+    Eigen::Map<const Eigen::Matrix<double, N, M> > right(b.data());
+    return left.lazyProduct(right);
+}
+
+/**
+ * Multiply an NxN matrix by one with N rows, if that has at most MAX_SIZE columns.
+ */
+template <int N>
+bool squareProduct(const Eigen::MatrixXd& a, const Eigen::MatrixXd& b, Eigen::MatrixXd& result) {
+    switch (b.cols()) {
+        case 1: result = fixedProduct<N, 1>(a, b); return true;
+        case 2: result = fixedProduct<N, 2>(a, b); return true;
+        case 3: result = fixedProduct<N, 3>(a, b); return true;
+        case 4: result = fixedProduct<N, 4>(a, b); return true;
+        default: return false;
+    }
+}
+
+template <int N>
+bool fixedInverse(const Eigen::MatrixXd& a, Eigen::MatrixXd& inverse) {
+    Eigen::Map<const Eigen::Matrix<double, N, N> > matrix(a.data());
+    Eigen::Matrix<double, N, N> result;
+    bool invertible;
+    matrix.computeInverseWithCheck(result, invertible);
+    if (invertible)
+        inverse = result;
+    return invertible;
+}
+
+}
+
+double SmallMatrix::determinant(const Eigen::MatrixXd& a) {
+    switch (a.rows()) {
+        case 0: return 1;
+        case 1: return fixedDeterminant<1>(a);
+        case 2: return fixedDeterminant<2>(a);
+        case 3: return fixedDeterminant<3>(a);
+        case 4: return fixedDeterminant<4>(a);
+        default: return a.partialPivLu().determinant();
+    }
+}
+
+Eigen::MatrixXd SmallMatrix::multiply(const Eigen::MatrixXd& a, const Eigen::MatrixXd& b) {
+    Eigen::MatrixXd result;
+    if (a.rows() == a.cols()) {
+        switch (a.rows()) {
+            case 1: if (squareProduct<1>(a, b, result)) return result; break;
+            case 2: if (squareProduct<2>(a, b, result)) return result; break;
+            case 3: if (squareProduct<3>(a, b, result)) return result; break;
+            case 4: if (squareProduct<4>(a, b, result)) return result; break;
+        }
+    }
+    return a*b;
+}
+
+bool SmallMatrix::inverse(const Eigen::MatrixXd& a, Eigen::MatrixXd& inverse) {
+    if (a.rows() != a.cols())
+        return false;
+    switch (a.rows()) {
+        case 1: return fixedInverse<1>(a, inverse);
+        case 2: return fixedInverse<2>(a, inverse);
+        case 3: return fixedInverse<3>(a, inverse);
+        case 4: return fixedInverse<4>(a, inverse);
+        default: return false;
+    }
+}
@@ -0,0 +1,322 @@
+#include "lepton/StoredFunction.h"
+#include "lepton/CompiledExpression.h"
+#include "lepton/Exception.h"
+#include "lepton/ExpressionTreeNode.h"
+#include "lepton/Operation.h"
+#include "lepton/ParsedExpression.h"
+#include "lepton/Parser.h"
+#include "Matrix.h"
+#include <algorithm>
+#include <limits>
+
+using namespace Lepton;
+using namespace std;
+
+/**
+ * The part of a StoredFunction shared by all of its clones.  The value and each derivative that has been
+ * asked for are compiled separately, keyed by derivative order, with the locations their variables are
+ * written to.
+ */
+
+class StoredFunction::Body {
+public:
+    Body(const string& name, const vector<string>& parameters, const map<string, double>& variables, const map<string, CustomFunction*>& functions) :
+            name(name), parameters(parameters), valueOrder(parameters.size(), 0), variables(variables), functions(functions), parsed(false),
+            parsedMode(0), active(false), version(0) {
+    }
+    void setDefinition(const string& definition) {
+        if (definition == this->definition)
+            return;
+        this->definition = definition;
+        forget();
+    }
+    /**
+     * Throw away the parsed body if the angle unit or integer mode fixed into it is no longer the one the
+     * parser uses.
+     */
+    void checkMode() {
+        if (parsed && parsedMode != Parser::getModeVersion())
+            forget();
+    }
+    void forget() {
+        version++;
+        parsed = false;
+        expression = ParsedExpression();
+        compiled.clear();
+    }
+    double evaluate(const double* arguments, const vector<int>& derivOrder);
+    const ExpressionTreeNode& getRootNode();
+
+    struct Compiled {
+        CompiledExpression expression;
+        vector<double*> parameterReferences;
+        vector<pair<string, double*> > globalReferences;
+    };
+    Compiled& getCompiled(const vector<int>& derivOrder);
+
+    string name;
+    string definition;
+    vector<string> parameters;
+    vector<int> valueOrder;
+    const map<string, double>& variables;
+    const map<string, CustomFunction*>& functions;
+    bool parsed;
+    unsigned int parsedMode;
+    ParsedExpression expression;
+    map<vector<int>, Compiled> compiled;
+    bool active;
+    unsigned int version;
+};
+
+const ExpressionTreeNode& StoredFunction::Body::getRootNode() {
+    checkMode();
+    if (!parsed) {
+        expression = Parser::parse(definition, functions);
+        parsed = true;
+        parsedMode = Parser::getModeVersion();
+    }
+    return expression.getRootNode();
+}
+
+StoredFunction::Body::Compiled& StoredFunction::Body::getCompiled(const vector<int>& derivOrder) {
+    map<vector<int>, Compiled>::iterator iter = compiled.find(derivOrder);
+    if (iter != compiled.end())
+        return iter->second;
+    ParsedExpression toCompile = ParsedExpression(getRootNode());
+    for (int i = 0; i < (int) parameters.size(); i++)
+        for (int j = 0; j < derivOrder[i]; j++)
+            toCompile = toCompile.differentiate(parameters[i]);
+
+    // Find the variable locations only once the entry is in the map, since copying it would move them.
+
+    Compiled& result = compiled[derivOrder];
+    result.expression = toCompile.createCompiledExpression();
+    result.parameterReferences.resize(parameters.size(), NULL);
+    for (const string& variable : result.expression.getVariables()) {
+        double* reference = &result.expression.getVariableReference(variable);
+        vector<string>::const_iterator parameter = find(parameters.begin(), parameters.end(), variable);
+        if (parameter != parameters.end())
+            result.parameterReferences[parameter-parameters.begin()] = reference;
+        else
+            result.globalReferences.push_back(make_pair(variable, reference));
+    }
+    return result;
+}
+
+double StoredFunction::Body::evaluate(const double* arguments, const vector<int>& derivOrder) {
+    if (active)
+        throw Exception("Function "+name+" calls itself");
+    if (definition.empty())
+        throw Exception("Function "+name+" is not defined");
+    checkMode();
+    Compiled& function = getCompiled(derivOrder);
+    for (int i = 0; i < (int) parameters.size(); i++)
+        if (function.parameterReferences[i] != NULL)
+            *function.parameterReferences[i] = arguments[i];
+    for (const pair<string, double*>& global : function.globalReferences) {
+        map<string, double>::const_iterator value = variables.find(global.first);
+        if (value == variables.end())
+            throw Exception("No value specified for variable "+global.first);
+        *global.second = value->second;
+    }
+    active = true;
+    try {
+        double result = function.expression.evaluate();
+        active = false;
+        return result;
+    }
+    catch (...) {
+        active = false;
+        throw;
+    }
+}
+
+StoredFunction::StoredFunction(const string& name, const vector<string>& parameters, const map<string, double>& variables,
+        const map<string, CustomFunction*>& functions) : body(make_shared<Body>(name, parameters, variables, functions)) {
+}
+
+void StoredFunction::setDefinition(const string& definition) {
+    body->setDefinition(definition);
+}
+
+const string& StoredFunction::getDefinition() const {
+    return body->definition;
+}
+
+unsigned int StoredFunction::getVersion() const {
+    body->checkMode();
+    return body->version;
+}
+
+void StoredFunction::findDependencies(set<string>& variables, set<string>& matrices, map<string, unsigned int>& functions) const {
+    if (functions.find(body->name) != functions.end())
+        return; // Already visited, which also stops at functions that call themselves
+    functions[body->name] = getVersion();
+    if (body->definition.empty())
+        return;
+    set<string> bodyVariables;
+    findDependencies(body->getRootNode(), body->functions, bodyVariables, matrices, functions);
+    for (const string& variable : bodyVariables)
+        if (find(body->parameters.begin(), body->parameters.end(), variable) == body->parameters.end())
+            variables.insert(variable);
+}
+
+/**
+ * Find what a node depends on, leaving out the variables bound inside it by fnInt, sigma, prod, lim, proots,
+ * solve and ode, as CompiledExpression does.  A bound variable is not read from the global variables, and
+ * may not even be in them.
+ */
+static void findNodeDependencies(const ExpressionTreeNode& node, const map<string, CustomFunction*>& customFunctions,
+        set<string>& bound, set<string>& variables, set<string>& matrices, map<string, unsigned int>& functions) {
+    const Operation& op = node.getOperation();
+    const vector<ExpressionTreeNode>& children = node.getChildren();
+    if (op.getId() == Operation::VARIABLE) {
+        if (bound.find(op.getName()) == bound.end())
+            variables.insert(op.getName());
+        return;
+    }
+    if (op.getId() == Operation::MATRIX)
+        matrices.insert(op.getName());
+    else if (op.getId() == Operation::CUSTOM) {
+        map<string, CustomFunction*>::const_iterator function = customFunctions.find(op.getName());
+        const StoredFunction* stored = (function == customFunctions.end() ? NULL : dynamic_cast<const StoredFunction*>(function->second));
+        if (stored != NULL)
+            stored->findDependencies(variables, matrices, functions);
+    }
+
+    // Children [0, bodyEnd) are inside the binding, and [namesBegin, namesEnd) name the variables it binds.
+    // The rest, such as the limits of a sum, are outside it.
+
+    int bodyEnd = 0, namesBegin = 0, namesEnd = 0;
+    Operation::Id id = op.getId();
+    if (id == Operation::FNINT || id == Operation::SIGMA || id == Operation::PROD || id == Operation::LIM || id == Operation::PROOTS) {
+        bodyEnd = 1;
+        namesBegin = 1;
+        namesEnd = 2;
+    }
+    else if (id == Operation::ODE) {
+        bodyEnd = 1;
+        namesBegin = 1;
+        namesEnd = 3;
+    }
+    else if (id == Operation::SOLVE) {
+        // The current values of the unknowns are only the starting guesses, which do not have to exist.
+        bodyEnd = namesBegin = children.size()/2;
+        namesEnd = children.size();
+    }
+    namesEnd = min(namesEnd, (int) children.size());
+    vector<string> added;
+    for (int i = namesBegin; i < namesEnd; i++)
+        if (children[i].getOperation().getId() == Operation::VARIABLE && bound.insert(children[i].getOperation().getName()).second)
+            added.push_back(children[i].getOperation().getName());
+    for (int i = 0; i < bodyEnd; i++)
+        findNodeDependencies(children[i], customFunctions, bound, variables, matrices, functions);
+    for (const string& name : added)
+        bound.erase(name);
+    for (int i = bodyEnd; i < (int) children.size(); i++)
+        if (i < namesBegin || i >= namesEnd)
+            findNodeDependencies(children[i], customFunctions, bound, variables, matrices, functions);
+}
+
+void StoredFunction::findDependencies(const ExpressionTreeNode& node, const map<string, CustomFunction*>& customFunctions,
+        set<string>& variables, set<string>& matrices, map<string, unsigned int>& functions) {
+    set<string> bound;
+    findNodeDependencies(node, customFunctions, bound, variables, matrices, functions);
+}
+
+/**
+ * Get the version of a stored matrix, or 0 if there is no matrix by that name.
+ */
+static uint32_t getMatrixVersion(const string& name) {
+    map<string, SharedMatrix>::const_iterator matrix = matrixMap.find(name);
+    return (matrix == matrixMap.end() ? 0 : matrix->second.getVersion());
+}
+
+const string& StoredFunction::getName() const {
+    return body->name;
+}
+
+void StoredFunction::markChanged() {
+    body->version++;
+}
+
+int StoredFunction::getNumArguments() const {
+    return body->parameters.size();
+}
+
+double StoredFunction::evaluate(const double* arguments) const {
+    return body->evaluate(arguments, body->valueOrder);
+}
+
+double StoredFunction::evaluateDerivative(const double* arguments, const int* derivOrder) const {
+    return body->evaluate(arguments, vector<int>(derivOrder, derivOrder+body->parameters.size()));
+}
+
+CustomFunction* StoredFunction::clone() const {
+    return new StoredFunction(*this);
+}
+
+DependencySnapshot::DependencySnapshot() : variables(NULL), functions(NULL), mode(0), valid(false) {
+}
+
+void DependencySnapshot::record(const ExpressionTreeNode& node, const string& boundVariable, const map<string, double>& variables,
+        const map<string, CustomFunction*>& functions) {
+    valid = false;
+    this->variables = &variables;
+    this->functions = &functions;
+    set<string> names, matrixNames;
+    versions.clear();
+    StoredFunction::findDependencies(node, functions, names, matrixNames, versions);
+    names.erase(boundVariable);
+    recordValues(names, matrixNames);
+}
+
+void DependencySnapshot::record(const StoredFunction& function) {
+    valid = false;
+    variables = &function.body->variables;
+    functions = &function.body->functions;
+    set<string> names, matrixNames;
+    versions.clear();
+    function.findDependencies(names, matrixNames, versions);
+    recordValues(names, matrixNames);
+}
+
+void DependencySnapshot::recordValues(const set<string>& names, const set<string>& matrixNames) {
+    values.clear();
+    for (const string& name : names) {
+        map<string, double>::const_iterator value = variables->find(name);
+        values.push_back(make_pair(name, value == variables->end() ? numeric_limits<double>::quiet_NaN() : value->second));
+    }
+    matrices.clear();
+    for (const string& name : matrixNames)
+        matrices.push_back(make_pair(name, getMatrixVersion(name)));
+    mode = Parser::getModeVersion();
+    valid = true;
+}
+
+bool DependencySnapshot::isCurrent() const {
+    if (!valid || mode != Parser::getModeVersion())
+        return false;
+    for (const pair<string, uint32_t>& recorded : matrices)
+        if (getMatrixVersion(recorded.first) != recorded.second)
+            return false;
+    for (const pair<string, double>& recorded : values) {
+        // A variable that is missing was recorded as NaN, so one still missing has not changed.
+
+        map<string, double>::const_iterator value = variables->find(recorded.first);
+        double current = (value == variables->end() ? numeric_limits<double>::quiet_NaN() : value->second);
+        if (current != recorded.second && !(current != current && recorded.second != recorded.second))
+            return false; // Changed, unless it was NaN both times
+    }
+    for (const pair<const string, unsigned int>& recorded : versions) {
+        map<string, CustomFunction*>::const_iterator function = functions->find(recorded.first);
+        const StoredFunction* stored = (function == functions->end() ? NULL : dynamic_cast<const StoredFunction*>(function->second));
+        if (stored == NULL || stored->getVersion() != recorded.second)
+            return false;
+    }
+    return true;
+}
+
+void DependencySnapshot::clear() {
+    valid = false;
+}
@@ -0,0 +1,76 @@
+#include "lepton/StoredSequence.h"
+#include "lepton/EvaluationContext.h"
+#include "lepton/Exception.h"
+#include <cmath>
+#include <limits>
+
+using namespace Lepton;
+using namespace std;
+
+StoredSequence::StoredSequence(const string& name, const string& parameter, const map<string, double>& variables,
+        const map<string, CustomFunction*>& functions) : StoredFunction(name, vector<string>(1, parameter), variables, functions),
+        terms(make_shared<Terms>()) {
+}
+
+void StoredSequence::setSeeds(const vector<double>& seeds) {
+    if (seeds == terms->seeds)
+        return;
+    terms->seeds = seeds;
+    markChanged();
+}
+
+const vector<double>& StoredSequence::getSeeds() const {
+    return terms->seeds;
+}
+
+double StoredSequence::evaluate(const double* arguments) const {
+    double n = floor(arguments[0]);
+    if (!(n >= 0))
+        return numeric_limits<double>::quiet_NaN();
+    if (n >= MAX_TERMS)
+        throw Exception(getName()+" is limited to the first "+to_string(MAX_TERMS)+" terms");
+    int index = (int) n;
+    vector<double>& values = terms->values;
+
+    // While the table is being filled, the body is asking for an earlier term.
+
+    if (terms->filling) {
+        if (index >= (int) values.size())
+            throw Exception(getName()+" can only use earlier terms");
+        return values[index];
+    }
+    if (!terms->inputs.isCurrent()) {
+        terms->inputs.record(*this);
+        values = terms->seeds;
+    }
+    if (index < (int) values.size())
+        return values[index];
+    if (getDefinition().empty())
+        throw Exception("Sequence "+getName()+" is not defined");
+
+    // Terms computed before an exception stay in the table, since they are still correct.
+
+    EvaluationContext& context = EvaluationContext::current();
+    terms->filling = true;
+    try {
+        while ((int) values.size() <= index) {
+            context.consume();
+            double next = values.size();
+            values.push_back(StoredFunction::evaluate(&next));
+        }
+    }
+    catch (...) {
+        terms->filling = false;
+        throw;
+    }
+    terms->filling = false;
+    return values[index];
+}
+
+double StoredSequence::evaluateDerivative(const double* /*arguments*/, const int* /*derivOrder*/) const {
+    throw Exception("Sequences cannot be differentiated");
+}
+
+CustomFunction* StoredSequence::clone() const {
+    return new StoredSequence(*this);
+}
@@ -0,0 +1,368 @@
+#include "lepton/Summation.h"
+#include "lepton/EvaluationContext.h"
+#include "lepton/Operation.h"
+#include "lepton/ParallelReduction.h"
+#include "lepton/ParsedExpression.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace Lepton;
+using namespace std;
+
+// How closely the second term must match first*ratio for a closed form to be trusted.  Structurally the
+// match is exact, so this only catches expressions whose evaluation differs from the algebra.
+
+static const double RATIO_TOLERANCE = 1e-12;
+
+namespace {
+
+/**
+ * Neumaier's variant of Kahan summation, which carries the rounding error of every addition and gets the
+ * sum nearly correctly rounded, whatever the order or signs of the terms.
+ */
+
+struct CompensatedSum {
+    double sum = 0, compensation = 0;
+    void add(double x) {
+        double t = sum+x;
+        if (abs(sum) >= abs(x))
+            compensation += (sum-t)+x;
+        else
+            compensation += (x-t)+sum;
+        sum = t;
+    }
+    void add(const CompensatedSum& other) {
+        add(other.sum);
+        compensation += other.compensation;
+    }
+    double get() const {
+        return (sum-sum == 0 ? sum+compensation : sum); // An infinite sum has no meaningful compensation
+    }
+};
+
+struct ComplexCompensatedSum {
+    CompensatedSum real, imag;
+    void add(complex<double> x) {
+        real.add(x.real());
+        imag.add(x.imag());
+    }
+    void add(const ComplexCompensatedSum& other) {
+        real.add(other.real);
+        imag.add(other.imag);
+    }
+    complex<double> get() const {
+        return complex<double>(real.get(), imag.get());
+    }
+};
+
+/**
+ * A product kept as a mantissa near 1 and a separate binary exponent, so that it never overflows or
+ * underflows before the result does.
+ */
+
+struct ScaledProduct {
+    complex<double> mantissa = 1;
+    long exponent = 0;
+    void multiply(complex<double> x, long shift) {
+        mantissa *= x;
+        exponent += shift;
+        double scale = max(abs(mantissa.real()), abs(mantissa.imag()));
+        if (scale == 0 || scale-scale != 0)
+            return; // Zero, infinite or NaN, so scaling does not matter
+        int normalize;
+        frexp(scale, &normalize);
+        mantissa = complex<double>(ldexp(mantissa.real(), -normalize), ldexp(mantissa.imag(), -normalize));
+        exponent += normalize;
+    }
+    bool isFinal() const {
+        double scale = max(abs(mantissa.real()), abs(mantissa.imag()));
+        return (scale == 0 || scale-scale != 0);
+    }
+    complex<double> get() const {
+        if (isFinal())
+            return mantissa;
+        int shift = (int) max(-100000L, min(100000L, exponent)); // ldexp saturates well within this
+        return complex<double>(ldexp(mantissa.real(), shift), ldexp(mantissa.imag(), shift));
+    }
+};
+
+}
+
+Summation::Summation(const ExpressionTreeNode& node, const string& variable, const map<string, double>& variables) :
+        node(node), variable(variable), variables(variables) {
+}
+
+complex<double> Summation::evaluate(double k) {
+    return evaluate(node, k);
+}
+
+complex<double> Summation::evaluate(const ExpressionTreeNode& subtree, double k) {
+    EvaluationContext::current().consume();
+    variables[variable] = k;
+    return ParsedExpression::publicEvaluate(subtree, variables).getComplex();
+}
+
+bool Summation::isShared(const ExpressionTreeNode& subtree) const {
+    Operation::Id id = subtree.getOperation().getId();
+    if (id == Operation::RAND || id == Operation::CUSTOM)
+        return true; // Draws from the generator, or may fill a stored sequence's table
+    for (const ExpressionTreeNode& child : subtree.getChildren())
+        if (isShared(child))
+            return true;
+    return false;
+}
+
+bool Summation::varies(const ExpressionTreeNode& subtree) const {
+    const Operation& op = subtree.getOperation();
+    if (op.getId() == Operation::RAND)
+        return true; // Different for every term, even though it does not use the index
+    if (op.getId() == Operation::VARIABLE && op.getName() == variable)
+        return true;
+    for (const ExpressionTreeNode& child : subtree.getChildren())
+        if (varies(child))
+            return true;
+    return false;
+}
+
+int Summation::polynomialDegree(const ExpressionTreeNode& subtree) {
+    if (!varies(subtree))
+        return 0;
+    const Operation& op = subtree.getOperation();
+    const vector<ExpressionTreeNode>& children = subtree.getChildren();
+    int degree = -1;
+    switch (op.getId()) {
+        case Operation::VARIABLE:
+            return 1;
+        case Operation::ADD:
+        case Operation::SUBTRACT: {
+            int first = polynomialDegree(children[0]);
+            int second = polynomialDegree(children[1]);
+            if (first >= 0 && second >= 0)
+                degree = max(first, second);
+            break;
+        }
+        case Operation::NEGATE:
+        case Operation::ADD_CONSTANT:
+        case Operation::MULTIPLY_CONSTANT:
+            return polynomialDegree(children[0]);
+        case Operation::MULTIPLY: {
+            int first = polynomialDegree(children[0]);
+            int second = polynomialDegree(children[1]);
+            if (first >= 0 && second >= 0)
+                degree = first+second;
+            break;
+        }
+        case Operation::DIVIDE:
+            if (!varies(children[1]))
+                return polynomialDegree(children[0]);
+            break;
+        case Operation::SQUARE:
+        case Operation::CUBE: {
+            int base = polynomialDegree(children[0]);
+            if (base >= 0)
+                degree = base*(op.getId() == Operation::SQUARE ? 2 : 3);
+            break;
+        }
+        case Operation::POWER_CONSTANT:
+        case Operation::POWER: {
+            double exponent;
+            if (op.getId() == Operation::POWER_CONSTANT)
+                exponent = dynamic_cast<const Operation::PowerConstant&>(op).getValue();
+            else if (!varies(children[1])) {
+                complex<double> value = evaluate(children[1], 0);
+                exponent = (value.imag() == 0 ? value.real() : -1);
+            }
+            else
+                break;
+            int base = polynomialDegree(children[0]);
+            if (base >= 0 && exponent >= 0 && exponent <= MAX_DEGREE && exponent == floor(exponent))
+                degree = base*(int) exponent;
+            break;
+        }
+        default:
+            break;
+    }
+    return (degree > MAX_DEGREE ? -1 : degree);
+}
+
+bool Summation::geometricRatio(const ExpressionTreeNode& subtree, complex<double>& ratio) {
+    if (!varies(subtree)) {
+        ratio = 1;
+        return true;
+    }
+    const Operation& op = subtree.getOperation();
+    const vector<ExpressionTreeNode>& children = subtree.getChildren();
+    switch (op.getId()) {
+        case Operation::NEGATE:
+        case Operation::MULTIPLY_CONSTANT:
+            return geometricRatio(children[0], ratio);
+        case Operation::MULTIPLY:
+        case Operation::DIVIDE: {
+            complex<double> first, second;
+            if (!geometricRatio(children[0], first) || !geometricRatio(children[1], second))
+                return false;
+            ratio = (op.getId() == Operation::MULTIPLY ? first*second : first/second);
+            return true;
+        }
+        case Operation::SQUARE:
+        case Operation::CUBE:
+            if (!geometricRatio(children[0], ratio))
+                return false;
+            ratio = (op.getId() == Operation::SQUARE ? ratio*ratio : ratio*ratio*ratio);
+            return true;
+        case Operation::POWER_CONSTANT: {
+            // (c*q^k)^p is only c^p*(q^p)^k for integer p.
+
+            double exponent = dynamic_cast<const Operation::PowerConstant&>(op).getValue();
+            if (exponent != floor(exponent) || !geometricRatio(children[0], ratio))
+                return false;
+            ratio = pow(ratio, exponent);
+            return true;
+        }
+        case Operation::POWER: {
+            if (!varies(children[1])) {
+                complex<double> exponent = evaluate(children[1], 0);
+                if (exponent.imag() != 0 || exponent.real() != floor(exponent.real()) || !geometricRatio(children[0], ratio))
+                    return false;
+                ratio = pow(ratio, exponent.real());
+                return true;
+            }
+
+            // b^(a*k+c) = b^c*(b^a)^k for every integer k, since both are exp((a*k+c)*log(b)).
+
+            if (varies(children[0]) || polynomialDegree(children[1]) != 1)
+                return false;
+            complex<double> base = evaluate(children[0], 0);
+            complex<double> step = evaluate(children[1], 1)-evaluate(children[1], 0);
+            ratio = pow(base, step);
+            return true;
+        }
+        case Operation::EXP: {
+            if (polynomialDegree(children[0]) != 1)
+                return false;
+            ratio = exp(evaluate(children[0], 1)-evaluate(children[0], 0));
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+bool Summation::findRatio(double start, complex<double>& first, complex<double>& ratio) {
+    if (!geometricRatio(node, ratio))
+        return false;
+    first = evaluate(start);
+    complex<double> second = evaluate(start+1);
+    complex<double> predicted = first*ratio;
+    return (abs(second-predicted) <= RATIO_TOLERANCE*max(abs(second), abs(predicted)));
+}
+
+complex<double> Summation::sumPolynomial(double first, double step, double count, int degree) {
+    // Newton's forward difference formula: the sum of p(first+j*step) for j in [0, count) is the sum of
+    // the j'th difference at first times C(count, j+1).
+
+    complex<double> differences[MAX_DEGREE+1];
+    for (int j = 0; j <= degree; j++)
+        differences[j] = evaluate(first+j*step);
+    for (int level = 1; level <= degree; level++)
+        for (int j = degree; j >= level; j--)
+            differences[j] -= differences[j-1];
+    ComplexCompensatedSum result;
+    double binomial = count;
+    for (int j = 0; j <= degree; j++) {
+        result.add(differences[j]*binomial);
+        binomial *= (count-j-1)/(j+2);
+    }
+    return result.get();
+}
+
+complex<double> Summation::sum(double start, double end) {
+    start = trunc(start);
+    end = trunc(end);
+    if (!(start <= end))
+        return 0;
+    double count = end-start+1;
+    if (count > MAX_DEGREE+1) {
+        int degree = polynomialDegree(node);
+        if (degree >= 0) {
+            // Start the differences at the end of the range nearest 0, where the terms are smallest, so that
+            // the terms of the formula cancel as little as possible.
+
+            if (start < 0 && end >= 0)
+                return sumPolynomial(-1, -1, -start, degree) + sumPolynomial(0, 1, end+1, degree);
+            if (end < 0)
+                return sumPolynomial(end, -1, count, degree);
+            return sumPolynomial(start, 1, count, degree);
+        }
+        complex<double> first, ratio;
+        if (findRatio(start, first, ratio)) {
+            if (ratio == 1.0)
+                return first*count;
+            complex<double> growth; // ratio^count-1
+            if (ratio.imag() == 0 && ratio.real() > 0)
+                growth = expm1(count*log(ratio.real()));
+            else if (ratio.imag() == 0)
+                growth = pow(ratio.real(), count)-1;
+            else
+                growth = pow(ratio, count)-1.0;
+            return first*growth/(ratio-1.0);
+        }
+    }
+    auto evaluateChunk = [this, start](double first, double last) {
+        map<string, double> local = variables; // Each chunk binds the index in its own copy
+        ComplexCompensatedSum partial;
+        for (double k = start+first; k < start+last; k++) {
+            EvaluationContext::current().consume();
+            local[variable] = k;
+            partial.add(ParsedExpression::publicEvaluate(node, local).getComplex());
+        }
+        return partial;
+    };
+    auto combine = [](ComplexCompensatedSum a, const ComplexCompensatedSum& b) {
+        a.add(b);
+        return a;
+    };
+    return ParallelReduction::reduce<ComplexCompensatedSum>(count, !isShared(node), evaluateChunk, combine).get();
+}
+
+complex<double> Summation::product(double start, double end) {
+    start = trunc(start);
+    end = trunc(end);
+    if (!(start <= end))
+        return 1;
+    double count = end-start+1;
+    if (count > MAX_DEGREE+1) {
+        // The product of first*ratio^j for j in [0, count) is first^count*ratio^(count*(count-1)/2).
+
+        complex<double> first, ratio;
+        if (findRatio(start, first, ratio)) {
+            if (first == 0.0 || ratio == 0.0)
+                return 0;
+            double triangle = count*(count-1)/2;
+            if (first.imag() != 0 || ratio.imag() != 0)
+                return exp(count*log(first) + triangle*log(ratio));
+            double magnitude = exp(count*log(abs(first.real())) + triangle*log(abs(ratio.real())));
+            double quarter = fmod(count, 4);
+            bool negative = (first.real() < 0 && fmod(count, 2) == 1) != (ratio.real() < 0 && quarter >= 2); // triangle is odd when count%4 is 2 or 3
+            return (negative ? -magnitude : magnitude);
+        }
+    }
+
+    auto evaluateChunk = [this, start](double first, double last) {
+        map<string, double> local = variables;
+        ScaledProduct partial;
+        for (double k = start+first; k < start+last && !partial.isFinal(); k++) {
+            EvaluationContext::current().consume();
+            local[variable] = k;
+            partial.multiply(ParsedExpression::publicEvaluate(node, local).getComplex(), 0);
+        }
+        return partial;
+    };
+    auto combine = [](ScaledProduct a, const ScaledProduct& b) {
+        if (a.isFinal())
+            return a; // The earlier terms already decide the product, as they would in order
+        a.multiply(b.mantissa, b.exponent);
+        return a;
+    };
+    return ParallelReduction::reduce<ScaledProduct>(count, !isShared(node), evaluateChunk, combine).get();
+}
@@ -0,0 +1,653 @@
+#include "lepton/UnivariateFunction.h"
+#include "lepton/EvaluationContext.h"
+#include "lepton/Exception.h"
+#include "lepton/ParsedExpression.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace Lepton;
+using namespace std;
+
+// A root where the function touches zero is accepted if |f| there is within this fraction of the largest
+// value seen in the scan.  A minimum close to zero that is not a root would need the function to be
+// flat to about 12 digits.
+
+static const double TOUCH_TOLERANCE = 1e-12;
+static const double EPSILON = numeric_limits<double>::epsilon();
+static const double SQRT_EPSILON = 1.49011611938953e-8;
+static const double GOLDEN_RATIO = 0.381966011250105; // (3-sqrt(5))/2
+
+/**
+ * Brent's method on any function of one variable, see UnivariateFunction::findRoot().
+ */
+
+template <class F>
+static double brent(F& function, double a, double b, double fa, double fb, double& value) {
+    double width = abs(b-a);
+    double c = b, fc = fb;
+    double d = b-a, e = d;
+    for (int iteration = 0; iteration < UnivariateFunction::MAX_ITERATIONS; iteration++) {
+        if ((fb > 0) == (fc > 0)) {
+            // Keep the root between b and c.
+
+            c = a;
+            fc = fa;
+            d = e = b-a;
+        }
+        if (abs(fc) < abs(fb)) {
+            // Make b the best estimate so far.
+
+            a = b;
+            b = c;
+            c = a;
+            fa = fb;
+            fb = fc;
+            fc = fa;
+        }
+        double tolerance = 2*EPSILON*abs(b) + 0.5*EPSILON*width;
+        double middle = 0.5*(c-b);
+        if (abs(middle) <= tolerance || fb == 0)
+            break;
+        if (abs(e) >= tolerance && abs(fa) > abs(fb)) {
+            // Try inverse quadratic interpolation, or the secant method when only two points are known.
+
+            double s = fb/fa;
+            double p, q;
+            if (a == c) {
+                p = 2*middle*s;
+                q = 1-s;
+            }
+            else {
+                double r = fb/fc;
+                q = fa/fc;
+                p = s*(2*middle*q*(q-r) - (b-a)*(r-1));
+                q = (q-1)*(r-1)*(s-1);
+            }
+            if (p > 0)
+                q = -q;
+            else
+                p = -p;
+            if (2*p < min(3*middle*q - abs(tolerance*q), abs(e*q))) {
+                e = d;
+                d = p/q;
+            }
+            else {
+                d = middle;
+                e = d;
+            }
+        }
+        else {
+            d = middle;
+            e = d;
+        }
+        a = b;
+        fa = fb;
+        b += (abs(d) > tolerance ? d : (middle > 0 ? tolerance : -tolerance));
+        fb = function(b);
+        if (fb != fb)
+            break; // The function is undefined somewhere inside the interval
+    }
+    value = fb;
+    return b;
+}
+
+/**
+ * Brent's method for the minimum of any function of one variable in [a, b].  Each step fits a parabola
+ * through the three best points, falling back to a golden section step when the parabola is not trusted.
+ * A value can only be located to about the square root of the machine precision, since the function is
+ * flat to that order near a minimum.
+ */
+
+template <class F>
+static double brentMinimum(F& function, double a, double b, double& value) {
+    double width = b-a;
+    double x = a+GOLDEN_RATIO*(b-a);
+    double w = x, v = x;
+    double fx = function(x);
+    double fw = fx, fv = fx;
+    double d = 0, e = 0;
+    for (int iteration = 0; iteration < UnivariateFunction::MAX_ITERATIONS; iteration++) {
+        double middle = 0.5*(a+b);
+        double tolerance = SQRT_EPSILON*(abs(x)+width);
+        if (abs(x-middle) <= 2*tolerance-0.5*(b-a))
+            break;
+        bool parabolic = false;
+        if (abs(e) > tolerance) {
+            double r = (x-w)*(fx-fv);
+            double q = (x-v)*(fx-fw);
+            double p = (x-v)*q - (x-w)*r;
+            q = 2*(q-r);
+            if (q > 0)
+                p = -p;
+            else
+                q = -q;
+            r = e;
+            e = d;
+            if (abs(p) < abs(0.5*q*r) && p > q*(a-x) && p < q*(b-x)) {
+                d = p/q;
+                if (x+d-a < 2*tolerance || b-x-d < 2*tolerance)
+                    d = (x < middle ? tolerance : -tolerance);
+                parabolic = true;
+            }
+        }
+        if (!parabolic) {
+            e = (x < middle ? b : a) - x;
+            d = GOLDEN_RATIO*e;
+        }
+        double u = x + (abs(d) >= tolerance ? d : (d > 0 ? tolerance : -tolerance));
+        double fu = function(u);
+        if (fu <= fx) {
+            if (u < x)
+                b = x;
+            else
+                a = x;
+            v = w;
+            fv = fw;
+            w = x;
+            fw = fx;
+            x = u;
+            fx = fu;
+        }
+        else {
+            if (u < x)
+                a = u;
+            else
+                b = u;
+            if (fu <= fw || w == x) {
+                v = w;
+                fv = fw;
+                w = u;
+                fw = fu;
+            }
+            else if (fu <= fv || v == x || v == w) {
+                v = u;
+                fv = fu;
+            }
+        }
+    }
+    value = fx;
+    return x;
+}
+
+UnivariateFunction::UnivariateFunction(const ExpressionTreeNode& node, const string& variable, const map<string, double>& variables) :
+        node(node), variable(variable), variables(variables), derivativeState(0) {
+    expression = ParsedExpression(node).createCompiledExpression();
+    bindVariables(expression, x);
+}
+
+void UnivariateFunction::bindVariables(CompiledExpression& compiled, double*& x) {
+    x = NULL;
+    for (const string& name : compiled.getVariables()) {
+        if (name == variable) {
+            x = &compiled.getVariableReference(name);
+            continue;
+        }
+        map<string, double>::const_iterator value = variables.find(name);
+        if (value == variables.end())
+            throw Exception("No value specified for variable "+name);
+        compiled.getVariableReference(name) = value->second;
+    }
+}
+
+double UnivariateFunction::evaluate(double value) {
+    EvaluationContext::current().consume();
+    if (x != NULL)
+        *x = value;
+    return expression.evaluate();
+}
+
+double UnivariateFunction::evaluateDerivative(double value) {
+    if (derivativeState == 0) {
+        try {
+            derivative = ParsedExpression(node).differentiate(variable).createCompiledExpression();
+            bindVariables(derivative, derivativeX);
+            derivativeState = 1;
+        }
+        catch (Exception& ex) {
+            derivativeState = -1;
+        }
+    }
+    if (derivativeState < 0)
+        return numeric_limits<double>::quiet_NaN();
+    EvaluationContext::current().consume();
+    if (derivativeX != NULL)
+        *derivativeX = value;
+    try {
+        return derivative.evaluate();
+    }
+    catch (EvaluationBreak& ex) {
+        throw;
+    }
+    catch (Exception& ex) {
+        // Some functions, such as sequences, have no derivative.
+
+        derivativeState = -1;
+        return numeric_limits<double>::quiet_NaN();
+    }
+}
+
+double UnivariateFunction::findRoot(double a, double b, double fa, double fb, double& value) {
+    auto function = [this](double x) { return evaluate(x); };
+    return brent(function, a, b, fa, fb, value);
+}
+
+bool UnivariateFunction::findTouchingRoot(double a, double b, double scale, double& root) {
+    // At a root where the function does not cross zero |f| has a minimum, so the derivative changes sign.
+    // If the derivative is available, find where with Brent's method.
+
+    double candidate;
+    double da = evaluateDerivative(a);
+    double db = (da == da ? evaluateDerivative(b) : da);
+    if (da*db < 0) {
+        auto function = [this](double x) { return evaluateDerivative(x); };
+        double value;
+        candidate = brent(function, a, b, da, db, value);
+    }
+    else {
+        // Otherwise look for the minimum of |f| directly.
+
+        auto function = [this](double x) { return abs(evaluate(x)); };
+        double value;
+        candidate = brentMinimum(function, a, b, value);
+    }
+    if (!(abs(evaluate(candidate)) <= TOUCH_TOLERANCE*scale))
+        return false;
+    root = candidate;
+    return true;
+}
+
+vector<double> UnivariateFunction::findRoots(double start, double end, int intervals) {
+    vector<double> roots;
+    vector<double> touching; // Samples where |f| has a local minimum without changing sign
+    double step = (end-start)/intervals;
+    double scale = 0;
+    double previousY = numeric_limits<double>::quiet_NaN();
+    double currentX = start, currentY = evaluate(start);
+    for (int i = 1; i <= intervals+1; i++) {
+        double nextX = (i == intervals ? end : start+i*step);
+        double nextY = (i > intervals ? numeric_limits<double>::quiet_NaN() : evaluate(nextX));
+        if (currentY-currentY == 0)
+            scale = max(scale, abs(currentY));
+        if (currentY == 0)
+            roots.push_back(currentX);
+        else if (currentY*nextY < 0) {
+            double value;
+            double root = findRoot(currentX, nextX, currentY, nextY, value);
+            if (abs(value) <= min(abs(currentY), abs(nextY)))
+                roots.push_back(root); // Otherwise it is a pole
+        }
+        if (currentY*previousY > 0 && currentY*nextY > 0 && abs(currentY) < abs(previousY) && abs(currentY) <= abs(nextY))
+            touching.push_back(currentX);
+        previousY = currentY;
+        currentX = nextX;
+        currentY = nextY;
+    }
+    for (double x : touching) {
+        double root;
+        if (findTouchingRoot(x-step, x+step, scale, root))
+            roots.push_back(root);
+    }
+    sort(roots.begin(), roots.end());
+    return roots;
+}
+
+double UnivariateFunction::findExtremum(double start, double end, int intervals, bool maximum, double& value) {
+    vector<double> samples(intervals+1);
+    for (int i = 0; i <= intervals; i++)
+        samples[i] = evaluate(i == intervals ? end : start+i*(end-start)/intervals);
+    return findExtremum(samples, start, end, maximum, value);
+}
+
+double UnivariateFunction::findExtremum(const vector<double>& samples, double start, double end, bool maximum, double& value) {
+    // Find the candidates, treating a run of equal samples as one so that flat stretches of a graph, or a
+    // stretch clipped at the edge of the screen, give a single candidate spanning all of it.
+
+    struct Candidate {
+        double estimate;
+        int first, last;
+    };
+    vector<Candidate> candidates;
+    int last = (int) samples.size()-1;
+    double sign = (maximum ? 1.0 : -1.0);
+    for (int i = 0; i <= last; ) {
+        int j = i;
+        while (j < last && samples[j+1] == samples[i])
+            j++;
+        double estimate = sign*samples[i];
+        if (estimate == estimate && (i == 0 || !(sign*samples[i-1] >= estimate)) && (j == last || !(sign*samples[j+1] >= estimate))) {
+            Candidate candidate = {estimate, i, j};
+            candidates.push_back(candidate);
+        }
+        i = j+1;
+    }
+    sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) { return a.estimate > b.estimate; });
+    if ((int) candidates.size() > MAX_CANDIDATES)
+        candidates.resize(MAX_CANDIDATES);
+
+    // Refine each candidate between the samples on either side of it.  The minimum of -f is the maximum of f.
+
+    auto function = [&](double x) {
+        double y = evaluate(x);
+        return (y == y ? -sign*y : numeric_limits<double>::infinity());
+    };
+    double step = (end-start)/last;
+    double best = numeric_limits<double>::quiet_NaN();
+    double bestValue = numeric_limits<double>::infinity();
+    for (const Candidate& candidate : candidates) {
+        double a = (candidate.first == 0 ? start : start+(candidate.first-1)*step);
+        double b = (candidate.last == last ? end : start+(candidate.last+1)*step);
+        double candidateValue;
+        double x = brentMinimum(function, a, b, candidateValue);
+        if (candidateValue < bestValue) {
+            best = x;
+            bestValue = candidateValue;
+        }
+
+        // The minimization never quite reaches the ends, so try them too.
+
+        if (candidate.first == 0 && (candidateValue = function(start)) < bestValue) {
+            best = start;
+            bestValue = candidateValue;
+        }
+        if (candidate.last == last && (candidateValue = function(end)) < bestValue) {
+            best = end;
+            bestValue = candidateValue;
+        }
+    }
+    value = (best == best ? -sign*bestValue : best);
+    return best;
+}
+
+// The 15 point Kronrod rule on [-1, 1] and the 7 point Gauss rule whose points are every other one of its
+// points, from QUADPACK.  Only the points in [0, 1) are listed, the rest are symmetric.
+
+static const double KRONROD_POINTS[8] = {0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+        0.864864423359769072789712788640926, 0.741531185599394439863864773280788, 0.586087235467691130294144845693013,
+        0.405845151377397166906606412076961, 0.207784955007898467600689403773245, 0.0};
+static const double KRONROD_WEIGHTS[8] = {0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+        0.104790010322250183839876322541518, 0.140653259715525918745189590510238, 0.169004726639267902826583426598550,
+        0.190350578064785409913256402421014, 0.204432940075298892414161999234649, 0.209482141084727828012999174891714};
+static const double GAUSS_WEIGHTS[4] = {0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+        0.381830050505118944950369775488975, 0.417959183673469387755102040816327};
+
+static const double INTEGRATION_TOLERANCE = 1e-10;
+
+namespace {
+
+struct Piece {
+    double start, end;
+    double integral, error, magnitude; // magnitude is the integral of |f|, which bounds the rounding error
+    bool operator<(const Piece& other) const {
+        return error < other.error;
+    }
+};
+
+}
+
+/**
+ * Apply the 15 point Gauss-Kronrod rule to a piece, estimating its error as QUADPACK does.
+ */
+
+template <class F>
+static void integratePiece(F& function, Piece& piece) {
+    double center = 0.5*(piece.start+piece.end);
+    double halfWidth = 0.5*(piece.end-piece.start);
+    double values[15];
+    values[7] = function(center);
+    for (int j = 0; j < 7; j++) {
+        values[j] = function(center-halfWidth*KRONROD_POINTS[j]);
+        values[14-j] = function(center+halfWidth*KRONROD_POINTS[j]);
+    }
+    double kronrod = KRONROD_WEIGHTS[7]*values[7];
+    double gauss = GAUSS_WEIGHTS[3]*values[7];
+    double magnitude = KRONROD_WEIGHTS[7]*abs(values[7]);
+    for (int j = 0; j < 7; j++) {
+        double pair = values[j]+values[14-j];
+        kronrod += KRONROD_WEIGHTS[j]*pair;
+        magnitude += KRONROD_WEIGHTS[j]*(abs(values[j])+abs(values[14-j]));
+        if ((j & 1) != 0)
+            gauss += GAUSS_WEIGHTS[j/2]*pair;
+    }
+
+    // How far the integrand strays from its mean scales the raw difference between the rules, which is
+    // usually far larger than the true error.
+
+    double mean = 0.5*kronrod;
+    double spread = KRONROD_WEIGHTS[7]*abs(values[7]-mean);
+    for (int j = 0; j < 7; j++)
+        spread += KRONROD_WEIGHTS[j]*(abs(values[j]-mean)+abs(values[14-j]-mean));
+    double scale = abs(halfWidth);
+    double error = abs((kronrod-gauss)*halfWidth);
+    spread *= scale;
+    if (spread != 0 && error != 0)
+        error = spread*min(1.0, pow(200*error/spread, 1.5));
+    piece.integral = kronrod*halfWidth;
+    piece.magnitude = magnitude*scale;
+    piece.error = max(error, 50*EPSILON*piece.magnitude);
+}
+
+double UnivariateFunction::integrate(double start, double end, double& error) {
+    if (start == end) {
+        error = 0;
+        return 0;
+    }
+    if (start > end) {
+        double result = integrate(end, start, error);
+        return -result;
+    }
+    if (start != start || end != end) {
+        error = numeric_limits<double>::quiet_NaN();
+        return error;
+    }
+    if (start == -numeric_limits<double>::infinity() && end == numeric_limits<double>::infinity()) {
+        // Each half line has its own change of variable, which suits integrands centred near 0 best.
+
+        double lowerError, upperError;
+        double result = integrate(start, 0, lowerError) + integrate(0, end, upperError);
+        error = lowerError+upperError;
+        return result;
+    }
+
+    // Change the variable to t in [0, 1], multiplying by dx/dt.  For a
+    // finite range x = start + (end-start)*t^2*(3-2t), whose derivative vanishes at both ends.
+
+    bool lowerInfinite = (start == -numeric_limits<double>::infinity());
+    bool upperInfinite = (end == numeric_limits<double>::infinity());
+    auto function = [&](double t) {
+        double x, dxdt;
+        if (upperInfinite) {
+            x = start + t/(1-t);
+            dxdt = 1/((1-t)*(1-t));
+        }
+        else if (lowerInfinite) {
+            x = end - (1-t)/t;
+            dxdt = 1/(t*t);
+        }
+        else {
+            x = start + (end-start)*t*t*(3-2*t);
+            dxdt = 6*(end-start)*t*(1-t);
+        }
+        double y = evaluate(x);
+        return (y == 0 ? 0.0 : y*dxdt); // Far out along an infinite range dxdt may overflow where y is 0
+    };
+
+    // Keep the pieces in a heap ordered by error, and split the worst until the total is small enough.
+    // The tolerance is relative to the integral of |f| rather than of f, so an integral that cancels to
+    // about 0, such as sin(x) from -1 to 1, stops as soon as the pieces are accurate.
+
+    vector<Piece> pieces(1, Piece{0.0, 1.0, 0.0, 0.0, 0.0});
+    integratePiece(function, pieces[0]);
+    double integral = pieces[0].integral;
+    double magnitude = pieces[0].magnitude;
+    error = pieces[0].error;
+    while ((int) pieces.size() < MAX_PIECES && error > INTEGRATION_TOLERANCE*magnitude && integral == integral) {
+        pop_heap(pieces.begin(), pieces.end());
+        Piece worst = pieces.back();
+        double middle = 0.5*(worst.start+worst.end);
+        if (!(middle > worst.start && middle < worst.end))
+            break; // Too narrow to split any further
+        Piece left = {worst.start, middle, 0.0, 0.0, 0.0}, right = {middle, worst.end, 0.0, 0.0, 0.0};
+        integratePiece(function, left);
+        integratePiece(function, right);
+        pieces.back() = left;
+        push_heap(pieces.begin(), pieces.end());
+        pieces.push_back(right);
+        push_heap(pieces.begin(), pieces.end());
+
+        // Add up from scratch so that rounding does not build up over many splits.
+
+        integral = 0;
+        magnitude = 0;
+        error = 0;
+        for (const Piece& piece : pieces) {
+            integral += piece.integral;
+            magnitude += piece.magnitude;
+            error += piece.error;
+        }
+    }
+    return integral;
+}
+
+// A limit is only accepted if the extrapolation settles to within this, relative to the larger of the
+// limit and 1.
+
+static const double LIMIT_TOLERANCE = 1e-7;
+
+/**
+ * Estimate the limit of a sequence with Wynn's epsilon algorithm, which generalizes Aitken's delta squared
+ * process and is exact for sums of geometric sequences.  Every other column of its table holds estimates,
+ * and the one that agrees best with its neighbours is returned.  The sequence is overwritten.
+ */
+
+static double wynnEpsilon(double* sequence, int count, double& error) {
+    // Each pass replaces the column in sequence with the next one, keeping the one before in previous.
+    // Every column is one shorter than the one before.
+
+    double previous[UnivariateFunction::LIMIT_STEPS] = {0};
+    double next[UnivariateFunction::LIMIT_STEPS];
+    double best = sequence[count-1];
+    error = numeric_limits<double>::infinity();
+    for (int k = 0; k+1 < count; k++) {
+        int length = count-k-1;
+        for (int j = 0; j < length; j++) {
+            double difference = sequence[j+1]-sequence[j];
+            if (difference == 0) {
+                // Two equal entries: an estimate column has converged exactly, and the next would divide by 0.
+
+                if (k%2 == 0) {
+                    error = 0;
+                    best = sequence[j];
+                }
+                return best;
+            }
+            next[j] = previous[j+1] + 1/difference;
+        }
+        if (k%2 == 1) {
+            for (int j = 1; j < length; j++) {
+                double difference = max(abs(next[j]-next[j-1]), abs(next[j]-previous[j+1]));
+                if (difference <= error) {
+                    error = difference;
+                    best = next[j];
+                }
+            }
+        }
+        for (int j = 0; j < length; j++) {
+            previous[j] = sequence[j];
+            sequence[j] = next[j];
+        }
+    }
+    return best;
+}
+
+double UnivariateFunction::findLimit(double point, int side, double& error) {
+    if (point != point) {
+        error = numeric_limits<double>::quiet_NaN();
+        return error;
+    }
+    if (abs(point) == numeric_limits<double>::infinity())
+        return findOneSidedLimit(point, (point > 0 ? -1 : 1), error);
+    if (side != 0)
+        return findOneSidedLimit(point, (side > 0 ? 1 : -1), error);
+    double lowerError, upperError;
+    double lower = findOneSidedLimit(point, -1, lowerError);
+    double upper = findOneSidedLimit(point, 1, upperError);
+    if (lower != lower || upper != upper) { // One side has no limit, such as sqrt(x) at 0
+        error = numeric_limits<double>::quiet_NaN();
+        return error;
+    }
+    if (lower == upper) {
+        error = max(lowerError, upperError);
+        return lower;
+    }
+    if (abs(lower-upper) > LIMIT_TOLERANCE*max(1.0, abs(upper)) + lowerError + upperError) {
+        error = numeric_limits<double>::quiet_NaN();
+        return error; // The two sides disagree
+    }
+    error = max(lowerError, upperError) + 0.5*abs(lower-upper);
+    return 0.5*(lower+upper);
+}
+
+double UnivariateFunction::findOneSidedLimit(double point, int direction, double& error) {
+    bool infinite = (abs(point) == numeric_limits<double>::infinity());
+    double step = (infinite ? 1.0 : 0.125*max(1.0, abs(point)));
+    double table[LIMIT_STEPS][LIMIT_STEPS];
+    double best = numeric_limits<double>::quiet_NaN();
+    error = numeric_limits<double>::infinity();
+    int rows = 0;
+    while (rows < LIMIT_STEPS) {
+        // Beyond an infinite point the variable is 1/step, so the function is a series in step either way.
+
+        double x = (infinite ? (point > 0 ? 1/step : -1/step) : point+direction*step);
+        if (x == point)
+            break; // The point cannot be approached any closer
+        int j = rows;
+        table[j][0] = evaluate(x);
+        if (table[j][0] != table[j][0])
+            break;
+        rows++;
+        double factor = 1;
+        for (int k = 1; k <= j; k++) {
+            factor *= 2;
+            table[j][k] = table[j][k-1] + (table[j][k-1]-table[j-1][k-1])/(factor-1);
+            double difference = max(abs(table[j][k]-table[j][k-1]), abs(table[j][k]-table[j-1][k-1]));
+            if (difference <= error) {
+                error = difference;
+                best = table[j][k];
+            }
+        }
+        bool settled = (error <= LIMIT_TOLERANCE*max(1.0, abs(best)));
+        if (settled && abs(table[j][j]-table[j-1][j-1]) >= 2*error)
+            break; // Rounding has taken over
+        if (error <= 4*EPSILON*abs(best))
+            break;
+        step *= 0.5;
+    }
+
+    // Values that keep growing by a steady factor in one direction go to infinity, and extrapolating them
+    // means nothing.
+
+    if (rows >= 4) {
+        bool growing = true;
+        for (int j = rows-3; j < rows && growing; j++)
+            growing = (table[j][0]*table[j-1][0] > 0 && abs(table[j][0]) >= 1.5*abs(table[j-1][0]));
+        if (growing) {
+            error = 0;
+            return (table[rows-1][0] > 0 ? numeric_limits<double>::infinity() : -numeric_limits<double>::infinity());
+        }
+    }
+    if (!(error <= LIMIT_TOLERANCE*max(1.0, abs(best))) && rows >= 3) {
+        // The error is not a series in whole powers of the step, such as sqrt(x) or x*ln(x) at 0.  Wynn's
+        // epsilon algorithm makes no such assumption, and needs no more evaluations.
+
+        double samples[LIMIT_STEPS];
+        for (int j = 0; j < rows; j++)
+            samples[j] = table[j][0];
+        best = wynnEpsilon(samples, rows, error);
+    }
+    if (!(error <= LIMIT_TOLERANCE*max(1.0, abs(best)))) {
+        error = numeric_limits<double>::quiet_NaN();
+        return error;
+    }
+    return (abs(best) <= error ? 0.0 : best); // Smaller than its own error is indistinguishable from 0
+}
@@ -5,7 +5,6 @@
 #endif
 #include "DisplayOutputType.h"
 #include "DisplayAngleUnit.h"
-#include "Features.h"
 #include "Receiver.h"
 #include "Matrix.h"
 #include <iostream>
@@ -17,6 +16,8 @@
 #include "LED.h"
 #include "RTC.h"
 #include "Graph.h"
+//Last, since its bits are macros named like the Lepton::Operation ids the headers above use
+#include "Features.h"
 //#include "hardware/watchdog.h"
 
 Lepton::Parser parser = Lepton::Parser();
@@ -24,7 +25,7 @@ Lepton::Parser parser = Lepton::Parser();
 //TODO: this might not be safe to modify from an IRQ
 void disableFeatures(u64 features) {
     for (int i=0; i<64; i++) {
-        unsigned long long feature = features & (1<<i);
+        unsigned long long feature = features & (1ULL<<i);
         if (feature != 0) {
             auto it = bitToFeaturesMap.find(feature);
             if (it != bitToFeaturesMap.end())
@@ -47,6 +48,12 @@ void disableFeatures(u64 features) {
 #define TRANS_NSS 1
 #define TRANS_DIO0 4
 
+//Evaluation budget, the ON key cancels sooner
+#define ON_KEY 29
+#define SEQUENCE_LINES 3 //The recurrence u(n) and the seeds u(0), u(1)
+#define EVAL_MAX_OPERATIONS 2000000
+#define EVAL_TIME_LIMIT_US (30*1000*1000)
+
 //Initialize periphreals
 static Receiver receiver(0, TRANS_SCK, TRANS_MISO, TRANS_MOSI, TRANS_NSS, TRANS_DIO0);
 static LED led(LED_PIN);
@@ -70,6 +77,12 @@ static absolute_time_t enteredTime;
 static u8 enteredDuration;
 static Screen* screenPtr;//Global versions of these allow us to access what we cannot reach
 static KeyboardInputReceiver* keyboardPtr;
+
+//Polled by long evaluations so ON can break out of them
+bool onKeyPressed(){
+    return keyboardPtr != NULL && keyboardPtr->isKeyDown(ON_KEY);
+}
+
 void enterTestMode(u8 seed, u8 duration, u64 features, char* code, bool shouldStore){
 
     if(code){//If there is a code, entry is optional
@@ -96,6 +109,7 @@ void enterTestMode(u8 seed, u8 duration, u64 features, char* code, bool shouldSt
         rtc.storeTest(seed, duration, features);
     disableFeatures(features);
     led.enterTest(seed);
+    Lepton::EvaluationContext::current().seedRandom(seed);//Everyone taking the test gets the same RNG sequence
 
     add_alarm_in_ms(duration*1000*60, exitTest, NULL, true);
 }
@@ -235,14 +249,24 @@ GraphFunctions graphFnMenu(unsigned int* fn1, unsigned int* fn2, KeyboardInputRe
     }
 }
 
+//Redraws the graph within the evaluation budget, a Break (ON held or the budget used up) stops the redraw but keeps what was
+//drawn so far on screen, functions left unfinished are evaluated again on the next redraw
+template <class Redraw>
+void redrawGraph(Screen* screen, Redraw redraw){
+    screen->clearImage();
+    try{
+        Lepton::EvaluationBudget budget(EVAL_MAX_OPERATIONS, EVAL_TIME_LIMIT_US);
+        redraw();
+    } catch(const Lepton::EvaluationBreak& e){}
+    screen->printImage();
+}
+
 void graphScreen(std::string strings[], Graph* graph, KeyboardInputReceiver* keyboardInputReceiver, Screen* screen){
     screen->clearImage();
     if(parser.checkFeatureDisabled("Disable graphing"))
         throw DisabledFeatureException("Graphs");
     
-    screen->clearImage();
-    graph->drawGraphs(strings);
-    screen->printImage();
+    redrawGraph(screen, [&](){ graph->drawGraphs(strings); });
 
     int64_t startTime = time_us_64();
     int keyIndex = keyboardInputReceiver->getButtonKeyIndex(startTime);
@@ -257,20 +281,14 @@ void graphScreen(std::string strings[], Graph* graph, KeyboardInputReceiver* key
                 dir = UP;
             else
                 dir = RIGHT;
-            screen->clearImage();
-            graph->handleMovement(dir);
-            screen->printImage();
+            redrawGraph(screen, [&](){ graph->handleMovement(dir); });
         }
         else if(keyIndex == 47){
-            screen->clearImage();
-            graph->handleEnter();
-            screen->printImage();
+            redrawGraph(screen, [&](){ graph->handleEnter(); });
         }
         else if(keyIndex == 8){//Graph ctrl
             graphLimitsMenu(graph, keyboardInputReceiver, screen);
-            screen->clearImage();
-            graph->update();
-            screen->printImage();
+            redrawGraph(screen, [&](){ graph->update(); });
         }
         else if(keyIndex == 7){//Graph fn
             unsigned int fn1 = 0;
@@ -281,9 +299,10 @@ void graphScreen(std::string strings[], Graph* graph, KeyboardInputReceiver* key
             if(parser.checkFeatureDisabled("fnInt"))
                 throw DisabledFeatureException("fnInt", "function");
 
-            if(whichFn != NONE)
-                graph->beginFunction(whichFn, fn1, fn2);
-            screen->printImage();
+            redrawGraph(screen, [&](){
+                if(whichFn != NONE)
+                    graph->beginFunction(whichFn, fn1, fn2);
+            });
         }
         keyIndex = keyboardInputReceiver->getButtonKeyIndex(startTime);
     }
@@ -369,9 +388,49 @@ void angleUnitsMenu(KeyboardInputReceiver keyboardInputReceiver, Screen* screen,
     return;
 }
 
-void modeMenu(KeyboardInputReceiver keyboardInputReceiver, Screen* screen, outputTypeEnum* outputType, angleUnitEnum* angleUnit){
-    std::string menuOptions1[2] = {"Angle Units", "Output Type"};
-    int numOptions1 = 2;
+void graphPrecisionMenu(KeyboardInputReceiver keyboardInputReceiver, Screen* screen, GraphPrecision* graphPrecision){
+    std::string menuOptions1[3] = {"Double", "Single", "Fixed Point"};
+    int numOptions1 = 3;
+    int selected = 0;
+    int64_t startTime = time_us_64();
+    
+    int keyIndex = 0;
+    // While the key pressed is not the ON button to exit the menu
+    while (keyIndex != 29){
+        screen->drawListMenu("PRECISION", menuOptions1, numOptions1, selected);
+        screen->printImage();
+        
+        keyIndex = keyboardInputReceiver.getButtonKeyIndex(startTime);
+
+        // Up key is pressed
+        if (keyIndex == 2){
+            selected = ((selected - 1) < 0) ? numOptions1-1 : (selected - 1);
+        }
+        // Down key is pressed
+        else if (keyIndex == 9){
+            selected = ((selected + 1) > (numOptions1 - 1) ? 0 : (selected + 1));
+        }
+        // Enter key is pressed, return index of matrix to select
+        else if (keyIndex == 47){
+            if (menuOptions1[selected] == "Double"){
+                *graphPrecision = PRECISION_DOUBLE;
+            }
+            else if (menuOptions1[selected] == "Single"){
+                *graphPrecision = PRECISION_FLOAT;
+            }
+            else{
+                *graphPrecision = PRECISION_FIXED;
+            }
+            return;
+        }
+    }
+    
+    return;
+}
+
+void modeMenu(KeyboardInputReceiver keyboardInputReceiver, Screen* screen, outputTypeEnum* outputType, angleUnitEnum* angleUnit, GraphPrecision* graphPrecision){
+    std::string menuOptions1[3] = {"Angle Units", "Output Type", "Graph Precision"};
+    int numOptions1 = 3;
     int selected = 0;
     int64_t startTime = time_us_64();
     
@@ -396,9 +455,12 @@ void modeMenu(KeyboardInputReceiver keyboardInputReceiver, Screen* screen, outpu
             if (menuOptions1[selected] == "Angle Units"){
                 angleUnitsMenu(keyboardInputReceiver, screen, angleUnit);
             }
-            else{
+            else if (menuOptions1[selected] == "Output Type"){
                 outputTypeMenu(keyboardInputReceiver, screen, outputType);
             }
+            else{
+                graphPrecisionMenu(keyboardInputReceiver, screen, graphPrecision);
+            }
         }
     }
     
@@ -457,6 +519,49 @@ std::string logicMenu(KeyboardInputReceiver keyboardInputReceiver, Screen* scree
     return "";
 }
 
+// Lists the Y= functions and the sequence, returns the start of a call to the selected one, e.g. "f1(", or "SEQUENCE" to edit the sequence
+std::string functionCallMenu(std::string storedFunctions[], std::string sequenceStrings[], KeyboardInputReceiver keyboardInputReceiver, Screen* screen){
+    std::string menuOptions1[6];
+    int numOptions1 = 6;
+    int selected = 0;
+    int64_t startTime = time_us_64();
+    for (int i = 0; i < 4; i++){
+        menuOptions1[i] = "f" + std::to_string(i+1) + "(x)=" + storedFunctions[i];
+    }
+    menuOptions1[4] = "u(n)=" + sequenceStrings[0];
+    menuOptions1[5] = "Edit u(n)";
+    
+    int keyIndex = 0;
+    // While the key pressed is not the ON button to exit the menu
+    while (keyIndex != 29){
+        screen->drawListMenu("Y-VARS", menuOptions1, numOptions1, selected);
+        screen->printImage();
+        
+        keyIndex = keyboardInputReceiver.getButtonKeyIndex(startTime);
+
+        // Up key is pressed
+        if (keyIndex == 2){
+            selected = ((selected - 1) < 0) ? numOptions1-1 : (selected - 1);
+        }
+        // Down key is pressed
+        else if (keyIndex == 9){
+            selected = ((selected + 1) > (numOptions1 - 1) ? 0 : (selected + 1));
+        }
+        // Enter key is pressed, return the call to the selected function
+        else if (keyIndex == 47){
+            if (selected == 4){
+                return "u(";
+            }
+            else if (selected == 5){
+                return "SEQUENCE";
+            }
+            return "f" + std::to_string(selected+1) + "(";
+        }
+    }
+    
+    return "";
+}
+
 std::string trigMenu(KeyboardInputReceiver keyboardInputReceiver, Screen* screen){
     std::string menuOptions1[7] = {"Secant", "Cosecant", "Cotangent", "Cosh", "Sinh", "Tanh", "Acosh"};
     std::string menuOptions2[7] = {"Asinh", "Atanh", "Asecant", "Acosecant", "Acotangent", "Secanth", "Cosecanth"};
@@ -603,6 +708,56 @@ void functionMenu(std::string storedFunctions[], KeyboardInputReceiver keyboardI
 
 }
 
+std::vector<std::string> sequenceVectors[SEQUENCE_LINES];
+// Edits the recurrence of the sequence and its seed values, the x/theta key types n here
+void sequenceMenu(std::string sequenceStrings[], KeyboardInputReceiver keyboardInputReceiver, Screen* screen){
+    std::string labels[SEQUENCE_LINES] = {"u(n)=", "u(0)=", "u(1)="};
+    std::string menuOptions[SEQUENCE_LINES];
+    int8_t selected = 0;
+    std::string expressionComponent;
+    int64_t startTime = time_us_64();
+
+    int keyIndex = 0;
+    while (true){
+        for (int i = 0; i < SEQUENCE_LINES; i++){
+            menuOptions[i] = labels[i] + sequenceStrings[i];
+        }
+        screen->drawListMenu("SEQUENCE", menuOptions, SEQUENCE_LINES, selected);
+        screen->printImage();
+
+        keyIndex = keyboardInputReceiver.getButtonKeyIndex(startTime);
+        if (keyIndex == 29 || keyIndex == 47){//On or enter button exit menu
+            break;
+        }
+        // Up key is pressed
+        else if (keyIndex == 2 && selected > 0){
+            selected--;
+        }
+        // Down key is pressed
+        else if (keyIndex == 9 && selected < SEQUENCE_LINES-1){
+            selected++;
+        }
+        else if (keyIndex == 6){//x/theta button
+            sequenceVectors[selected].push_back("n");
+            sequenceStrings[selected] += "n";
+        }
+        // Delete button pressed
+        else if (keyIndex == 41 && sequenceVectors[selected].size() != 0) {
+            std::string tmpString = "";
+            sequenceVectors[selected].pop_back();
+            for (std::string exp : sequenceVectors[selected]) {
+                tmpString += exp;
+            }
+            sequenceStrings[selected] = tmpString;
+        }
+        else{
+            expressionComponent = keyboardInputReceiver.getkeyIndexValue(keyIndex);
+            sequenceVectors[selected].push_back(expressionComponent);
+            sequenceStrings[selected] += expressionComponent;
+        }
+    }
+}
+
 void matrixMenuEdit(KeyboardInputReceiver keyboardInputReceiver, Screen* screen, int64_t startTime){
     std::string menuOptions[6] = {"[A]", "[B]", "[C]", "[D]", "[E]", "[F]"};
     std::string expression = "";
@@ -685,8 +840,8 @@ void matrixMenuEdit(KeyboardInputReceiver keyboardInputReceiver, Screen* screen,
 }
 
 std::string matrixMenuMath(KeyboardInputReceiver keyboardInputReceiver, Screen* screen, int64_t startTime){
-    std::string menuOptions[5] = {"Transpose", "Det", "Dot", "Cross", "Solve Ax=b"};
-    int numOptions = 5;
+    std::string menuOptions[7] = {"Transpose", "Det", "Dot", "Cross", "Solve Ax=b", "Eigenvalues", "Inverse"};
+    int numOptions = 7;
     int selected = 0;
     std::string retOp = "";
     
@@ -724,6 +879,12 @@ std::string matrixMenuMath(KeyboardInputReceiver keyboardInputReceiver, Screen*
                 case 4:
                     retOp = retOp + "solveSOLE" + "(";
                     break;
+                case 5:
+                    retOp = retOp + "eig" + "(";
+                    break;
+                case 6:
+                    retOp = retOp + "inv" + "(";
+                    break;
             }
             return retOp;
         }
@@ -823,6 +984,20 @@ std::string trimZeros(std::string num){
     return num;
 }
 
+// Format an integer in base 2, 8 or 16 as its 64 bit two's complement pattern, or in base 10 with a sign
+std::string formatInteger(int64_t value, int base){
+    const char digits[] = "0123456789ABCDEF";
+    uint64_t remaining = (base == 10 && value < 0) ? 0-(uint64_t)value : (uint64_t)value;
+    std::string result = "";
+    do {
+        result.insert(result.begin(), digits[remaining % base]);
+        remaining /= base;
+    } while (remaining != 0);
+    if (base == 10 && value < 0)
+        result.insert(result.begin(), '-');
+    return result;
+}
+
 int main() {
     stdio_init_all();
     
@@ -844,8 +1019,11 @@ int main() {
     std::string expression = "";
     outputTypeEnum outputType = DECIMAL;
     angleUnitEnum angleUnit = RAD;
+    GraphPrecision graphPrecision = PRECISION_FLOAT;
     
     std::string storedFunctions[4];
+    std::string sequenceStrings[SEQUENCE_LINES];
+    int64_t integerAns = 0;
 
     //Initialize the screen
     Screen *screen = new Screen();
@@ -863,6 +1041,8 @@ int main() {
     KeyboardInputReceiver keyboardInputReceiver = KeyboardInputReceiver(screen);
     keyboardPtr = &keyboardInputReceiver;
     #endif
+    Lepton::EvaluationContext::setClock(time_us_64);
+    Lepton::EvaluationContext::setBreakCheck(onKeyPressed);
 
     std::map<std::string, double> variables = {{"ans", 0}, {"PI", 3.14159265358979323846}, {"e", 2.71828182845904523536}};
     int wasTest = rtc.readTest();
@@ -880,7 +1060,22 @@ int main() {
 
     rtc.readVariables(variables);
 
-    Graph graph(variables, &parser);
+    // The Y= functions, which expressions can call as f1(x) to f4(x). Each is parsed and compiled once, when first called after it changes.
+    std::map<std::string, Lepton::CustomFunction*> functions;
+    Lepton::StoredFunction* callableFunctions[4];
+    for (int i = 0; i < 4; i++){
+        std::string name = "f" + std::to_string(i+1);
+        callableFunctions[i] = new Lepton::StoredFunction(name, {"x"}, variables, functions);
+        functions[name] = callableFunctions[i];
+    }
+    // The sequence u(n), whose terms are remembered so a recurrence costs one evaluation per term
+    Lepton::StoredSequence* sequence = new Lepton::StoredSequence("u", "n", variables, functions);
+    functions["u"] = sequence;
+    #ifndef NO_BUTTONS
+    keyboardInputReceiver.setCustomFunctions(&functions);
+    #endif
+
+    Graph graph(variables, &parser, functions);
 
     while (1) {
         #ifndef NO_BUTTONS
@@ -894,6 +1089,32 @@ int main() {
 
         if (expression == "Y="){
             functionMenu(storedFunctions, keyboardInputReceiver, screen);
+            for (int i = 0; i < 4; i++){
+                callableFunctions[i]->setDefinition(storedFunctions[i]);
+            }
+            continue;
+        }
+        else if (expression == "Y-VARS"){
+            std::string functionCall = functionCallMenu(storedFunctions, sequenceStrings, keyboardInputReceiver, screen);
+            if (functionCall == "SEQUENCE"){
+                sequenceMenu(sequenceStrings, keyboardInputReceiver, screen);
+                try {
+                    // The seeds are the values typed in from u(0) up to the first empty one
+                    std::vector<double> seeds;
+                    for (int i = 1; i < SEQUENCE_LINES && !sequenceStrings[i].empty(); i++){
+                        seeds.push_back(parser.parse(sequenceStrings[i], functions).evaluate(variables).getReal());
+                    }
+                    sequence->setDefinition(sequenceStrings[0]);
+                    sequence->setSeeds(seeds);
+                } catch (const std::exception& e) {
+                    screen->clearImage();
+                    screen->drawWrappingString(1, 100, e.what(), &Font12, BLACK, WHITE);
+                    screen->printImage();
+                }
+                keyboardInputReceiver.buildExpression("");
+                continue;
+            }
+            keyboardInputReceiver.buildExpression(functionCall);
             continue;
         }
         else if(expression == "MATRIX"){
@@ -912,8 +1133,10 @@ int main() {
             continue;
         }
         else if(expression == "MODE"){
-            modeMenu(keyboardInputReceiver, screen, &outputType, &angleUnit);
+            modeMenu(keyboardInputReceiver, screen, &outputType, &angleUnit, &graphPrecision);
             parser.setAngleUnit(angleUnit == DEG ? true : false);
+            parser.setIntegerMode(outputType != DECIMAL);
+            graph.setPrecision(graphPrecision);
             keyboardInputReceiver.buildExpression("");
             continue;
         }
@@ -927,12 +1150,46 @@ int main() {
                 continue;
             }
 
-            Result result = parser.parse(expression).evaluate(variables);
+            Lepton::EvaluationBudget budget(EVAL_MAX_OPERATIONS, EVAL_TIME_LIMIT_US);
+            if (parser.getIntegerMode()){
+                // Programmer mode: evaluate in 64 bit integers so results are exact past 2^53
+                std::map<std::string, int64_t> integerVariables;
+                for (const auto& variable : variables){
+                    if (variable.second == std::floor(variable.second) && std::abs(variable.second) < 9.2233720368547758e18)
+                        integerVariables[variable.first] = (int64_t)variable.second;
+                }
+                // ans is only exact here if it came from programmer mode
+                if ((double)integerAns == variables["ans"])
+                    integerVariables["ans"] = integerAns;
+                integerAns = parser.parse(expression, functions).evaluateInteger(integerVariables);
+                variables["ans"] = (double)integerAns;
+
+                std::string formatted;
+                switch (outputType){
+                    case BINARY:
+                        formatted = "0b" + formatInteger(integerAns, 2);
+                        break;
+                    case OCTAL:
+                        formatted = "0o" + formatInteger(integerAns, 8);
+                        break;
+                    case HEXADECIMAL:
+                        formatted = "0x" + formatInteger(integerAns, 16);
+                        break;
+                    default:
+                        formatted = formatInteger(integerAns, 10);
+                        break;
+                }
+                std::cout << "\n=" << formatted << "\n";
+                screen->drawWrappingString(1, 32, "= " + formatted, &Font16, BLACK, WHITE);
+                screen->printImage();
+                continue;
+            }
+            Result result = parser.parse(expression, functions).evaluate(variables);
             Eigen::MatrixXd matrixResult;
             std::complex<double> complexResult;
             double value;
             if (result.dataTypeEnum == DataTypeEnum::matrix){
-                matrixResult = result.matrix;
+                matrixResult = result.getMatrix();
                 for (int i = 0; i < matrixResult.rows(); i++){
                     for (int j = 0; j < matrixResult.cols(); j++){
                         std::cout << matrixResult(i,j) << std::endl;
@@ -973,26 +1230,17 @@ int main() {
                         stream << std::defaultfloat << real(complexResult);
                         screen->drawString(1, 32, "= " + trimZeros(stream.str()), &Font16, BLACK, WHITE);
                     }
+                    double integrationError = Lepton::EvaluationContext::current().getIntegrationError();
+                    if (integrationError > 0){// Some fnInt was only accurate to about this much
+                        char errorString[32];
+                        snprintf(errorString, sizeof(errorString), "fnInt error ~%.1e", integrationError);
+                        std::cout << " (" << errorString << ")";
+                        screen->drawString(1, 100, errorString, &Font12, BLACK, WHITE);
+                    }
                     fflush(stdout);
                     screen->printImage();
                     break;
                 }
-                case BINARY: {
-                    std::bitset<32> x(value);
-                    std::cout << x;
-                    screen->drawString(1, 32, "= " + trimZeros(x.to_string()), &Font16, BLACK, WHITE);
-                    screen->printImage();
-                    break;
-                }
-                case OCTAL: {
-                    // TO DO: Convert to octal appropriately as std::oct does not work with double data types.
-                    std::cout << std::oct << value;
-                    break;
-                }
-                case HEXADECIMAL: {
-                    std::cout << std::hexfloat << value;
-                    break;
-                }
                 default: {
                     std::cout << std::defaultfloat << value;
                     screen->drawString(1, 32, "= " + trimZeros(std::__cxx11::to_string(value)), &Font16, BLACK, WHITE);
@@ -1012,6 +1260,9 @@ int main() {
             strcat(eString, " min(s)");
             screen->drawWrappingString(1, 32, eString, &Font12, BLACK, WHITE);
             screen->printImage();
+        } catch (const Lepton::EvaluationBreak& e) {
+            screen->drawString(1, 32, "Break", &Font16, BLACK, WHITE);
+            screen->printImage();
         } catch (const std::exception& e) {
             screen->drawWrappingString(1, 100, e.what(), &Font12, BLACK, WHITE);
             screen->printImage();
@@ -0,0 +1,103 @@
+/**
+ * Checks that DependencySnapshot, which Graph and StoredSequence use to decide whether what they computed
+ * before is still good, only goes stale when something the expression actually reads changes.  Variables
+ * bound by sigma, fnInt and the like are not read from the global variables, so they must not count, and a
+ * variable that does not exist yet has not changed as long as it still does not exist.  Otherwise a sequence
+ * whose body uses one throws away its terms on every call, and a graph refits its surrogate on every redraw.
+ */
+
+#include "Lepton.h"
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <string>
+
+using namespace Lepton;
+using namespace std;
+
+// The screen and fit accuracy as Graph.h sees them, over a view from -10 to 10 both ways
+static const int SCREEN_WIDTH = 160;
+static const int SCREEN_HEIGHT = 130;
+static const double SURROGATE_REFINEMENT = 8;
+
+struct Case {
+    const char* expression;
+    bool readsB;
+};
+
+int main() {
+    // A-J are missing from the variables until something stores to them, as on the calculator.
+    map<string, double> variables = {{"B", 1}};
+    map<string, CustomFunction*> functions;
+    const Case cases[] = {{"sigma(1/k,k,1,x)", false}, {"fnInt(t,t,0,x)", false}, {"sigma(1/A,A,1,x)", false},
+            {"prod(1+1/A,A,1,x)", false}, {"lim(sin(A*x)/A,A,0)", false}, {"ode(y,t,y,0,1,x)", false}, {"C+x", false},
+            {"sigma(B/k,k,1,x)", true}, {"fnInt(t*B,t,0,x)", true}, {"solve(y^2-B,y)", true}, {"B+x", true}};
+    bool passed = true;
+    printf("Current after recording, and after B changes\n");
+    for (const Case& c : cases) {
+        DependencySnapshot snapshot;
+        snapshot.record(Parser::parse(c.expression, functions).getRootNode(), "x", variables, functions);
+        bool before = snapshot.isCurrent();
+        variables["B"] = 2;
+        bool after = snapshot.isCurrent();
+        variables["B"] = 1;
+        bool within = (before && after == !c.readsB);
+        printf("  %-22s %d %d  %s\n", c.expression, before, after, within ? "ok" : "WRONG");
+        passed &= within;
+    }
+
+    // A sequence keeps its terms between calls, so drawing the same columns again only looks them up.
+
+    StoredSequence sequence("u", "n", variables, functions);
+    functions["u"] = &sequence;
+    sequence.setDefinition("u(n-1)+sigma(1/A,A,1,n)");
+    sequence.setSeeds({0});
+    CompiledExpression graph = Parser::parse("u(x)", functions).createCompiledExpression();
+    double& x = graph.getVariableReference("x");
+    unsigned int operations[2];
+    for (int pass = 0; pass < 2; pass++) {
+        EvaluationBudget budget(0, 0);
+        for (int i = 0; i < 160; i++) {
+            x = i;
+            graph.evaluate();
+        }
+        operations[pass] = EvaluationContext::current().getOperationsUsed();
+    }
+    bool kept = (operations[1] < operations[0]/10);
+    printf("u(n)=u(n-1)+sigma(1/A,A,1,n) over 160 columns, drawn and redrawn: %u and %u operations  %s\n", operations[0],
+            operations[1], kept ? "ok" : "RECOMPUTED");
+    passed &= kept;
+
+    // Graph fits a surrogate to an expensive function and only throws it away when its snapshot goes stale,
+    // so redrawing the same view should not call the function at all.
+
+    const char* expensive[] = {"fnInt(sin(t)/t,t,0.001,x)", "sigma(1/(A+x^2),A,1,50)"};
+    for (const char* text : expensive) {
+        ParsedExpression parsed = Parser::parse(text, functions);
+        CompiledExpression compiled = parsed.createCompiledExpression();
+        double& t = compiled.getVariableReference("x");
+        int calls = 0;
+        function<double(double)> sample = [&](double value) {
+            calls++;
+            t = value;
+            return compiled.evaluate();
+        };
+        PiecewiseChebyshev surrogate;
+        DependencySnapshot inputs;
+        int drawn[2];
+        for (int pass = 0; pass < 2; pass++) {
+            calls = 0;
+            if (!inputs.isCurrent()) {
+                surrogate.clear();
+                inputs.record(parsed.getRootNode(), "x", variables, functions);
+            }
+            double stepSize = 20.0/SCREEN_WIDTH, pixelHeight = 20.0/SCREEN_HEIGHT;
+            surrogate.fit(sample, -10, 10-stepSize, pixelHeight/2, SURROGATE_REFINEMENT, (PiecewiseChebyshev::DEGREE+2)*stepSize);
+            drawn[pass] = calls;
+        }
+        bool reused = (drawn[0] > 0 && drawn[1] == 0);
+        printf("%s fitted and refitted: %d and %d calls  %s\n", text, drawn[0], drawn[1], reused ? "ok" : "REFITTED");
+        passed &= reused;
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+/**
+ * Checks the error table in lepton/FastMath.h, and the resolution promised by lepton/Fixed.h, against the
+ * double precision library.  It is built once for each LEPTON_FAST_MATH_ACCURACY level, prints the
+ * largest error of each function next to the limit in the table, and fails if any is over.
+ */
+
+#include "lepton/FastMath.h"
+#include "lepton/Fixed.h"
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+
+using namespace Lepton;
+using namespace std;
+
+// The table in FastMath.h, one row per function and one column per accuracy level.
+
+struct Limit {
+    const char* name;
+    double error[3];
+};
+
+static const Limit LIMITS[] = {
+    {"sin", {3.4e-4, 3.8e-6, 1.1e-7}},
+    {"cos", {3.4e-4, 3.8e-6, 1.1e-7}},
+    {"tan", {4.3e-4, 4.9e-6, 2.2e-7}},
+    {"exp", {8.3e-4, 3.5e-6, 2.5e-7}},
+    {"ln", {6.4e-5, 1.4e-6, 1.4e-7}},
+    {"sqrt", {1.8e-3, 5.0e-6, 2.0e-7}},
+    {"atan", {2.8e-4, 1.4e-5, 1.9e-7}}
+};
+
+static const int SAMPLES = 1000000;
+
+static float fromBits(int32_t bits) {
+    float x;
+    memcpy(&x, &bits, sizeof(x));
+    return x;
+}
+
+static int32_t toBits(float x) {
+    int32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return bits;
+}
+
+/**
+ * Call visit(x) for about SAMPLES floats in [low, high] with 0 < low < high, spaced evenly through their bit
+ * patterns so that every binade gets as many as the others.
+ */
+static void forEachPositive(float low, float high, const function<void(float)>& visit) {
+    int32_t first = toBits(low), last = toBits(high);
+    int32_t stride = max(1, (last-first)/SAMPLES);
+    for (int32_t bits = first; bits <= last && bits >= first; bits += stride)
+        visit(fromBits(bits));
+}
+
+// How an error is measured.  RELATIVE_ABOVE_ONE divides by the larger of 1 and the result, so it is
+// absolute for small results and relative for large ones, where rounding to float alone is more than the
+// absolute limit.
+
+enum ErrorKind {ABSOLUTE, RELATIVE, RELATIVE_ABOVE_ONE};
+
+/**
+ * Find the largest error of fast(x) against exact(x) over [tiny, bound], and [-bound, -tiny] as well if
+ * symmetric is true.
+ */
+static double maximumError(const function<float(float)>& fast, const function<double(double)>& exact, float tiny, float bound,
+        bool symmetric, ErrorKind kind) {
+    double largest = 0;
+    auto visit = [&](float x) {
+        double expected = exact(x);
+        double error = abs(fast(x)-expected);
+        if (kind == RELATIVE)
+            error /= abs(expected);
+        else if (kind == RELATIVE_ABOVE_ONE)
+            error /= max(1.0, abs(expected));
+        if (!(error <= largest))
+            largest = error;
+    };
+    forEachPositive(tiny, bound, visit);
+    if (symmetric)
+        forEachPositive(tiny, bound, [&](float x) { visit(-x); });
+    return largest;
+}
+
+/**
+ * Check that a Fixed operation is within one step of the resolution of the exact result, wherever that
+ * result is inside the representable range.
+ */
+static double fixedError(const function<Fixed(Fixed, Fixed)>& fast, const function<double(double, double)>& exact,
+        double low, double high) {
+    mt19937 random(1);
+    uniform_real_distribution<double> operand(low, high);
+    double largest = 0;
+    for (int i = 0; i < SAMPLES; i++) {
+        Fixed a(operand(random)), b(operand(random));
+        double expected = exact(a.toDouble(), b.toDouble());
+        if (!(abs(expected) < 32767))
+            continue;
+        largest = max(largest, abs(fast(a, b).toDouble()-expected));
+    }
+    return largest;
+}
+
+int main() {
+    const int level = LEPTON_FAST_MATH_ACCURACY;
+    const float smallest = numeric_limits<float>::denorm_min();
+    const float largest = numeric_limits<float>::max();
+    double measured[] = {
+        maximumError(FastMath::sin, [](double x) { return std::sin(x); }, smallest, FastMath::TRIG_LIMIT, true, ABSOLUTE),
+        maximumError(FastMath::cos, [](double x) { return std::cos(x); }, smallest, FastMath::TRIG_LIMIT, true, ABSOLUTE),
+        maximumError(FastMath::tan, [](double x) { return std::tan(x); }, smallest, 1.5f, true, RELATIVE),
+        maximumError(FastMath::exp, [](double x) { return std::exp(x); }, smallest, 87.0f, true, RELATIVE),
+        maximumError(FastMath::log, [](double x) { return std::log(x); }, smallest, largest, false, RELATIVE_ABOVE_ONE),
+        maximumError(FastMath::sqrt, [](double x) { return std::sqrt(x); }, smallest, largest, false, RELATIVE),
+        maximumError(FastMath::atan, [](double x) { return std::atan(x); }, smallest, largest, true, ABSOLUTE)
+    };
+    bool passed = true;
+    printf("LEPTON_FAST_MATH_ACCURACY %d\n", level);
+    for (int i = 0; i < (int) (sizeof(measured)/sizeof(measured[0])); i++) {
+        bool within = (measured[i] <= LIMITS[i].error[level-1]);
+        printf("  %-6s %.2e  limit %.1e  %s\n", LIMITS[i].name, measured[i], LIMITS[i].error[level-1], within ? "ok" : "OVER");
+        passed &= within;
+    }
+
+    // Fixed rounds every result down or towards zero, so it may be off by just under one step.
+
+    const double step = 1.0/Fixed::ONE;
+    double fixedMeasured[] = {
+        fixedError([](Fixed a, Fixed b) { return a+b; }, [](double a, double b) { return a+b; }, -16000, 16000),
+        fixedError([](Fixed a, Fixed b) { return a*b; }, [](double a, double b) { return a*b; }, -180, 180),
+        fixedError([](Fixed a, Fixed b) { return a/b; }, [](double a, double b) { return a/b; }, -100, 100),
+        fixedError([](Fixed a, Fixed) { return a.sqrt(); }, [](double a, double) { return std::sqrt(a); }, 0, 32000)
+    };
+    const char* fixedNames[] = {"+", "*", "/", "sqrt"};
+    for (int i = 0; i < 4; i++) {
+        bool within = (fixedMeasured[i] < step);
+        printf("  Fixed %-4s %.2e  limit %.2e  %s\n", fixedNames[i], fixedMeasured[i], step, within ? "ok" : "OVER");
+        passed &= within;
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,110 @@
+/**
+ * Checks the reduced precision paths Graph uses to draw functions, CompiledExpression::evaluateFloat() and
+ * evaluateFixed(), against double precision.  Each function is sampled at every column of a few views and
+ * the row it lands on is compared with the one double precision gives, the same way Graph::yToStorage()
+ * maps values to rows.  It also times each path, including the tree walk PRECISION_DOUBLE uses.  Timings
+ * on a host with an FPU understate how much the reduced precision paths save on the calculator.
+ */
+
+#include "Lepton.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <string>
+
+using namespace Lepton;
+using namespace std;
+
+// The screen as Graph.h sees it
+static const int SCREEN_WIDTH = 160;
+static const int SCREEN_HEIGHT = 130;
+
+// A column may land on a different row than in double precision when the value is close to the edge
+// between rows, but never further off than this.
+static const double MAX_PIXEL_ERROR = 0.5;
+
+// How many times each path evaluates every column when timing it
+static const int TIMING_PASSES = 200;
+
+struct View {
+    double xLeft, xRight, yBottom, yTop;
+};
+
+/**
+ * Find the largest distance in rows between value(x) and the exact value, over the columns where the exact
+ * value is finite and on screen.
+ */
+static double pixelError(CompiledExpression& compiled, const View& view, const function<double()>& value) {
+    double& x = compiled.getVariableReference("x");
+    double step = (view.xRight-view.xLeft)/SCREEN_WIDTH;
+    double scale = SCREEN_HEIGHT/(view.yTop-view.yBottom);
+    double largest = 0;
+    for (int i = 0; i < SCREEN_WIDTH; i++) {
+        x = view.xLeft + i*step;
+        double exact = (view.yTop-compiled.evaluate())*scale;
+        if (!(exact >= 0 && exact < SCREEN_HEIGHT))
+            continue;
+        double row = (view.yTop-value())*scale;
+        if (!(abs(row-exact) <= largest))
+            largest = abs(row-exact);
+    }
+    return largest;
+}
+
+/**
+ * Get the average time in nanoseconds to evaluate one column.
+ */
+static double timePerColumn(CompiledExpression& compiled, const View& view, const function<double()>& value) {
+    double& x = compiled.getVariableReference("x");
+    double step = (view.xRight-view.xLeft)/SCREEN_WIDTH;
+    volatile double sink = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int pass = 0; pass < TIMING_PASSES; pass++)
+        for (int i = 0; i < SCREEN_WIDTH; i++) {
+            x = view.xLeft + i*step;
+            sink = sink + value();
+        }
+    chrono::duration<double, nano> elapsed = chrono::steady_clock::now()-start;
+    return elapsed.count()/(TIMING_PASSES*SCREEN_WIDTH);
+}
+
+int main() {
+    const char* expressions[] = {"x^2", "x^3-3*x", "sin(x)", "2*cos(3*x)+x", "exp(-x^2)*cos(3*x)", "sqrt(abs(x))", "ln(x^2+1)",
+            "atan(x)", "tan(x)", "1/x", "x^2.5", "sin(x)/x"};
+    const View views[] = {{-10, 10, -10, 10}, {-1, 1, -1, 1}, {-100, 100, -100, 100}};
+    bool passed = true;
+    double total[4] = {0, 0, 0, 0};
+    printf("LEPTON_FAST_MATH_ACCURACY %d, largest error in rows and time per column in ns\n", LEPTON_FAST_MATH_ACCURACY);
+    printf("  %-20s %8s %8s   %8s %8s %8s %8s\n", "", "float", "fixed", "tree", "double", "float", "fixed");
+    for (const char* text : expressions) {
+        ParsedExpression parsed = Parser::parse(text);
+        CompiledExpression compiled = parsed.createCompiledExpression();
+        double& x = compiled.getVariableReference("x");
+        function<double()> exact = [&]() { return compiled.evaluate(); };
+        function<double()> single = [&]() { return (double) compiled.evaluateFloat(); };
+        function<double()> fixed = [&]() { return compiled.evaluateFixed().toDouble(); };
+        map<string, double> variables;
+        function<double()> tree = [&]() {
+            variables["x"] = x;
+            Result result = ParsedExpression::publicEvaluate(parsed.getRootNode(), variables);
+            return (result.isReal() ? result.getReal() : nan(""));
+        };
+        double floatError = 0, fixedError = 0;
+        for (const View& view : views) {
+            floatError = max(floatError, pixelError(compiled, view, single));
+            fixedError = max(fixedError, pixelError(compiled, view, fixed));
+        }
+        double times[4] = {timePerColumn(compiled, views[0], tree), timePerColumn(compiled, views[0], exact),
+                timePerColumn(compiled, views[0], single), timePerColumn(compiled, views[0], fixed)};
+        for (int i = 0; i < 4; i++)
+            total[i] += times[i];
+        bool within = (floatError <= MAX_PIXEL_ERROR && fixedError <= MAX_PIXEL_ERROR);
+        printf("  %-20s %8.1e %8.1e   %8.1f %8.1f %8.1f %8.1f  %s\n", text, floatError, fixedError, times[0], times[1], times[2],
+                times[3], within ? "ok" : "OVER");
+        passed &= within;
+    }
+    printf("  %-20s %8s %8s   %8.1f %8.1f %8.1f %8.1f\n", "total", "", "", total[0], total[1], total[2], total[3]);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,47 @@
+/**
+ * Times sigma and prod over long ranges, which ParallelReduction splits into chunks.  It is built twice,
+ * against the evaluator with LEPTON_THREADS at 1 and above 1, so running both compares the serial and
+ * parallel reductions.  The parallel one takes the number of threads as its argument, so the speedup can
+ * be measured for each.  The results are printed in full, and should match digit for digit between runs.
+ *
+ * The parallel path is for host builds only.  The calculator is built with LEPTON_THREADS at 1 and runs
+ * every chunk on the calling thread, so this says nothing about its speed there.
+ */
+
+#include "Lepton.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+
+using namespace Lepton;
+using namespace std;
+
+// How many times each expression is evaluated, keeping the fastest
+static const int REPEATS = 3;
+
+int main(int argc, char* argv[]) {
+    int threads = (LEPTON_THREADS > 1 && argc > 1 ? max(1, atoi(argv[1])) : LEPTON_THREADS);
+    ParallelReduction::setThreadCount(threads);
+    const char* expressions[] = {"sigma(1/k^1.5,k,1,1e6)", "sigma(sin(k)/k,k,1,1e6)", "prod(1+1/k^2,k,1,1e6)",
+            "sigma(sigma(1/(j*k+1),j,1,1000),k,1,1000)", "sigma(fnInt(x^k,x,0,1),k,1,600)"};
+    map<string, double> variables;
+    printf("%d threads, fastest of %d in ms\n", threads, REPEATS);
+    for (const char* text : expressions) {
+        ParsedExpression parsed = Parser::parse(text);
+        double fastest = 0;
+        Result result;
+        for (int i = 0; i < REPEATS; i++) {
+            EvaluationBudget budget(100000000, 0);
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            result = parsed.evaluate(variables);
+            chrono::duration<double, milli> elapsed = chrono::steady_clock::now()-start;
+            if (i == 0 || elapsed.count() < fastest)
+                fastest = elapsed.count();
+        }
+        printf("  %-42s %9.1f  %.17g\n", text, fastest, result.getReal());
+    }
+    return 0;
+}
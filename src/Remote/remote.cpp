@@ -167,7 +167,7 @@ void printFunctionsMenu() {
                         break;
                     }
                     case 2: {
-                        uint8_t menuLength = 10;
+                        uint8_t menuLength = 14;
                         std::string menuList[menuLength] =  {
                             "fnInt",
                             "sigma",
@@ -179,6 +179,10 @@ void printFunctionsMenu() {
                             "gcd",
                             "lcm",
                             "rand",
+                            "solve",
+                            "lim",
+                            "proots",
+                            "ode",
                         };
                         printSubFunctionsMenu("Math Funct's", menuList, menuLength);
                         break;
@@ -51,6 +51,12 @@
 #define VARIABLE (1ULL << 46)
 #define COMPLEX_NUMBER (1ULL << 47)
 #define GRAPH (1ULL << 48)
+#define EIG (1ULL << 49)
+#define INV (1ULL << 50)
+#define SOLVE (1ULL << 51)
+#define LIM (1ULL << 52)
+#define PROOTS (1ULL << 53)
+#define ODE (1ULL << 54)
 
 const std::map<std::string, unsigned long long> featuresToBitMap = {
     {"sin", SIN},
@@ -98,6 +104,12 @@ const std::map<std::string, unsigned long long> featuresToBitMap = {
     {"dot", DOT},
     {"cross", CROSS},
     {"solveSOLE", SOLVE_SOLE},
+    {"eig", EIG},
+    {"inv", INV},
+    {"solve", SOLVE},
+    {"lim", LIM},
+    {"proots", PROOTS},
+    {"ode", ODE},
     {"[A]", MATRIX},
     {"Disable variable", VARIABLE},
     {"Disable complex", COMPLEX_NUMBER},
@@ -150,6 +162,12 @@ const std::map<unsigned long long, std::string> bitToFeaturesMap = {
     {DOT, "dot"},
     {CROSS, "cross"},
     {SOLVE_SOLE, "solveSOLE"},
+    {EIG, "eig"},
+    {INV, "inv"},
+    {SOLVE, "solve"},
+    {LIM, "lim"},
+    {PROOTS, "proots"},
+    {ODE, "ode"},
     {MATRIX, "[A]"},
     {VARIABLE, "Disable variable"},
     {COMPLEX_NUMBER, "Disable complex"},
@@ -2,7 +2,15 @@
 
 #include <string>
 #include <cstring>
+#include <map>
+#include <vector>
 #include "lepton/ParsedExpression.h"
+#include "lepton/CompiledExpression.h"
+#include "lepton/EvaluationContext.h"
+#include "lepton/OdeSolver.h"
+#include "lepton/PiecewiseChebyshev.h"
+#include "lepton/StoredFunction.h"
+#include "lepton/UnivariateFunction.h"
 #include "GUI_Paint.h"
 #include "LCD_1in8.h"
 
@@ -15,6 +23,18 @@
 
 #define TOO_LOW (unsigned char) -1
 #define TOO_HIGH (unsigned char) -2
+#define UNDEFINED (unsigned char) -3 //Not a real number, leaves a gap
+
+//Q16.16 only holds values up to 32768 with steps of 2^-16, views outside this are drawn in single precision instead
+#define FIXED_POINT_LIMIT 16384.0
+#define FIXED_POINT_MIN_RANGE 0.1
+
+//Expensive functions are drawn from a piecewise polynomial fitted to them, see lepton/PiecewiseChebyshev.h
+#define SURROGATE_TRANSCENDENTALS 8 //A function making more transcendental calls than this counts as expensive
+#define SURROGATE_REFINEMENT 8 //Fit to this fraction of the half pixel allowed, so the fit is kept after zooming in
+
+//Solutions of ode(f, x, y, x0, y0, x) are drawn from a single integration across the screen, see lepton/OdeSolver.h
+#define TRAJECTORY_REFINEMENT 8 //Error allowed in each step as a fraction of a pixel, steps add up so this is finer than a pixel
 
 enum GraphState {
     XHAIR, LEFT_LINE, RIGHT_LINE
@@ -28,12 +48,20 @@ enum Direction {
     UP, DOWN, LEFT, RIGHT
 };
 
+//Precision used to compute the points of the graphs, the values shown to the user are always double
+//Single precision and fixed point usually land on the same pixel as double, see CompiledExpression for the error bounds
+enum GraphPrecision {
+    PRECISION_DOUBLE, PRECISION_FLOAT, PRECISION_FIXED
+};
+
 class Graph {
     Args functions[4];
+    Lepton::CompiledExpression compiledFunctions[4]; //Same as functions, used for the reduced precision modes
     Args fnArg; //The one that actually goes into the operation
 
     const std::map<std::string, double>& globalVariables;//References to globals allow us up-to date info when evaulating
     Lepton::Parser* parser;
+    const std::map<std::string, Lepton::CustomFunction*>& customFunctions;//The Y= functions, which graphs may call
 
     UWORD xXhair, yXhair; //The crosshair showing the current position
     UWORD xLineLeft, xLineRight; //The movable lines used for input for graph functions
@@ -41,9 +69,25 @@ class Graph {
     GraphFunctions function = NONE;
     bool shadeIntegral;
     unsigned int whichFn;
+    std::vector<double> roots; //Every root found by the last zero or intersect, enter steps through them
+    unsigned int rootIndex;
 
     unsigned char graphBuffer[4][SCREEN_WIDTH];
 
+    //What each buffer was computed from, so that only the functions whose inputs changed get recomputed
+    std::string parsedDefinitions[4]; //The Y= text that functions and compiledFunctions were parsed from
+    unsigned int parsedModes[4]; //The parser's angle unit and integer mode version they were parsed under
+    Lepton::DependencySnapshot bufferInputs[4]; //The global variables and stored functions each buffer was computed from
+
+    //Fits of the expensive functions, which unlike the buffers survive changes to the view
+    bool expensive[4];
+    Lepton::PiecewiseChebyshev surrogates[4];
+    Lepton::DependencySnapshot surrogateInputs[4];
+
+    GraphPrecision precision;
+    float yTopFloat, yScaleFloat; //Limits in the form used by the reduced precision modes, set before evaluating
+    Lepton::Fixed yTopFixed, yScaleFixed;
+
 public:
     double xLeft, xRight, yBottom, yTop; //Limits of the screen
     bool dirty;
@@ -51,7 +95,7 @@ public:
 
     //We probably need layers for caching
 
-    Graph(const std::map<std::string, double>& vars, Lepton::Parser* Parser) : globalVariables(vars), parser(Parser) {
+    Graph(const std::map<std::string, double>& vars, Lepton::Parser* Parser, const std::map<std::string, Lepton::CustomFunction*>& functions) : globalVariables(vars), parser(Parser), customFunctions(functions) {
         xLeft = yBottom = -10.0;
         xRight = yTop = 10.0;
         xXhair = xLineLeft = xLineRight = SCREEN_WIDTH/2;
@@ -59,7 +103,13 @@ public:
         state = XHAIR;
         shadeIntegral = false;
         whichFn = 0;
+        rootIndex = 0;
         dirty = true;
+        precision = PRECISION_FLOAT;
+        for(int i = 0; i < 4; i++){
+            expensive[i] = false;
+            parsedModes[i] = Lepton::Parser::getModeVersion();
+        }
     }
 
 private:
@@ -80,12 +130,215 @@ private:
 
     //Returns the equivalent coordinate for a y value clamped to the screen dimensions
     UWORD yToStorage(double y){
-        long yCoord = (yTop-y)/(yTop-yBottom) * SCREEN_HEIGHT;
-        if(yCoord < 0)
-            yCoord = TOO_LOW;
+        if(!std::isfinite(y))
+            return UNDEFINED;
+        double yCoord = (yTop-y)/(yTop-yBottom) * SCREEN_HEIGHT;
+        if(yCoord <= -1.0)
+            return TOO_LOW;
         else if(yCoord >= SCREEN_HEIGHT)
-            yCoord = TOO_HIGH;
-        return yCoord;
+            return TOO_HIGH;
+        return (long) yCoord;
+    }
+
+    //Same as above in single precision
+    UWORD yToStorage(float y){
+        if(!std::isfinite(y))
+            return UNDEFINED;
+        float yCoord = (yTopFloat-y) * yScaleFloat;
+        if(yCoord <= -1.0f)
+            return TOO_LOW;
+        else if(yCoord >= SCREEN_HEIGHT)
+            return TOO_HIGH;
+        return (long) yCoord;
+    }
+
+    //Same as above in fixed point, the subtraction saturates so far away values keep the right sign
+    UWORD yToStorage(Lepton::Fixed y){
+        if(y.isNaN())
+            return UNDEFINED;
+        Lepton::Fixed yCoord = (yTopFixed-y) * yScaleFixed;
+        if(yCoord <= Lepton::Fixed(-1))
+            return TOO_LOW;
+        else if(yCoord >= Lepton::Fixed(SCREEN_HEIGHT))
+            return TOO_HIGH;
+        return yCoord < Lepton::Fixed(0) ? 0 : yCoord.floor();
+    }
+
+    //Real part of a result, or NaN if it has none we can draw
+    static double realValue(Result result){
+        if(!result.isReal())
+            return nan("");
+        return result.getReal();
+    }
+
+    //Whether the view is small enough to be drawn in fixed point
+    bool fitsFixedPoint(){
+        return std::abs(xLeft) < FIXED_POINT_LIMIT && std::abs(xRight) < FIXED_POINT_LIMIT &&
+               std::abs(yBottom) < FIXED_POINT_LIMIT && std::abs(yTop) < FIXED_POINT_LIMIT &&
+               xRight-xLeft >= FIXED_POINT_MIN_RANGE && yTop-yBottom >= FIXED_POINT_MIN_RANGE;
+    }
+
+    //Copies the globals into the compiled function, returning where its x value lives (NULL if it has no x)
+    double* bindVariables(Lepton::CompiledExpression& compiled, const std::string& xName){
+        double* x = NULL;
+        const std::set<std::string>& names = compiled.getVariables();
+        for(std::set<std::string>::const_iterator name = names.begin(); name != names.end(); ++name){
+            if(*name == xName){
+                x = &compiled.getVariableReference(*name);
+                continue;
+            }
+            std::map<std::string, double>::const_iterator value = globalVariables.find(*name);
+            if(value == globalVariables.end())
+                throw Lepton::Exception("No value specified for variable "+*name);
+            compiled.getVariableReference(*name) = value->second;
+        }
+        return x;
+    }
+
+    //Whether a node reads a variable anywhere in it
+    static bool usesVariable(const Lepton::ExpressionTreeNode& node, const std::string& name){
+        if(node.getOperation().getId() == Lepton::Operation::VARIABLE && node.getOperation().getName() == name)
+            return true;
+        for(const Lepton::ExpressionTreeNode& child : node.getChildren())
+            if(usesVariable(child, name))
+                return true;
+        return false;
+    }
+
+    //Whether a function is ode(f, x, y, x0, y0, x) with a fixed starting point, so that its graph is one solution curve
+    static bool isTrajectory(const Args& function){
+        const Lepton::ExpressionTreeNode& node = function.node;
+        if(node.getOperation().getId() != Lepton::Operation::ODE)
+            return false;
+        const std::vector<Lepton::ExpressionTreeNode>& children = node.getChildren();
+        return children[1].getOperation().getId() == Lepton::Operation::VARIABLE && children[2].getOperation().getId() == Lepton::Operation::VARIABLE &&
+               children[5].getOperation().getId() == Lepton::Operation::VARIABLE && children[5].getOperation().getName() == function.variableName &&
+               !usesVariable(children[3], function.variableName) && !usesVariable(children[4], function.variableName);
+    }
+
+    //Fills the buffer of a solution curve by integrating outwards from its starting point once, the dense output of each
+    //step gives every column it passes so the cost depends on how hard the curve is rather than on the number of columns
+    //The error allowed grows with |y| once it is off the screen, where only the direction of the curve matters
+    void evaluateTrajectory(unsigned char fn){
+        const std::vector<Lepton::ExpressionTreeNode>& children = functions[fn].node.getChildren();
+        double x0 = realValue(Lepton::ParsedExpression::publicEvaluate(children[3], globalVariables));
+        double y0 = realValue(Lepton::ParsedExpression::publicEvaluate(children[4], globalVariables));
+        double values[SCREEN_WIDTH];
+        if(std::isfinite(x0) && std::isfinite(y0)){
+            Lepton::OdeSolver solution(children[0], children[1].getOperation().getName(), children[2].getOperation().getName(), globalVariables);
+            double stepSize = (xRight-xLeft)/SCREEN_WIDTH;
+            double pixelHeight = (yTop-yBottom)/SCREEN_HEIGHT;
+            double tolerance = pixelHeight/TRAJECTORY_REFINEMENT;
+            solution.sample(x0, y0, xLeft, stepSize, SCREEN_WIDTH, tolerance, tolerance/(std::abs(yTop)+std::abs(yBottom)), values);
+        }
+        else{
+            for(UWORD i = 0; i < SCREEN_WIDTH; i++)
+                values[i] = nan("");
+        }
+        for(UWORD i = 0; i < SCREEN_WIDTH; i++)
+            graphBuffer[fn][i] = yToStorage(values[i]);
+    }
+
+    //Whether a function costs enough per point to be worth fitting: it iterates (fnInt, sigma, prod, lim, solve, ode), calls a
+    //stored function, or makes many transcendental calls
+    static bool isExpensive(const Lepton::ExpressionTreeNode& node, int& transcendentals){
+        Lepton::Operation::Id id = node.getOperation().getId();
+        if(id == Lepton::Operation::FNINT || id == Lepton::Operation::SIGMA || id == Lepton::Operation::PROD || id == Lepton::Operation::LIM || id == Lepton::Operation::SOLVE || id == Lepton::Operation::ODE || id == Lepton::Operation::CUSTOM)
+            return true;
+        if((id >= Lepton::Operation::SIN && id <= Lepton::Operation::ERFC) || id == Lepton::Operation::EXP || id == Lepton::Operation::LOG ||
+                id == Lepton::Operation::LN || id == Lepton::Operation::POWER){
+            if(++transcendentals > SURROGATE_TRANSCENDENTALS)
+                return true;
+        }
+        for(const Lepton::ExpressionTreeNode& child : node.getChildren())
+            if(isExpensive(child, transcendentals))
+                return true;
+        return false;
+    }
+
+    //Fills the buffer of an expensive function from its fit, first fitting whatever part of the view it does not cover yet
+    //The fit is always sampled in double precision, columns it could not approximate (poles, jumps) are evaluated directly
+    void evaluateSurrogate(unsigned char fn){
+        Lepton::EvaluationContext& context = Lepton::EvaluationContext::current();
+        Lepton::CompiledExpression& compiled = compiledFunctions[fn];
+        double* x = bindVariables(compiled, functions[fn].variableName);
+        if(!surrogateInputs[fn].isCurrent()){
+            surrogates[fn].clear();
+            surrogateInputs[fn].record(functions[fn].node, functions[fn].variableName, globalVariables, customFunctions);
+        }
+
+        std::function<double(double)> sample = [&](double value){
+            context.consume();
+            if(x != NULL)
+                *x = value;
+            return compiled.evaluate();
+        };
+        double stepSize = (xRight-xLeft)/SCREEN_WIDTH;
+        double pixelHeight = (yTop-yBottom)/SCREEN_HEIGHT;
+        //Pieces narrower than this would cost more to fit than to evaluate column by column
+        double minWidth = (Lepton::PiecewiseChebyshev::DEGREE+2)*stepSize;
+        surrogates[fn].fit(sample, xLeft, xLeft + (SCREEN_WIDTH-1)*stepSize, pixelHeight/2, SURROGATE_REFINEMENT, minWidth);
+
+        UWORD direct = 0;
+        for(UWORD i = 0; i < SCREEN_WIDTH; i++){
+            double xValue = xLeft + i*stepSize;
+            double y;
+            if(!surrogates[fn].evaluate(xValue, y)){
+                y = sample(xValue);
+                direct++;
+            }
+            graphBuffer[fn][i] = yToStorage(y);
+        }
+
+        //A function that is mostly jumps or poles at this scale only wastes time being fitted, so draw it directly from now on
+        if(direct > SCREEN_WIDTH/2){
+            expensive[fn] = false;
+            surrogates[fn].clear();
+        }
+    }
+
+    //Fills the buffer of the specified function with the y coordinate at each x on the screen
+    void evaluateFn(unsigned char fn){
+        if(isTrajectory(functions[fn])){
+            evaluateTrajectory(fn);
+            return;
+        }
+        if(expensive[fn]){
+            evaluateSurrogate(fn);
+            return;
+        }
+        Lepton::EvaluationContext& context = Lepton::EvaluationContext::current();
+        double stepSize = (xRight-xLeft)/SCREEN_WIDTH;
+        GraphPrecision mode = precision;
+        if(mode == PRECISION_FIXED && !fitsFixedPoint())
+            mode = PRECISION_FLOAT;
+
+        if(mode == PRECISION_DOUBLE){
+            std::map<std::string, double> tempVariables;
+            tempVariables.insert(globalVariables.begin(), globalVariables.end());
+            for(UWORD i = 0; i < SCREEN_WIDTH; i++){
+                context.consume();
+                tempVariables[functions[fn].variableName] = xLeft + i*stepSize;
+                graphBuffer[fn][i] = yToStorage(realValue(Lepton::ParsedExpression::publicEvaluate(functions[fn].node, tempVariables)));
+            }
+            return;
+        }
+
+        Lepton::CompiledExpression& compiled = compiledFunctions[fn];
+        double* x = bindVariables(compiled, functions[fn].variableName);
+        yTopFloat = yTop;
+        yScaleFloat = SCREEN_HEIGHT/(yTop-yBottom);
+        yTopFixed = Lepton::Fixed(yTop);
+        yScaleFixed = Lepton::Fixed(SCREEN_HEIGHT/(yTop-yBottom));
+        for(UWORD i = 0; i < SCREEN_WIDTH; i++){
+            context.consume();
+            if(x != NULL)
+                *x = xLeft + i*stepSize;
+            if(mode == PRECISION_FLOAT)
+                graphBuffer[fn][i] = yToStorage(compiled.evaluateFloat());
+            else
+                graphBuffer[fn][i] = yToStorage(compiled.evaluateFixed());
+        }
     }
 
     //Convert from the buffer value to the equivalent location
@@ -135,16 +388,17 @@ private:
         Args* args = &functions[fnToDraw];
         if(args->variableName.empty())//Signifies invalid/unset function
             return;
-        
-        std::map<std::string, double> tempVariables;
-        tempVariables.insert(globalVariables.begin(), globalVariables.end());
-        tempVariables[args->variableName] = xLeft;
+
+        if(!bufferInputs[fnToDraw].isCurrent()){
+            bufferInputs[fnToDraw].clear();
+            evaluateFn(fnToDraw);
+            bufferInputs[fnToDraw].record(args->node, args->variableName, globalVariables, customFunctions);
+        }
 
         unsigned char workingY;
         UWORD eqvYCoord;
-        double yDiff = yTop-yBottom;
-        double stepSize = (xRight-xLeft)/SCREEN_WIDTH;
         UWORD leftYCoord; //Keep track of the height of the pixel to our left so we can join them, this is clamped
+        bool leftDefined = false; //Whether there is a pixel to our left at all
 
         UWORD xAxis;
         bool weShade = false;
@@ -155,31 +409,30 @@ private:
         }
 
         for(UWORD i = 0; i < SCREEN_WIDTH; i++){
-            if(dirty){
-                workingY = yToStorage((Lepton::ParsedExpression::publicEvaluate(args->node, tempVariables)).getReal());
-                graphBuffer[fnToDraw][i] = workingY;
+            workingY = graphBuffer[fnToDraw][i];
+            if(workingY == UNDEFINED){//Nothing here to draw or to connect the next pixel to
+                leftDefined = false;
+                continue;
             }
-            else
-                workingY = graphBuffer[fnToDraw][i];
 
             eqvYCoord = storageToY(workingY);
 
             if(weShade && i >= xLineLeft && i <= xLineRight){//Integral
-                if(i != 0)
+                if(leftDefined)
                     connectPoints(i, leftYCoord, eqvYCoord, xAxis);
                 else
                     connectPoints(i, eqvYCoord, xAxis);
             }
             else{//Regular point
                 if(workingY != TOO_HIGH && workingY != TOO_LOW){
-                    if(i != 0)
+                    if(leftDefined)
                         connectPoints(i, leftYCoord, workingY);
                     else
                         Paint_SetPixel(i, workingY, BLACK);
                 }
             }
             leftYCoord = eqvYCoord;
-            tempVariables[args->variableName] += stepSize;
+            leftDefined = true;
         }
     }
 
@@ -255,12 +508,16 @@ private:
     //Redraws everything on the screen
     //Draw the marker at the specified location if update is true
     void drawGraphs(double x, double y, bool update, bool showString, char* str){
+        if(dirty){//The view or precision changed, which affects every buffer
+            for(int i = 0; i < 4; i++)
+                bufferInputs[i].clear();
+            dirty = false;
+        }
         drawAxis();
         drawnFn(0);
         drawnFn(1);
         drawnFn(2);
         drawnFn(3);
-        dirty = false;
         if (!showString)
             drawXhair(x, y, update);
         drawLines();
@@ -275,7 +532,43 @@ private:
         return yTop - y*(yTop-yBottom)/SCREEN_HEIGHT;
     }
 
+    //Estimates of a function at the columns from its buffer, only their order is right
+    //Rows count down from the top of the screen, and TOO_LOW is above it
+    std::vector<double> bufferSamples(unsigned int fn, UWORD firstColumn, UWORD lastColumn){
+        std::vector<double> samples;
+        for(UWORD i = firstColumn; i <= lastColumn; i++){
+            unsigned char y = graphBuffer[fn][i];
+            if(y == UNDEFINED)
+                samples.push_back(nan(""));
+            else if(y == TOO_LOW)
+                samples.push_back(INFINITY);
+            else if(y == TOO_HIGH)
+                samples.push_back(-INFINITY);
+            else
+                samples.push_back(-(double) y);
+        }
+        if(samples.size() < 2)
+            samples.push_back(samples.back());
+        return samples;
+    }
+
+    //Value of the function the current graph function works on
+    double fnArgValue(double x){
+        std::map<std::string, double> tempVariables;
+        tempVariables.insert(globalVariables.begin(), globalVariables.end());
+        tempVariables[fnArg.variableName] = x;
+        return (Lepton::ParsedExpression::publicEvaluate(fnArg.node, tempVariables)).getReal();
+    }
+
 public:
+    //Changes the precision used for the graphs, they are recomputed on the next draw
+    void setPrecision(GraphPrecision newPrecision){
+        if(newPrecision != precision){
+            precision = newPrecision;
+            dirty = true;
+        }
+    }
+
     //Redraws with new view
     void update(){
         drawGraphs(0.0, 0.0, false, false, NULL);
@@ -293,15 +586,28 @@ public:
         drawGraphs(0.0, 0.0, false, false, NULL);
     }
 
-    //Converts the strings to internal arg classes
+    //Converts the strings to internal arg classes, only the ones that changed, or were parsed under another angle unit
+    //or integer mode, are parsed again and lose their buffer
     void drawGraphs(std::string strings[]){
-        dirty = true;
-
         for(int i = 0; i < 4; i++){
-            if(!strings[i].empty()){
-                functions[i].node = parser->parse(strings[i]).getRootNode();
+            if(strings[i] == parsedDefinitions[i] && parsedModes[i] == Lepton::Parser::getModeVersion())
+                continue;
+            bufferInputs[i].clear();
+            surrogates[i].clear();
+            surrogateInputs[i].clear();
+            if(strings[i].empty()){
+                functions[i].variableName.clear();
+            }
+            else{
+                Lepton::ParsedExpression expression = parser->parse(strings[i], customFunctions);
+                functions[i].node = expression.getRootNode();
                 functions[i].variableName = "x";
+                compiledFunctions[i] = expression.createCompiledExpression();
+                int transcendentals = 0;
+                expensive[i] = isExpensive(functions[i].node, transcendentals);
             }
+            parsedDefinitions[i] = strings[i];
+            parsedModes[i] = Lepton::Parser::getModeVersion();
         }
         drawGraphs((xRight-xLeft)/2+xLeft, (yTop-yBottom)/2+yBottom, true, false, NULL);
     }
@@ -311,6 +617,7 @@ public:
         function = fn;
         state = LEFT_LINE;
         whichFn = fn1;
+        roots.clear();
 
         if(fn == INTERSECT){
             fnArg.node = Lepton::ExpressionTreeNode(new Lepton::Operation::Subtract(), functions[fn1].node, functions[fn2].node);
@@ -325,14 +632,20 @@ public:
 
     //Handles the enter click and redraws if needed
     void handleEnter(){
-        if(state == XHAIR)
+        if(state == XHAIR){
+            if(roots.size() > 1){//Move on to the next root
+                rootIndex = (rootIndex+1) % roots.size();
+                drawGraphs(roots[rootIndex], fnArgValue(roots[rootIndex]), true, false, NULL);
+            }
             return;
+        }
         
         double x = 0.0;
         double y = 0.0;
         bool shouldUpdate = false;
         bool showString = false;
         char buf[30];
+        double integralError = 0.0;
 
         if(state == LEFT_LINE)
             state = RIGHT_LINE;
@@ -340,37 +653,36 @@ public:
             state = XHAIR;
             
             //Need to get the arguments in order
-            double argLeft = xToDouble(xLineLeft);
-            double argRight = xToDouble(xLineRight);
-            if(argRight < argLeft){
-                double temp = argLeft;
-                argLeft = argRight;
-                argRight = temp;
-            }
+            UWORD firstColumn = xLineLeft < xLineRight ? xLineLeft : xLineRight;
+            UWORD lastColumn = xLineLeft < xLineRight ? xLineRight : xLineLeft;
+            double argLeft = xToDouble(firstColumn);
+            double argRight = xToDouble(lastColumn);
+            int pixels = lastColumn > firstColumn ? lastColumn-firstColumn : 1;
             
             try{
-                if(function == MAX)
-                    x = Lepton::getExtrema(fnArg, globalVariables, argLeft, argRight, true);
-                else if(function == MIN)
-                    x = Lepton::getExtrema(fnArg, globalVariables, argLeft, argRight, false);
+                if(fnArg.variableName.empty())//The chosen function is not set
+                    throw Lepton::Exception("Function is not defined");
+                if(function == MAX || function == MIN){
+                    Lepton::UnivariateFunction curve(fnArg.node, fnArg.variableName, globalVariables);
+                    double value;
+                    if(bufferInputs[whichFn].isCurrent())//Pick the candidates from what is already drawn
+                        x = curve.findExtremum(bufferSamples(whichFn, firstColumn, lastColumn), argLeft, argRight, function == MAX, value);
+                    else
+                        x = curve.findExtremum(argLeft, argRight, pixels, function == MAX, value);
+                }
                 else if(function == ZERO || function == INTERSECT){ //The nodes were joined via subtraction previously
-                    x = Lepton::getZero(fnArg, globalVariables, argLeft, argRight);
+                    Lepton::UnivariateFunction difference(fnArg.node, fnArg.variableName, globalVariables);
+                    roots = difference.findRoots(argLeft, argRight, pixels);//Sample once per pixel
+                    rootIndex = 0;
+                    x = roots.empty() ? nan("") : roots[0];
                     fnArg = functions[whichFn];//Next evaluation will be at the first function, not the difference function
                 }
                 else if(function == INTEGRAL){
-                    Lepton::Operation::FnInt tempInt;
-                    if (fnArg.inputs.size() == 0){
-                        fnArg.inputs.push_back(argLeft);
-                        fnArg.inputs.push_back(argRight);
-                    }
-                    else{
-                        fnArg.inputs[0] = argLeft;
-                        fnArg.inputs[1] = argRight;
-                    }  
-                    x = tempInt.evaluate(fnArg, globalVariables).getReal();
+                    Lepton::UnivariateFunction curve(fnArg.node, fnArg.variableName, globalVariables);
+                    x = curve.integrate(argLeft, argRight, integralError);
                 }
             } catch(...){//TODO: figure out what went wrong
-                x = nan(NULL);
+                x = nan("");
             }
             
             if(std::isnan(x)){
@@ -379,14 +691,14 @@ public:
             }
             else if(function == INTEGRAL){//Draw answer
                 showString = true;
-                snprintf(buf, sizeof(buf), "= %.5g", x);
+                if(integralError > 0.0)
+                    snprintf(buf, sizeof(buf), "= %.5g +/-%.0e", x, integralError);
+                else
+                    snprintf(buf, sizeof(buf), "= %.5g", x);
                 shadeIntegral = true;
             }
             else{//find y
-                std::map<std::string, double> tempVariables;
-                tempVariables.insert(globalVariables.begin(), globalVariables.end());
-                tempVariables[fnArg.variableName] = x;
-                y = (Lepton::ParsedExpression::publicEvaluate(fnArg.node, tempVariables)).getReal();
+                y = fnArgValue(x);
                 shouldUpdate = true;
             }
         }
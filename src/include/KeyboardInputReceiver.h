@@ -10,14 +10,20 @@
 #include <vector>
 #include <Screen.h>
 
+namespace Lepton {
+class CustomFunction;
+}
+
 class KeyboardInputReceiver {
 public:
     KeyboardInputReceiver(Screen *screen);
     std::string getExpression(std::map<std::string, double> &variables);
     int getMenuKey();
     int getButtonKeyIndex(int64_t &startTime);
+    bool isKeyDown(int keyIndex);
     std::string getkeyIndexValue(int keyIndex);
     void buildExpression(std::string expressionComponent);
+    void setCustomFunctions(const std::map<std::string, Lepton::CustomFunction*>* functions);
 
 private:
     static const int M = 10;
@@ -36,6 +42,7 @@ private:
     std::string expression;
 
     Screen *screen__;
+    const std::map<std::string, Lepton::CustomFunction*>* customFunctions;
 
     void pinSetup();
     void initializeKeyMappings();
@@ -34,10 +34,25 @@
 
 #include "lepton/CompiledExpression.h"
 #include "lepton/CustomFunction.h"
+#include "lepton/EvaluationContext.h"
 #include "lepton/ExpressionTreeNode.h"
+#include "lepton/Factorization.h"
+#include "lepton/FastMath.h"
+#include "lepton/Fixed.h"
+#include "lepton/MatrixPower.h"
+#include "lepton/NonlinearSystem.h"
+#include "lepton/OdeSolver.h"
 #include "lepton/Operation.h"
+#include "lepton/ParallelReduction.h"
 #include "lepton/ParsedExpression.h"
 #include "lepton/Parser.h"
+#include "lepton/PiecewiseChebyshev.h"
+#include "lepton/PolynomialRoots.h"
+#include "lepton/SmallMatrix.h"
+#include "lepton/StoredFunction.h"
+#include "lepton/StoredSequence.h"
+#include "lepton/Summation.h"
+#include "lepton/UnivariateFunction.h"
 
 #endif /*LEPTON_H_*/
 
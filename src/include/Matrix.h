@@ -1,12 +1,129 @@
+#pragma once
+
 #include <Eigen/Dense>
 #include <unsupported/Eigen/MatrixFunctions>
+#include <cstdint>
 #include <map>
+#include <memory>
 #include <string>
 #include "lepton/Exception.h"
 
-extern std::map<std::string, Eigen::MatrixXd> matrixMap;
+/**
+ * Whether a stored matrix may be held in compressed sparse form, chosen at compile time.  The calculator
+ * has neither the memory for the large, mostly zero systems this is for nor files to load them from, so
+ * only host builds turn it on (e.g. -DLEPTON_SPARSE=1).
+ */
+#ifndef LEPTON_SPARSE
+#define LEPTON_SPARSE 0
+#endif
+#if LEPTON_SPARSE
+#include <Eigen/SparseCore>
+#include <mutex>
+#endif
+
+/**
+ * A reference counted handle to a matrix value.  Copying a handle only shares the matrix, so a named
+ * matrix can pass from the map through Result and InputArgType into an operation without being copied.
+ * The matrix is only copied when it is written through a handle that shares it with another.
+ *
+ * Matrices stored under a name also carry a version, which is different for every stored value, so that
+ * work derived from one (such as a Factorization) can be kept and found again.  Other values have version 0.
+ *
+ * With LEPTON_SPARSE a handle may instead hold a sparse matrix, which solveSOLE and det factor without ever
+ * forming the dense one.  Operations that only work on dense matrices still see it through get(), which
+ * converts it the first time it is called and keeps the result with the sparse matrix.
+ */
+
+class SharedMatrix {
+public:
+    SharedMatrix() : version(0) {
+    }
+    SharedMatrix(Eigen::MatrixXd matrix, uint32_t version = 0) : value(std::make_shared<Eigen::MatrixXd>(std::move(matrix))), version(version) {
+    }
+#if LEPTON_SPARSE
+    SharedMatrix(Eigen::SparseMatrix<double> matrix, uint32_t version = 0) : sparse(std::make_shared<SparseValue>(std::move(matrix))), version(version) {
+    }
+    /**
+     * Get whether the handle holds a sparse matrix.
+     */
+    bool isSparse() const {
+        return (bool) sparse;
+    }
+    /**
+     * Get the sparse matrix, which must have been set.
+     */
+    const Eigen::SparseMatrix<double>& getSparse() const {
+        return sparse->matrix;
+    }
+#endif
+    /**
+     * Get the matrix, which is empty if none was set.
+     */
+    const Eigen::MatrixXd& get() const {
+        static const Eigen::MatrixXd empty;
+#if LEPTON_SPARSE
+        if (sparse)
+            return sparse->getDense();
+#endif
+        return (value ? *value : empty);
+    }
+    /**
+     * Get the number of rows, without converting a sparse matrix.
+     */
+    Eigen::Index rows() const {
+#if LEPTON_SPARSE
+        if (sparse)
+            return sparse->matrix.rows();
+#endif
+        return get().rows();
+    }
+    /**
+     * Get the number of columns, without converting a sparse matrix.
+     */
+    Eigen::Index cols() const {
+#if LEPTON_SPARSE
+        if (sparse)
+            return sparse->matrix.cols();
+#endif
+        return get().cols();
+    }
+    /**
+     * Get the version of a stored matrix, or 0 if it was not stored under a name.
+     */
+    uint32_t getVersion() const {
+        return version;
+    }
+    /**
+     * Get the matrix for writing, first copying it if another handle shares it.  A stored matrix gets a new
+     * version, since it no longer holds the value that was stored.
+     */
+    Eigen::MatrixXd& edit();
+private:
+#if LEPTON_SPARSE
+    struct SparseValue {
+        SparseValue(Eigen::SparseMatrix<double> matrix) : matrix(std::move(matrix)) {
+        }
+        const Eigen::MatrixXd& getDense();
+        Eigen::SparseMatrix<double> matrix;
+        std::once_flag densified;
+        Eigen::MatrixXd dense;
+    };
+    std::shared_ptr<SparseValue> sparse;
+#endif
+    std::shared_ptr<Eigen::MatrixXd> value;
+    uint32_t version;
+};
 
-void storeMatrixValue(std::string matrixName, Eigen::MatrixXd matrixValue);
-void deleteMatrixValue(std::string matrixName);
-Eigen::MatrixXd getMatrixValue(std::string matrixName);
+extern std::map<std::string, SharedMatrix> matrixMap;
 
+void storeMatrixValue(const std::string& matrixName, Eigen::MatrixXd matrixValue);
+#if LEPTON_SPARSE
+void storeMatrixValue(const std::string& matrixName, Eigen::SparseMatrix<double> matrixValue);
+/**
+ * Store the matrix in a Matrix Market file, in coordinate or array format with real, integer or pattern
+ * entries, under a name.  A coordinate file is kept as a sparse matrix.
+ */
+void loadMatrixValue(const std::string& matrixName, const std::string& fileName);
+#endif
+void deleteMatrixValue(const std::string& matrixName);
+const SharedMatrix& getMatrixValue(const std::string& matrixName);
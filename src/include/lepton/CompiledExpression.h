@@ -33,6 +33,7 @@
  * -------------------------------------------------------------------------- */
 
 #include "ExpressionTreeNode.h"
+#include "Fixed.h"
 #include "windowsIncludes.h"
 #include <map>
 #include <set>
@@ -50,6 +51,15 @@ class ParsedExpression;
  * is visible.
  * 
  * A CompiledExpression is created by calling createCompiledExpression() on a ParsedExpression.
+ *
+ * Every intermediate value is a real scalar.  A step whose result is complex or a matrix produces NaN.
+ * Subexpressions that cannot be broken into scalar steps (fnInt, sigma, prod and anything involving a
+ * matrix) are evaluated as a whole with ParsedExpression, so they are supported but not accelerated.
+ *
+ * Besides double precision, the expression can be evaluated in single precision or Q16.16 fixed point.
+ * These are meant for drawing, where the result only has to land on the right pixel, and are much
+ * cheaper on processors without an FPU.  Operations without a reduced precision implementation fall back
+ * to double for that step.
  * 
  * WARNING: CompiledExpression is NOT thread safe.  You should never access a CompiledExpression from two threads at
  * the same time.
@@ -74,19 +84,53 @@ public:
      * Evaluate the expression.  The values of all variables should have been set before calling this.
      */
     double evaluate() const;
+    /**
+     * Evaluate the expression in single precision.  Arithmetic is done in float, adding a relative error
+     * of at most 2^-24 (6e-8) per operation.  sqrt, exp, ln, pow, sin, cos, tan and atan use the FastMath
+     * approximations, whose error is set at compile time by LEPTON_FAST_MATH_ACCURACY (1e-5 by default).
+     * Cancellation (e.g. subtracting two nearly equal values) can magnify these errors, so the result
+     * should only be trusted to that fraction of the largest intermediate value.
+     */
+    float evaluateFloat() const;
+    /**
+     * Evaluate the expression in Q16.16 fixed point.  Arithmetic and sqrt are exact to within 2^-16
+     * (1.5e-5) per operation; other functions are computed as in evaluateFloat() and rounded.  Every intermediate
+     * value must lie within [-32768, 32768): values outside saturate, which keeps their sign but not
+     * their magnitude.
+     */
+    Fixed evaluateFixed() const;
 private:
+    /**
+     * Data used by the scalar evaluators for steps that take a constant, stored in each precision
+     * so no conversion is needed at evaluation time.
+     */
+    struct StepValue {
+        double asDouble;
+        float asFloat;
+        Fixed asFixed;
+    };
     friend class ParsedExpression;
     CompiledExpression(const ParsedExpression& expression);
     void compileExpression(const ExpressionTreeNode& node, std::vector<std::pair<ExpressionTreeNode, int> >& temps);
     int findTempIndex(const ExpressionTreeNode& node, std::vector<std::pair<ExpressionTreeNode, int> >& temps);
+    void addVariable(const std::string& name, std::vector<std::pair<ExpressionTreeNode, int> >& temps);
+    double evaluateStep(int step) const;
+    template <class T>
+    T evaluateScalar(std::vector<T>& values) const;
+    template <class T>
+    static T getStepValue(const StepValue& value);
     std::vector<std::vector<int> > arguments;
     std::vector<int> target;
     std::vector<Operation*> operation;
+    std::vector<StepValue> stepValue;
+    std::vector<ExpressionTreeNode> treeNodes;
+    std::vector<int> treeNodeIndex;
     std::map<std::string, int> variableIndices;
     std::set<std::string> variableNames;
     mutable std::vector<double> workspace;
-    mutable std::vector<double> argValues;
-    std::map<std::string, double> dummyVariables;
+    mutable std::vector<float> workspaceFloat;
+    mutable std::vector<Fixed> workspaceFixed;
+    mutable std::map<std::string, double> treeVariables;
 };
 
 } // namespace Lepton
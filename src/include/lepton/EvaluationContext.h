@@ -0,0 +1,179 @@
+#ifndef LEPTON_EVALUATION_CONTEXT_H_
+#define LEPTON_EVALUATION_CONTEXT_H_
+
+#include "windowsIncludes.h"
+#include "Exception.h"
+#include <cstdint>
+
+/**
+ * How many threads a ParallelReduction may spread its chunks over, chosen at compile time.  Above 1, every
+ * thread has its own EvaluationContext.  The calculator evaluates on a single core, so only host builds
+ * raise this (e.g. -DLEPTON_THREADS=8).
+ */
+#ifndef LEPTON_THREADS
+#define LEPTON_THREADS 1
+#endif
+#if LEPTON_THREADS > 1
+#include <atomic>
+#endif
+
+namespace Lepton {
+
+/**
+ * This exception is thrown when an evaluation is stopped before it finishes, either because it used up
+ * its budget or because the user asked for it to be cancelled.
+ */
+
+class EvaluationBreak : public Exception {
+public:
+    EvaluationBreak() : Exception("Break") {
+    }
+};
+
+/**
+ * An EvaluationContext holds the state shared by every Operation taking part in an evaluation.
+ *
+ * It carries the evaluation budget: a maximum number of operations and a deadline.  Operations that
+ * iterate (sigma, prod, fnInt, the graph solvers) charge their work with consume() once per iteration.
+ * The clock and the break check are only consulted every CHECK_INTERVAL units of work, so single nodes
+ * pay nothing and loops pay one increment and compare per iteration.
+ *
+ * It also owns the random number generator used by RNG, which is xoshiro128**: 16 bytes of state, and a
+ * few shifts, xors and adds per number, all on 32 bit words.  Unless it is seeded with seedRandom(), it
+ * seeds itself from the clock the first time it is used.
+ */
+
+class LEPTON_EXPORT EvaluationContext {
+public:
+    /**
+     * How many units of work may be consumed between two looks at the clock and the break check.
+     */
+    static const uint32_t CHECK_INTERVAL = 16;
+    /**
+     * Get the context used by evaluations on this thread.
+     */
+    static EvaluationContext& current();
+    /**
+     * Set the function used to read the time in microseconds.  Without one the deadline is ignored.
+     */
+    static void setClock(uint64_t (*clock)());
+    /**
+     * Set the function polled to find out if the user wants the evaluation cancelled (e.g. the ON key).
+     */
+    static void setBreakCheck(bool (*breakRequested)());
+    /**
+     * Start limiting evaluations to maxOperations units of work and timeLimitUs microseconds.  A value of
+     * zero disables that limit.  Nested calls keep the outermost budget.
+     */
+    void beginBudget(uint32_t maxOperations, uint64_t timeLimitUs);
+#if LEPTON_THREADS > 1
+    /**
+     * Start a budget for work split off from another context, such as a chunk of a ParallelReduction run on
+     * another thread.  It shares the other's deadline, and its operations are added to shared, which holds
+     * the total used so far by the other and every piece split off from it, whenever the budget is checked.
+     */
+    void beginBudget(const EvaluationContext& parent, std::atomic<uint32_t>& shared);
+#endif
+    /**
+     * Stop limiting evaluations.
+     */
+    void endBudget();
+    /**
+     * Drop the budget and throw EvaluationBreak, as happens when it runs out.
+     */
+    void stop();
+    /**
+     * Charge count units of work against the budget, throwing EvaluationBreak if it has run out.
+     */
+    void consume(uint32_t count = 1) {
+        if (budgetDepth == 0)
+            return;
+        operationsUsed += count;
+        if (operationsUsed >= nextCheck)
+            checkBudget();
+    }
+    /**
+     * Get how many units of work have been consumed since the budget was started.
+     */
+    uint32_t getOperationsUsed() const {
+        return operationsUsed;
+    }
+    /**
+     * Record the estimated error of a numerical integral, so it can be shown alongside the result.
+     */
+    void reportIntegrationError(double error) {
+        if (!(error <= integrationError))
+            integrationError = error;
+    }
+    /**
+     * Get the largest integration error reported since the budget was started, or 0 if there was none.
+     */
+    double getIntegrationError() const {
+        return integrationError;
+    }
+    /**
+     * Restart the random number generator from a seed, so that the same numbers follow.
+     */
+    void seedRandom(uint64_t seed);
+    /**
+     * Get 32 random bits.
+     */
+    uint32_t nextRandom() {
+        if (!randomSeeded)
+            seedFromClock();
+        uint32_t result = rotate(randomState[1]*5, 7)*9;
+        uint32_t shifted = randomState[1] << 9;
+        randomState[2] ^= randomState[0];
+        randomState[3] ^= randomState[1];
+        randomState[1] ^= randomState[2];
+        randomState[0] ^= randomState[3];
+        randomState[2] ^= shifted;
+        randomState[3] = rotate(randomState[3], 11);
+        return result;
+    }
+    /**
+     * Get an integer in [low, high], each equally likely.
+     */
+    int64_t randomInteger(int64_t low, int64_t high);
+private:
+    EvaluationContext();
+    void checkBudget();
+    static uint32_t rotate(uint32_t x, int bits) {
+        return (x << bits) | (x >> (32-bits));
+    }
+    void seedFromClock();
+    uint64_t randomBelow(uint64_t bound, uint32_t threshold);
+    int budgetDepth;
+    uint32_t operationsUsed;
+    uint32_t maxOperations;
+    uint32_t nextCheck;
+    uint64_t deadline;
+    double integrationError;
+    uint32_t randomState[4];
+    bool randomSeeded;
+#if LEPTON_THREADS > 1
+    std::atomic<uint32_t>* sharedOperations;
+    uint32_t sharedReported;
+#endif
+};
+
+/**
+ * Starts a budget on the current EvaluationContext for as long as this object is in scope.
+ */
+
+class EvaluationBudget {
+public:
+    EvaluationBudget(uint32_t maxOperations, uint64_t timeLimitUs) {
+        EvaluationContext::current().beginBudget(maxOperations, timeLimitUs);
+    }
+    ~EvaluationBudget() {
+        EvaluationContext::current().endBudget();
+    }
+private:
+    EvaluationBudget(const EvaluationBudget&);
+    EvaluationBudget& operator=(const EvaluationBudget&);
+};
+
+} // namespace Lepton
+
+#endif /*LEPTON_EVALUATION_CONTEXT_H_*/
@@ -0,0 +1,150 @@
+#ifndef LEPTON_FACTORIZATION_H_
+#define LEPTON_FACTORIZATION_H_
+
+#include "windowsIncludes.h"
+#include "EvaluationContext.h"
+#include "Matrix.h"
+#include <complex>
+#include <memory>
+#include <vector>
+#if LEPTON_THREADS > 1
+#include <mutex>
+#endif
+#if LEPTON_SPARSE
+#include <Eigen/IterativeLinearSolvers>
+#include <Eigen/SparseCholesky>
+#include <Eigen/SparseLU>
+#include <Eigen/SparseQR>
+#include <iostream> // unsupported/Eigen/IterativeSolvers uses std::cerr without including it
+#include <unsupported/Eigen/IterativeSolvers>
+#include <mutex>
+#endif
+
+namespace Lepton {
+
+/**
+ * A factorization of a matrix, from which systems with it are solved by substitution and its determinant
+ * is read off.
+ *
+ * The cheapest method the structure of the matrix allows is used.  Diagonal and triangular matrices
+ * with no zero on the diagonal need no factoring at all, only division or substitution.  Other square
+ * matrices of up to SmallMatrix::MAX_SIZE rows keep their closed form inverse.  Larger symmetric matrices
+ * use LLT when they are positive definite and LDLT when they are negative definite, and other square
+ * matrices partial pivot LU.  When the matrix is singular, too badly conditioned for these, or not square,
+ * solutions come from column pivoting Householder QR, which copes with rank deficiency and gives the least
+ * squares solution.
+ *
+ * Sparse matrices (with LEPTON_SPARSE) are factored in sparse form: simplicial Cholesky when they are
+ * symmetric positive definite, otherwise supernodal LU, and sparse QR when they are singular or not square.
+ * The factors of some, such as those from three dimensional grids, fill in far beyond the matrix, so a
+ * square matrix whose factor would have more than MAX_SPARSE_FILL times its nonzeros is solved iteratively
+ * instead, by preconditioned conjugate gradients when symmetric and BiCGSTAB otherwise, with restarted GMRES
+ * for systems on which those stall.
+ *
+ * Factorizations of stored matrices are kept in a small cache keyed by the matrix and its version, so that
+ * solving with the same matrix again, or taking its determinant at every column of a graph, costs only the
+ * O(n^2) substitutions.  storeMatrixValue() and deleteMatrixValue() drop the ones they replace.  The
+ * eigendecomposition, which is only needed for some operations, is computed the first time it is asked
+ * for and then kept with the rest.
+ */
+
+class LEPTON_EXPORT Factorization {
+public:
+    /**
+     * The number of factorizations kept.  The least recently used one is dropped to make room for another.
+     */
+    static const int CACHE_SIZE = 4;
+    /**
+     * The largest condition number for which the inverse, LLT, LDLT or LU is trusted to solve a system.
+     */
+    static constexpr double MAX_CONDITION = 1e8;
+    /**
+     * The most nonzeros the factor of a sparse matrix may have, as a multiple of the nonzeros in the matrix,
+     * for it to be factored directly rather than solved iteratively.
+     */
+    static const int MAX_SPARSE_FILL = 20;
+    /**
+     * The relative residual at which the iterative solvers stop.
+     */
+    static constexpr double ITERATIVE_TOLERANCE = 1e-12;
+    /**
+     * The eigendecomposition a = vectors*diag(values)*inverseVectors of a square matrix.
+     */
+    struct Eigendecomposition {
+        Eigen::VectorXcd values;
+        Eigen::MatrixXcd vectors;
+        Eigen::MatrixXcd inverseVectors;
+    };
+
+    /**
+     * Factor a matrix.
+     */
+    Factorization(const SharedMatrix& matrix);
+    /**
+     * Get the factorization of a matrix, from the cache if it is a stored matrix that was factored before.
+     */
+    static std::shared_ptr<const Factorization> find(const SharedMatrix& matrix);
+    /**
+     * Drop the cached factorization of a matrix, if there is one.
+     */
+    static void forget(const SharedMatrix& matrix);
+    /**
+     * Get the determinant of the matrix, which must be square and not one that is solved iteratively.
+     */
+    double determinant() const;
+    /**
+     * Solve a*x = b, where b has as many rows as the matrix.
+     */
+    Eigen::MatrixXd solve(const Eigen::MatrixXd& b) const;
+    /**
+     * Get the inverse of the matrix, throwing an Exception if it is not square or is singular.
+     */
+    Eigen::MatrixXd inverse() const;
+    /**
+     * Get the eigenvalues of the matrix, which must be square, sorted by real and then imaginary part.
+     */
+    std::vector<std::complex<double> > eigenvalues() const;
+    /**
+     * Get the eigendecomposition of the matrix.
+     *
+     * @return NULL if the matrix is not square or is not diagonalizable, which is taken to mean that the
+     *         condition number of its eigenvectors is above MAX_CONDITION
+     */
+    const Eigendecomposition* getEigendecomposition() const;
+private:
+    enum Method {DIAGONAL, UPPER, LOWER, INVERSE, LLT, LDLT, LU, QR, SPARSE_LLT, SPARSE_LU, SPARSE_QR, CG, BICGSTAB};
+    bool matches(const SharedMatrix& other) const;
+#if LEPTON_SPARSE
+    struct Sparse {
+        Eigen::SimplicialLLT<Eigen::SparseMatrix<double> > llt;
+        Eigen::SparseLU<Eigen::SparseMatrix<double> > lu;
+        Eigen::SparseQR<Eigen::SparseMatrix<double>, Eigen::COLAMDOrdering<int> > qr;
+        Eigen::ConjugateGradient<Eigen::SparseMatrix<double>, Eigen::Lower|Eigen::Upper, Eigen::IncompleteCholesky<double> > cg;
+        Eigen::BiCGSTAB<Eigen::SparseMatrix<double>, Eigen::IncompleteLUT<double> > bicgstab;
+        Eigen::GMRES<Eigen::SparseMatrix<double>, Eigen::DiagonalPreconditioner<double> > gmres;
+        bool gmresReady;
+        std::mutex lock;
+    };
+    void factorSparse();
+    Eigen::MatrixXd solveIteratively(const Eigen::MatrixXd& b) const;
+    std::unique_ptr<Sparse> sparse;
+#endif
+    SharedMatrix matrix;
+    Method method;
+    bool symmetric;
+    double det;
+    Eigen::MatrixXd smallInverse;
+    Eigen::LLT<Eigen::MatrixXd> llt;
+    Eigen::LDLT<Eigen::MatrixXd> ldlt;
+    Eigen::PartialPivLU<Eigen::MatrixXd> lu;
+    Eigen::ColPivHouseholderQR<Eigen::MatrixXd> qr;
+    mutable bool diagonalized;
+    mutable std::unique_ptr<Eigendecomposition> eigendecomposition;
+#if LEPTON_THREADS > 1
+    mutable std::mutex eigendecompositionLock;
+#endif
+};
+
+} // namespace Lepton
+
+#endif /*LEPTON_FACTORIZATION_H_*/
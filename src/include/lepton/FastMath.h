@@ -0,0 +1,300 @@
+#ifndef LEPTON_FAST_MATH_H_
+#define LEPTON_FAST_MATH_H_
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+/**
+ * How accurate the FastMath approximations are, chosen at compile time.  Higher levels use longer
+ * polynomials (one or two more terms per level), so they cost a few more multiplies.
+ *
+ *   1 - about 1e-3, enough to put a point on the right pixel
+ *   2 - about 1e-5
+ *   3 - about 1e-7, close to the resolution of float itself
+ */
+#ifndef LEPTON_FAST_MATH_ACCURACY
+#define LEPTON_FAST_MATH_ACCURACY 2
+#endif
+
+namespace Lepton {
+
+/**
+ * Single precision approximations of the elementary functions, for places where speed matters more than
+ * the last digits, such as drawing graphs.  Each function reduces its argument to a small interval and
+ * evaluates a short polynomial there with float multiplies and adds.  This is far cheaper than the double
+ * precision library on processors without an FPU.
+ *
+ * Maximum errors against double precision over every float argument, including the rounding of the result
+ * to float, as checked by src/HostChecks/FastMathCheck.cpp.  sin, cos and atan errors are absolute, with
+ * sin and cos up to 32768.  exp, sqrt and tan errors are relative, and tan is measured on (-1.5, 1.5).  ln
+ * errors are absolute where |ln(x)| is below 1 and relative beyond, since rounding a large result to float
+ * is more than the absolute error.
+ *
+ *   accuracy     1        2        3
+ *   sin, cos     3.4e-4   3.8e-6   1.1e-7
+ *   tan          4.3e-4   4.9e-6   2.2e-7
+ *   exp          8.3e-4   3.5e-6   2.5e-7
+ *   ln           6.4e-5   1.4e-6   1.4e-7
+ *   sqrt         1.8e-3   5.0e-6   2.0e-7
+ *   atan         2.8e-4   1.4e-5   1.9e-7
+ *
+ * pow(x, y) is exp(y*ln(x)), so its relative error is about |y*ln(x)| times the ln error plus the exp
+ * error.  sin, cos and tan fall back to the standard library above 32768 in magnitude, where the argument
+ * reduction used here runs out of precision.
+ */
+
+namespace FastMath {
+
+const float PI = 3.14159265358979f;
+const float HALF_PI = 1.57079632679490f;
+
+// pi/2 and ln(2) split into parts with few enough bits that multiplying them by a small integer is exact,
+// plus a correction.  This keeps the argument reduction accurate far from zero.  pi/2 needs a middle part,
+// since the quadrant goes up to 2^15 and the correction times it would otherwise be rounded by 5e-7.
+
+const float HALF_PI_HIGH = 1.5703125f;
+const float HALF_PI_MIDDLE = 4.8351287841796875e-4f;
+const float HALF_PI_LOW = 3.13916478589249e-7f;
+const float TWO_OVER_PI = 0.636619772367581f;
+const float LN2_HIGH = 0.693145751953125f;
+const float LN2_LOW = 1.42860682030941723e-6f;
+const float LOG2_E = 1.44269504088896f;
+const float SQRT2 = 1.41421356237310f;
+const float SQRT3 = 1.73205080756888f;
+const float TAN_PI_OVER_12 = 0.267949192431123f;
+const float TRIG_LIMIT = 32768.0f;
+
+/**
+ * Round to the nearest integer, halfway cases away from zero.
+ */
+inline int roundToInt(float x) {
+    return (int) (x < 0 ? x-0.5f : x+0.5f);
+}
+
+/**
+ * Compute 2^k for k in [-126, 127] by building the float directly.
+ */
+inline float powerOfTwo(int k) {
+    uint32_t bits = (uint32_t) (k+127) << 23;
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+/**
+ * Compute sin and cos of x together, since they share the argument reduction.
+ */
+inline void sincos(float x, float& sine, float& cosine) {
+    if (!(x > -TRIG_LIMIT && x < TRIG_LIMIT)) {
+        sine = std::sin(x);
+        cosine = std::cos(x);
+        return;
+    }
+
+    // Reduce to r in [-pi/4, pi/4] with x = r + quadrant*pi/2.
+
+    int quadrant = roundToInt(x*TWO_OVER_PI);
+    float r = ((x-quadrant*HALF_PI_HIGH)-quadrant*HALF_PI_MIDDLE)-quadrant*HALF_PI_LOW;
+    float r2 = r*r;
+
+    // Taylor series, whose error on this interval is about the size of the first term left out.
+
+#if LEPTON_FAST_MATH_ACCURACY <= 1
+    float s = r + r*r2*(-1.0f/6 + r2*(1.0f/120));
+    float c = 1.0f + r2*(-0.5f + r2*(1.0f/24));
+#elif LEPTON_FAST_MATH_ACCURACY == 2
+    float s = r + r*r2*(-1.0f/6 + r2*(1.0f/120 + r2*(-1.0f/5040)));
+    float c = 1.0f + r2*(-0.5f + r2*(1.0f/24 + r2*(-1.0f/720)));
+#else
+    float s = r + r*r2*(-1.0f/6 + r2*(1.0f/120 + r2*(-1.0f/5040 + r2*(1.0f/362880))));
+    float c = 1.0f + r2*(-0.5f + r2*(1.0f/24 + r2*(-1.0f/720 + r2*(1.0f/40320))));
+#endif
+    switch (quadrant & 3) {
+        case 0:
+            sine = s;
+            cosine = c;
+            break;
+        case 1:
+            sine = c;
+            cosine = -s;
+            break;
+        case 2:
+            sine = -s;
+            cosine = -c;
+            break;
+        default:
+            sine = -c;
+            cosine = s;
+            break;
+    }
+}
+
+inline float sin(float x) {
+    float sine, cosine;
+    sincos(x, sine, cosine);
+    return sine;
+}
+
+inline float cos(float x) {
+    float sine, cosine;
+    sincos(x, sine, cosine);
+    return cosine;
+}
+
+inline float tan(float x) {
+    float sine, cosine;
+    sincos(x, sine, cosine);
+    return sine/cosine;
+}
+
+inline float exp(float x) {
+    if (x != x)
+        return x;
+    if (x > 88.72f)
+        return std::numeric_limits<float>::infinity();
+    if (x < -87.33f)
+        return 0.0f;
+
+    // Reduce to r in [-ln(2)/2, ln(2)/2] with x = r + k*ln(2), so exp(x) = exp(r)*2^k.
+
+    int k = roundToInt(x*LOG2_E);
+    float r = (x-k*LN2_HIGH)-k*LN2_LOW;
+#if LEPTON_FAST_MATH_ACCURACY <= 1
+    float p = 1.0f + r*(1.0f + r*(0.5f + r*(1.0f/6)));
+#elif LEPTON_FAST_MATH_ACCURACY == 2
+    float p = 1.0f + r*(1.0f + r*(0.5f + r*(1.0f/6 + r*(1.0f/24 + r*(1.0f/120)))));
+#else
+    float p = 1.0f + r*(1.0f + r*(0.5f + r*(1.0f/6 + r*(1.0f/24 + r*(1.0f/120 + r*(1.0f/720))))));
+#endif
+    if (k > 127) {
+        p *= 2.0f;
+        k--;
+    }
+    return p*powerOfTwo(k);
+}
+
+inline float log(float x) {
+    if (!(x > 0))
+        return (x == 0 ? -std::numeric_limits<float>::infinity() : std::numeric_limits<float>::quiet_NaN());
+    if (x == std::numeric_limits<float>::infinity())
+        return x;
+
+    // Split x into m*2^e with m in [sqrt(1/2), sqrt(2)), scaling denormals up first.
+
+    int e = 0;
+    if (x < std::numeric_limits<float>::min()) {
+        x *= 8388608.0f;
+        e = -23;
+    }
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    e += (int) ((bits >> 23) & 0xff) - 127;
+    bits = (bits & 0x7fffff) | 0x3f800000;
+    float m;
+    std::memcpy(&m, &bits, sizeof(m));
+    if (m > SQRT2) {
+        m *= 0.5f;
+        e++;
+    }
+
+    // ln(m) = 2*atanh(s) with s = (m-1)/(m+1), which is at most 0.172 here.
+
+    float s = (m-1.0f)/(m+1.0f);
+    float s2 = s*s;
+#if LEPTON_FAST_MATH_ACCURACY <= 1
+    float lnM = 2.0f*s*(1.0f + s2*(1.0f/3));
+#elif LEPTON_FAST_MATH_ACCURACY == 2
+    float lnM = 2.0f*s*(1.0f + s2*(1.0f/3 + s2*(1.0f/5)));
+#else
+    float lnM = 2.0f*s*(1.0f + s2*(1.0f/3 + s2*(1.0f/5 + s2*(1.0f/7))));
+#endif
+    return e*LN2_HIGH + (lnM + e*LN2_LOW);
+}
+
+inline float sqrt(float x) {
+    if (!(x > 0))
+        return (x == 0 ? x : std::numeric_limits<float>::quiet_NaN());
+    if (x == std::numeric_limits<float>::infinity())
+        return x;
+
+    // Newton's method for 1/sqrt(x), which needs no division, from an estimate taken from the exponent bits.
+    // Denormals have no exponent bits to estimate from, so they are scaled up by 2^24 first.
+
+    float scale = 1.0f;
+    if (x < std::numeric_limits<float>::min()) {
+        x *= 16777216.0f;
+        scale = 1.0f/4096;
+    }
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    bits = 0x5f3759df - (bits >> 1);
+    float y;
+    std::memcpy(&y, &bits, sizeof(y));
+    float half = 0.5f*x;
+    y = y*(1.5f - half*y*y);
+#if LEPTON_FAST_MATH_ACCURACY >= 2
+    y = y*(1.5f - half*y*y);
+#endif
+#if LEPTON_FAST_MATH_ACCURACY >= 3
+    y = y*(1.5f - half*y*y);
+#endif
+    return x*y*scale;
+}
+
+inline float atan(float x) {
+    if (x != x)
+        return x;
+
+    // Use the symmetries atan(-x) = -atan(x) and atan(x) = pi/2 - atan(1/x), then
+    // atan(x) = pi/6 + atan((x*sqrt(3)-1)/(x+sqrt(3))) to bring the argument within tan(pi/12).
+
+    bool negative = (x < 0);
+    if (negative)
+        x = -x;
+    bool inverted = (x > 1.0f);
+    if (inverted)
+        x = 1.0f/x;
+    bool shifted = (x > TAN_PI_OVER_12);
+    if (shifted)
+        x = (x*SQRT3-1.0f)/(x+SQRT3);
+    float x2 = x*x;
+#if LEPTON_FAST_MATH_ACCURACY <= 1
+    float result = x + x*x2*(-1.0f/3);
+#elif LEPTON_FAST_MATH_ACCURACY == 2
+    float result = x + x*x2*(-1.0f/3 + x2*(1.0f/5));
+#else
+    float result = x + x*x2*(-1.0f/3 + x2*(1.0f/5 + x2*(-1.0f/7 + x2*(1.0f/9))));
+#endif
+    if (shifted)
+        result += PI/6;
+    if (inverted)
+        result = HALF_PI-result;
+    return (negative ? -result : result);
+}
+
+inline float pow(float x, float y) {
+    if (y == 0)
+        return 1.0f;
+    if (x > 0)
+        return exp(y*log(x));
+    if (x == 0)
+        return (y > 0 ? 0.0f : std::numeric_limits<float>::infinity());
+
+    // A negative base only has a real power when the exponent is an integer.  Every float above 2^24 is an even integer.
+
+    if (!(std::abs(y) < 16777216.0f))
+        return (y == y ? exp(y*log(-x)) : y);
+    int n = (int) y;
+    if (n != y)
+        return std::numeric_limits<float>::quiet_NaN();
+    float result = exp(y*log(-x));
+    return ((n & 1) != 0 ? -result : result);
+}
+
+} // namespace FastMath
+
+} // namespace Lepton
+
+#endif /*LEPTON_FAST_MATH_H_*/
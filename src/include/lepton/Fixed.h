@@ -0,0 +1,153 @@
+#ifndef LEPTON_FIXED_H_
+#define LEPTON_FIXED_H_
+
+#include "windowsIncludes.h"
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace Lepton {
+
+/**
+ * A signed Q16.16 fixed point number.  Addition, subtraction and multiplication are done with integer
+ * instructions, which makes this much cheaper than float or double on processors without an FPU.
+ *
+ * The representable range is [-32768, 32768) with a resolution of 2^-16 (about 1.5e-5).  Results outside
+ * the range saturate to the nearest end instead of wrapping, so they keep their sign.  The most negative
+ * raw value is reserved to mean NaN, which propagates through every operation.  Converting an infinity
+ * also gives NaN, since it usually comes from a pole rather than a large value.
+ */
+
+class LEPTON_EXPORT Fixed {
+public:
+    static const int FRACTION_BITS = 16;
+    static const int32_t ONE = 1 << FRACTION_BITS;
+    static const int32_t MAX_RAW = INT32_MAX;
+    static const int32_t MIN_RAW = INT32_MIN+1;
+    static const int32_t NAN_RAW = INT32_MIN;
+
+    Fixed() : raw(0) {
+    }
+    explicit Fixed(int value) : raw(saturate((int64_t) value << FRACTION_BITS)) {
+    }
+    explicit Fixed(float value) : raw(fromFloating(value)) {
+    }
+    explicit Fixed(double value) : raw(fromFloating(value)) {
+    }
+    /**
+     * Create a Fixed from its raw Q16.16 representation.
+     */
+    static Fixed fromRaw(int32_t raw) {
+        Fixed result;
+        result.raw = raw;
+        return result;
+    }
+    static Fixed nan() {
+        return fromRaw(NAN_RAW);
+    }
+    int32_t getRaw() const {
+        return raw;
+    }
+    bool isNaN() const {
+        return raw == NAN_RAW;
+    }
+    float toFloat() const {
+        return isNaN() ? std::numeric_limits<float>::quiet_NaN() : raw * (1.0f/ONE);
+    }
+    double toDouble() const {
+        return isNaN() ? std::numeric_limits<double>::quiet_NaN() : raw * (1.0/ONE);
+    }
+    /**
+     * Round towards negative infinity to an integer.
+     */
+    int32_t floor() const {
+        return raw >> FRACTION_BITS;
+    }
+    Fixed operator+(Fixed other) const {
+        if (isNaN() || other.isNaN())
+            return nan();
+        return fromRaw(saturate((int64_t) raw + other.raw));
+    }
+    Fixed operator-(Fixed other) const {
+        if (isNaN() || other.isNaN())
+            return nan();
+        return fromRaw(saturate((int64_t) raw - other.raw));
+    }
+    Fixed operator-() const {
+        return isNaN() ? nan() : fromRaw(-raw);
+    }
+    Fixed operator*(Fixed other) const {
+        if (isNaN() || other.isNaN())
+            return nan();
+        return fromRaw(saturate(((int64_t) raw * other.raw) >> FRACTION_BITS));
+    }
+    Fixed operator/(Fixed other) const {
+        if (isNaN() || other.isNaN() || other.raw == 0)
+            return nan();
+        return fromRaw(saturate(((int64_t) raw << FRACTION_BITS) / other.raw));
+    }
+    bool operator<(Fixed other) const {
+        return !isNaN() && !other.isNaN() && raw < other.raw;
+    }
+    bool operator>(Fixed other) const {
+        return other < *this;
+    }
+    bool operator<=(Fixed other) const {
+        return !isNaN() && !other.isNaN() && raw <= other.raw;
+    }
+    bool operator>=(Fixed other) const {
+        return other <= *this;
+    }
+    bool operator==(Fixed other) const {
+        return !isNaN() && raw == other.raw;
+    }
+    bool operator!=(Fixed other) const {
+        return !(*this == other);
+    }
+    /**
+     * Compute the square root exactly (rounded down to the resolution) using only integer operations.
+     */
+    Fixed sqrt() const {
+        if (isNaN() || raw < 0)
+            return nan();
+        uint64_t value = (uint64_t) raw << FRACTION_BITS;
+        uint64_t result = 0;
+        uint64_t bit = (uint64_t) 1 << 62;
+        while (bit > value)
+            bit >>= 2;
+        while (bit != 0) {
+            if (value >= result+bit) {
+                value -= result+bit;
+                result = (result >> 1) + bit;
+            }
+            else
+                result >>= 1;
+            bit >>= 2;
+        }
+        return fromRaw((int32_t) result);
+    }
+private:
+    static int32_t saturate(int64_t value) {
+        if (value > MAX_RAW)
+            return MAX_RAW;
+        if (value < MIN_RAW)
+            return MIN_RAW;
+        return (int32_t) value;
+    }
+    template <class T>
+    static int32_t fromFloating(T value) {
+        if (value != value || value-value != 0)
+            return NAN_RAW; // NaN or infinite
+        T scaled = value*ONE;
+        if (scaled >= (T) MAX_RAW)
+            return MAX_RAW;
+        if (scaled <= (T) MIN_RAW)
+            return MIN_RAW;
+        return (int32_t) std::lround(scaled);
+    }
+    int32_t raw;
+};
+
+} // namespace Lepton
+
+#endif /*LEPTON_FIXED_H_*/
@@ -0,0 +1,35 @@
+#ifndef LEPTON_MATRIX_POWER_H_
+#define LEPTON_MATRIX_POWER_H_
+
+#include "windowsIncludes.h"
+#include "Matrix.h"
+
+namespace Lepton {
+
+/**
+ * Powers of square matrices, as used by ^.
+ *
+ * Integer exponents up to MAX_SQUARING_EXPONENT in size are computed by repeated squaring, which takes
+ * about 2*log2(n) products, and negative ones square the inverse from the matrix's Factorization.  Larger
+ * and fractional exponents use the cached eigendecomposition a = V*D*V^-1, so that a^p = V*D^p*V^-1 costs
+ * two products however large p is.  Only matrices that are not diagonalizable with a real result fall
+ * back to the general Schur-Pade algorithm in Eigen's MatrixFunctions module.
+ */
+
+class LEPTON_EXPORT MatrixPower {
+public:
+    /**
+     * The largest exponent computed by repeated squaring even when the eigendecomposition could be used.
+     * Squaring is more accurate for matrices whose eigenvectors are nearly dependent.
+     */
+    static const int MAX_SQUARING_EXPONENT = 64;
+
+    /**
+     * Get matrix^exponent.
+     */
+    static Eigen::MatrixXd evaluate(const SharedMatrix& matrix, double exponent);
+};
+
+} // namespace Lepton
+
+#endif /*LEPTON_MATRIX_POWER_H_*/
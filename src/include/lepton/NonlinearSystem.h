@@ -0,0 +1,88 @@
+#ifndef LEPTON_NONLINEAR_SYSTEM_H_
+#define LEPTON_NONLINEAR_SYSTEM_H_
+
+#include "windowsIncludes.h"
+#include "CompiledExpression.h"
+#include "ExpressionTreeNode.h"
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Lepton {
+
+/**
+ * A system of n equations f_i = 0 in n unknowns, with every other variable fixed at its current value, as
+ * used by solve.
+ *
+ * It is solved with Powell's hybrid (dogleg) method from Eigen's NonLinearOptimization module, which takes
+ * Newton steps inside a trust region and falls back towards steepest descent of |f| when they fail, so a
+ * good guess converges quadratically in a handful of iterations.  The equations and their Jacobian are
+ * compiled once: the Jacobian is the symbolic derivative of each equation with respect to each unknown, so
+ * it is exact.  Equations containing functions whose derivatives are not known, such as fnInt or nCr, use
+ * forward differences instead.  Each evaluation of an equation or a derivative charges one unit of work to
+ * the current EvaluationContext.
+ *
+ * Values that are not real stop the solver.
+ */
+
+class LEPTON_EXPORT NonlinearSystem {
+public:
+    /**
+     * The most unknowns a system may have.
+     */
+    static const int MAX_UNKNOWNS = 10;
+    /**
+     * The most times each attempt may evaluate the equations.
+     */
+    static const int MAX_EVALUATIONS = 100;
+
+    /**
+     * Create a NonlinearSystem.
+     *
+     * @param equations   the expressions that should be zero
+     * @param unknowns    the variables to solve for, as many as there are equations
+     * @param variables   the values of every other variable in the equations
+     */
+    NonlinearSystem(const std::vector<ExpressionTreeNode>& equations, const std::vector<std::string>& unknowns, const std::map<std::string, double>& variables);
+    /**
+     * Find a solution near a guess.  If the solver stalls, usually because the Jacobian is singular at the
+     * guess, it starts again from the guess moved by max(1, |x|) up and then down in every unknown.
+     *
+     * @param x   the guess, which is replaced by the solution
+     * @return true if a solution was found, false if the equations could not all be made zero
+     */
+    bool solve(std::vector<double>& x);
+    /**
+     * Evaluate the equations.
+     *
+     * @return false if any of them is not real
+     */
+    bool evaluate(const double* x, double* values);
+    /**
+     * Evaluate the Jacobian, storing d(equation i)/d(unknown j) in jacobian[i+j*n].
+     *
+     * @return false if any element is not real
+     */
+    bool evaluateJacobian(const double* x, double* jacobian);
+    /**
+     * Get whether the Jacobian is known exactly.  If not, the solver approximates it by forward differences.
+     */
+    bool hasJacobian() const {
+        return jacobianKnown;
+    }
+private:
+    NonlinearSystem(const NonlinearSystem&); // The compiled expressions are bound to their own variables
+    NonlinearSystem& operator=(const NonlinearSystem&);
+    void bindVariables(CompiledExpression& compiled, std::vector<double*>& references);
+    double evaluate(CompiledExpression& compiled, const std::vector<double*>& references, const double* x);
+    bool attempt(std::vector<double>& x);
+    std::vector<std::string> unknowns;
+    const std::map<std::string, double>& variables;
+    std::vector<CompiledExpression> equations, derivatives;
+    std::vector<std::vector<double*> > equationInputs, derivativeInputs; // Where each expression reads each unknown, or NULL
+    bool jacobianKnown;
+};
+
+} // namespace Lepton
+
+#endif /*LEPTON_NONLINEAR_SYSTEM_H_*/
@@ -0,0 +1,73 @@
+#ifndef LEPTON_ODE_SOLVER_H_
+#define LEPTON_ODE_SOLVER_H_
+
+#include "windowsIncludes.h"
+#include "CompiledExpression.h"
+#include "ExpressionTreeNode.h"
+#include <map>
+#include <string>
+
+namespace Lepton {
+
+/**
+ * The solution of a first order differential equation y' = f(x, y), as used by ode and by the graphs of it.
+ *
+ * It is integrated with the Dormand-Prince 5(4) Runge-Kutta pair.  The difference between the fifth and
+ * fourth order solutions estimates the error of each step, and the step size adapts to keep it within the
+ * tolerance.  The last stage of each step is the first of the next, so a step costs six evaluations of f.
+ * Values between the ends of a step come from its fourth order dense output at no extra cost, so
+ * sampling the solution at many points needs no more steps than reaching the last of them.
+ *
+ * The right hand side is compiled once with x and y bound to fixed slots, and each evaluation charges one
+ * unit of work to the current EvaluationContext.  Values of f that are not real are NaN.
+ */
+
+class LEPTON_EXPORT OdeSolver {
+public:
+    /**
+     * The most steps an integration may take.
+     */
+    static const int MAX_STEPS = 10000;
+
+    /**
+     * Create an OdeSolver.
+     *
+     * @param node        the right hand side f
+     * @param x           the independent variable
+     * @param y           the dependent variable
+     * @param variables   the values of every other variable in f
+     */
+    OdeSolver(const ExpressionTreeNode& node, const std::string& x, const std::string& y, const std::map<std::string, double>& variables);
+    /**
+     * Get y(end) for the solution through (start, value), to about 10 significant digits.  end may be less
+     * than start.
+     *
+     * @return the value, or NaN if the solution is undefined or stops before end
+     */
+    double solve(double start, double value, double end);
+    /**
+     * Get the solution through (start, value) at count evenly spaced points, integrating away from start in
+     * each direction that has points.  Where the solution cannot be continued, for example past a pole,
+     * the rest of the points on that side are NaN.
+     *
+     * @param first       the first point
+     * @param spacing     the distance between points
+     * @param absolute    the error allowed in each step where y is near 0
+     * @param relative    the error allowed in each step as a fraction of |y|, which is added to absolute
+     * @param values      set to the solution at first, first+spacing, ..., first+(count-1)*spacing
+     */
+    void sample(double start, double value, double first, double spacing, int count, double absolute, double relative, double* values);
+private:
+    OdeSolver(const OdeSolver&); // The compiled expression is bound to its own variables
+    OdeSolver& operator=(const OdeSolver&);
+    double evaluate(double x, double y);
+    double initialStep(double x, double y, double f, double direction, double absolute, double relative);
+    void integrate(double start, double value, const double* points, int count, double absolute, double relative, double* values);
+    CompiledExpression expression;
+    double* xReference;
+    double* yReference;
+};
+
+} // namespace Lepton
+
+#endif /*LEPTON_ODE_SOLVER_H_*/
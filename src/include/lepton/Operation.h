@@ -34,8 +34,12 @@
 
 #include "windowsIncludes.h"
 #include "CustomFunction.h"
+#include "EvaluationContext.h"
 #include "Exception.h"
+#include "Factorization.h"
+#include "MatrixPower.h"
 #include "ParsedExpression.h"
+#include "SmallMatrix.h"
 #include <cmath>
 #include <map>
 #include <string>
@@ -43,7 +47,6 @@
 #include <sstream>
 #include <algorithm>
 #include <numeric>
-#include <random>
 #include <complex>
 
 #include <iostream>
@@ -52,7 +55,7 @@ namespace Lepton {
 
 class ExpressionTreeNode;
 
-inline bool isMatrix(InputArgType input) {
+inline bool isMatrix(const InputArgType& input) {
     if (input.dataTypeEnum != DataTypeEnum::matrix)
         return false;
 
@@ -78,7 +81,7 @@ public:
     enum Id {COMPLEX_NUMBER, CONSTANT, VARIABLE, MATRIX, TRANSPOSE, DET, DOT, CROSS, SOLVE_SOLE, CUSTOM, AND, OR, NOT, XOR, LOGICAL_LEFT_SHIFT, LOGICAL_RIGHT_SHIFT,
              ADD, SUBTRACT, MULTIPLY, DIVIDE, MODULUS, POWER, NEGATE, SQRT, EXP, LOG, LN, FACTORIAL, GCD, LCM, FNINT, SIGMA, PROD,
              NPR, NCR, SIN, COS, SEC, CSC, TAN, COT, ASIN, ACOS, ATAN, SINH, COSH, TANH, ASINH, ACOSH, ATANH, ACSC, CSCH, COTH, SECH, ASEC, ACOT, ACSCH, ASECH, ACOTH,
-             ERF, ERFC, STEP, DELTA, SQUARE, CUBE, RECIPROCAL, ADD_CONSTANT, MULTIPLY_CONSTANT, POWER_CONSTANT, MIN, MAX, ABS, RAND};
+             ERF, ERFC, STEP, DELTA, SQUARE, CUBE, RECIPROCAL, ADD_CONSTANT, MULTIPLY_CONSTANT, POWER_CONSTANT, MIN, MAX, ABS, RAND, INTEGER, LIM, SOLVE, PROOTS, ODE, EIG, INV};
     /**
      * Get the name of this Operation.
      */
@@ -88,7 +91,7 @@ public:
      */
     virtual Id getId() const = 0;
     /**
-     * Get the number of arguments this operation expects.
+     * Get the number of arguments this operation expects, or -1 if it takes any number.
      */
     virtual int getNumArguments() const = 0;
     /**
@@ -132,6 +135,7 @@ public:
     }
     class ComplexNumber;
     class Constant;
+    class Integer;
     class Variable;
     class Matrix;
     class Transpose;
@@ -163,6 +167,12 @@ public:
     class FnInt;
     class Sigma;
     class Prod;
+    class Lim;
+    class Solve;
+    class Proots;
+    class Ode;
+    class Eig;
+    class Inv;
     class Npr;
     class Ncr;
     class Sin;
@@ -207,6 +217,13 @@ public:
 };
 
 class LEPTON_EXPORT Operation::TrigonometricFunction : public Operation {
+public:
+    /**
+     * Get whether this function takes (or, for inverse functions, is meant to give) angles in degrees.
+     */
+    bool usesDegrees() const {
+        return isDegree;
+    }
 protected:
     TrigonometricFunction() : isDegree(false) {}
     TrigonometricFunction(bool isDegree) : isDegree(isDegree) {}
@@ -282,6 +299,43 @@ private:
     double value;
 };
 
+/**
+ * An integer literal, kept exact so that programmer mode can use all 64 bits.  Elsewhere it behaves like a
+ * Constant, although values above 2^53 get rounded when converted to double.
+ */
+class LEPTON_EXPORT Operation::Integer : public Operation {
+public:
+    Integer(int64_t value) : value(value) {
+    }
+    std::string getName() const {
+        std::stringstream name;
+        name << value;
+        return name.str();
+    }
+    Id getId() const {
+        return INTEGER;
+    }
+    int getNumArguments() const {
+        return 0;
+    }
+    Operation* clone() const {
+        return new Integer(value);
+    }
+    Result evaluate(Args& args, const std::map<std::string, double>& variables) const {
+        return Result((double) value);
+    }
+    ExpressionTreeNode differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const;
+    int64_t getValue() const {
+        return value;
+    }
+    bool operator!=(const Operation& op) const {
+        const Integer* o = dynamic_cast<const Integer*>(&op);
+        return (o == NULL || o->value != value);
+    }
+private:
+    int64_t value;
+};
+
 class LEPTON_EXPORT Operation::Variable : public Operation {
 public:
     Variable(const std::string& name) : name(name) {
@@ -357,7 +411,7 @@ public:
         if (!isMatrix(args.inputs[0]))
             throw Exception("Error: Argument is not a matrix");
 
-        return Result(args.inputs[0].matrix.transpose());
+        return Result(args.inputs[0].getMatrix().transpose());
     }
     ExpressionTreeNode differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const;
 };
@@ -382,7 +436,15 @@ public:
         if (!isMatrix(args.inputs[0]))
             throw Exception("Error: Argument is not a matrix");
 
-        return Result(args.inputs[0].matrix.determinant());
+        if (args.inputs[0].matrix.rows() != args.inputs[0].matrix.cols()) {
+            throw Exception("Error: Not a square matrix");
+        }
+
+        if (args.inputs[0].matrix.rows() <= SmallMatrix::MAX_SIZE) {
+            return Result(SmallMatrix::determinant(args.inputs[0].getMatrix()));
+        }
+
+        return Result(Factorization::find(args.inputs[0].matrix)->determinant());
     }
     ExpressionTreeNode differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const;
 };
@@ -407,13 +469,14 @@ public:
         if ((!isMatrix(args.inputs[0]) || (!isMatrix(args.inputs[1]))))
             throw Exception("Error: Argument is not a matrix");
 
-        if (args.inputs[0].matrix.cols() != 1 || args.inputs[1].matrix.cols() != 1) {
+        if (args.inputs[0].getMatrix().cols() != 1 || args.inputs[1].getMatrix().cols() != 1) {
             throw Exception("Error: Not a nx1 matrix");
         }
+        if (args.inputs[0].getMatrix().rows() != args.inputs[1].getMatrix().rows()) {
+            throw Exception("LHS rows != RHS rows");
+        }
 
-        Eigen::VectorXd v(Eigen::Map<Eigen::VectorXd>(args.inputs[0].matrix.data(), args.inputs[0].matrix.rows()));
-        Eigen::VectorXd w(Eigen::Map<Eigen::VectorXd>(args.inputs[1].matrix.data(), args.inputs[1].matrix.rows()));
-        return Result(v.dot(w));
+        return Result(args.inputs[0].getMatrix().col(0).dot(args.inputs[1].getMatrix().col(0)));
     }
     ExpressionTreeNode differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const;
 };
@@ -438,13 +501,13 @@ public:
         if ((!isMatrix(args.inputs[0]) || (!isMatrix(args.inputs[1]))))
             throw Exception("Error: Argument is not a Matrix");
 
-        if (args.inputs[0].matrix.rows() != 3 || args.inputs[0].matrix.cols() != 1 ||
-            args.inputs[1].matrix.rows() != 3 || args.inputs[1].matrix.cols() != 1) {
+        if (args.inputs[0].getMatrix().rows() != 3 || args.inputs[0].getMatrix().cols() != 1 ||
+            args.inputs[1].getMatrix().rows() != 3 || args.inputs[1].getMatrix().cols() != 1) {
             throw Exception("Error: Not a 3x1 matrix");
         }
 
-        Eigen::Vector3d v(Eigen::Map<Eigen::Vector3d>(args.inputs[0].matrix.data(), 3));
-        Eigen::Vector3d w(Eigen::Map<Eigen::Vector3d>(args.inputs[1].matrix.data(), 3));
+        Eigen::Map<const Eigen::Vector3d> v(args.inputs[0].getMatrix().data());
+        Eigen::Map<const Eigen::Vector3d> w(args.inputs[1].getMatrix().data());
         return Result(v.cross(w));
     }
     ExpressionTreeNode differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const;
@@ -470,8 +533,79 @@ public:
         if ((!isMatrix(args.inputs[0]) || (!isMatrix(args.inputs[1]))))
             throw Exception("Error: Argument is not a Matrix");
 
-        Eigen::MatrixXd x = args.inputs[0].matrix.householderQr().solve(args.inputs[1].matrix);
-        return Result(x);
+        if (args.inputs[0].matrix.rows() != args.inputs[1].matrix.rows()) {
+            throw Exception("LHS rows != RHS rows");
+        }
+
+        return Result(Factorization::find(args.inputs[0].matrix)->solve(args.inputs[1].getMatrix()));
+    }
+    ExpressionTreeNode differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const;
+};
+
+/**
+ * eig(A) is every eigenvalue of a square matrix, as a matrix with one row per eigenvalue holding its real
+ * and imaginary parts, like proots.
+ */
+class LEPTON_EXPORT Operation::Eig : public Operation {
+public:
+    Eig() {
+    }
+    std::string getName() const {
+        return "eig";
+    }
+    Id getId() const {
+        return EIG;
+    }
+    int getNumArguments() const {
+        return 1;
+    }
+    Operation* clone() const {
+        return new Eig();
+    }
+    Result evaluate(Args& args, const std::map<std::string, double>& variables) const {
+        if (!isMatrix(args.inputs[0]))
+            throw Exception("Error: Argument is not a matrix");
+
+        if (args.inputs[0].getMatrix().rows() != args.inputs[0].getMatrix().cols()) {
+            throw Exception("Error: Not a square matrix");
+        }
+
+        std::vector<std::complex<double> > values = Factorization::find(args.inputs[0].matrix)->eigenvalues();
+        Eigen::MatrixXd result(values.size(), 2);
+        for (int i = 0; i < (int) values.size(); i++) {
+            result(i, 0) = values[i].real();
+            result(i, 1) = values[i].imag();
+        }
+        return Result(result);
+    }
+    ExpressionTreeNode differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const;
+};
+
+class LEPTON_EXPORT Operation::Inv : public Operation {
+public:
+    Inv() {
+    }
+    std::string getName() const {
+        return "inv";
+    }
+    Id getId() const {
+        return INV;
+    }
+    int getNumArguments() const {
+        return 1;
+    }
+    Operation* clone() const {
+        return new Inv();
+    }
+    Result evaluate(Args& args, const std::map<std::string, double>& variables) const {
+        if (!isMatrix(args.inputs[0]))
+            throw Exception("Error: Argument is not a matrix");
+
+        if (args.inputs[0].matrix.rows() != args.inputs[0].matrix.cols()) {
+            throw Exception("Error: Not a square matrix");
+        }
+
+        return Result(Factorization::find(args.inputs[0].matrix)->inverse());
     }
     ExpressionTreeNode differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const;
 };
@@ -502,15 +636,22 @@ public:
         return clone;
     }
     Result evaluate(Args& args, const std::map<std::string, double>& variables) const {
-        if (args.inputs[0].getImag() != 0) {
-            throw Exception("Argument must be purely real");
+        // The function expects its arguments next to each other, so copy them out of the inputs.
+        int numArguments = function->getNumArguments();
+        arguments.resize(numArguments);
+        for (int i = 0; i < numArguments; i++) {
+            if (isMatrix(args.inputs[i])) {
+                throw Exception("Matrices are not supported with "+name);
+            }
+            if (args.inputs[i].getImag() != 0) {
+                throw Exception("Argument must be purely real");
+            }
+            arguments[i] = args.inputs[i].getReal();
         }
 
-        double val = args.inputs[0].getReal();
-        
         if (isDerivative)
-            return function->evaluateDerivative(&args.inputs[0].realVal, &derivOrder[0]);
-        return Result(function->evaluate(&args.inputs[0].realVal));
+            return function->evaluateDerivative(arguments.data(), &derivOrder[0]);
+        return Result(function->evaluate(arguments.data()));
     }
     ExpressionTreeNode differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const;
     const std::vector<int>& getDerivOrder() const {
@@ -525,6 +666,7 @@ private:
     CustomFunction* function;
     bool isDerivative;
     std::vector<int> derivOrder;
+    mutable std::vector<double> arguments;
 };
 
 class LEPTON_EXPORT Operation::And : public Operation {
@@ -743,12 +885,12 @@ public:
     }
     Result evaluate(Args& args, const std::map<std::string, double>& variables) const {
         if (args.inputs[0].dataTypeEnum == DataTypeEnum::matrix && args.inputs[1].dataTypeEnum == DataTypeEnum::matrix) {
-            if (args.inputs[0].matrix.rows() != args.inputs[1].matrix.rows() || 
-                args.inputs[0].matrix.cols() != args.inputs[1].matrix.cols()) {
+            if (args.inputs[0].getMatrix().rows() != args.inputs[1].getMatrix().rows() || 
+                args.inputs[0].getMatrix().cols() != args.inputs[1].getMatrix().cols()) {
                 throw Exception("LHS rows or cols != RHS rows or cols");
             }
             
-            return Result(args.inputs[0].matrix+args.inputs[1].matrix);
+            return Result(args.inputs[0].getMatrix()+args.inputs[1].getMatrix());
         }
         else if (args.inputs[0].dataTypeEnum == DataTypeEnum::complexVal && args.inputs[1].dataTypeEnum == DataTypeEnum::complexVal) {
             return Result(args.inputs[0].getComplex()+args.inputs[1].getComplex());
@@ -783,12 +925,12 @@ public:
     }
     Result evaluate(Args& args, const std::map<std::string, double>& variables) const {
         if (args.inputs[0].dataTypeEnum == DataTypeEnum::matrix && args.inputs[1].dataTypeEnum == DataTypeEnum::matrix) {
-            if (args.inputs[0].matrix.rows() != args.inputs[1].matrix.rows() || 
-                args.inputs[0].matrix.cols() != args.inputs[1].matrix.cols()) {
+            if (args.inputs[0].getMatrix().rows() != args.inputs[1].getMatrix().rows() || 
+                args.inputs[0].getMatrix().cols() != args.inputs[1].getMatrix().cols()) {
                 throw Exception("LHS rows or cols != RHS rows or cols");
             }
             
-            return Result(args.inputs[0].matrix-args.inputs[1].matrix);
+            return Result(args.inputs[0].getMatrix()-args.inputs[1].getMatrix());
         }
         else if (args.inputs[0].dataTypeEnum == DataTypeEnum::complexVal && args.inputs[1].dataTypeEnum == DataTypeEnum::complexVal) {
             return Result(args.inputs[0].getComplex()-args.inputs[1].getComplex());
@@ -824,20 +966,20 @@ public:
                 throw Exception("Matrix multiplication with complex numbers is not supported");
             }
             if (args.inputs[1].dataTypeEnum == DataTypeEnum::matrix) {
-                if (args.inputs[0].matrix.cols() != args.inputs[1].matrix.rows()) {
+                if (args.inputs[0].getMatrix().cols() != args.inputs[1].getMatrix().rows()) {
                     throw Exception("LHS cols != RHS rows");
                 }
 
-                return Result(args.inputs[0].matrix*args.inputs[1].matrix);
+                return Result(SmallMatrix::multiply(args.inputs[0].getMatrix(), args.inputs[1].getMatrix()));
             }
 
-            return Result(args.inputs[0].matrix*args.inputs[1].getReal());
+            return Result(args.inputs[0].getMatrix()*args.inputs[1].getReal());
         }
         else if (args.inputs[1].dataTypeEnum == DataTypeEnum::matrix) {
             if (args.inputs[0].getImag() != 0) {
                 throw Exception("Matrix multiplication with complex numbers is not supported");
             }
-            return Result(args.inputs[0].getReal()*args.inputs[1].matrix);
+            return Result(args.inputs[0].getReal()*args.inputs[1].getMatrix());
         }
         
         return Result(args.inputs[0].getComplex()*args.inputs[1].getComplex());
@@ -938,7 +1080,7 @@ public:
             if (args.inputs[1].getImag() != 0) {
                 throw Exception("Error: cannot raise matrix to power of complex number");
             }
-            return Result(args.inputs[0].matrix.pow(args.inputs[1].getReal()));
+            return Result(MatrixPower::evaluate(args.inputs[0].matrix, args.inputs[1].getReal()));
         }
 
         return Result(std::pow(args.inputs[0].getComplex(), args.inputs[1].getComplex()));
@@ -967,7 +1109,7 @@ public:
     }
     Result evaluate(Args& args, const std::map<std::string, double>& variables) const {
         if (isMatrix(args.inputs[0])) {
-            return Result(args.inputs[0].matrix * -1);
+            return Result(args.inputs[0].getMatrix() * -1);
         }
 
         return Result(-args.inputs[0].getComplex());
@@ -1095,26 +1237,7 @@ public:
     Operation* clone() const {
         return new Factorial();
     }
-    Result evaluate(Args& args, const std::map<std::string, double>& variables) const {
-        if (isMatrix(args.inputs[0])) {
-                throw Exception("Matrices are not supported with factorial");
-        }
-        
-        // Computation with complex numbers involves integral calculations for the gamma function
-        if (args.inputs[0].getImag() != 0) {
-            throw Exception("Error: Factorial for complex numbers is not supported");
-        }
-
-        if (args.inputs[0].getReal() < 0)
-            throw Exception("Math Error: Factorial of a negative number does not exist");
-        
-        double res = 1;
-        for(int i = 1; i <=args.inputs[0].getReal(); ++i) {
-            res *= i;
-        }
-
-        return Result(res);
-    }
+    Result evaluate(Args& args, const std::map<std::string, double>& variables) const;
     ExpressionTreeNode differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const;
 };
 
@@ -1212,98 +1335,10 @@ public:
     Operation* clone() const {
         return new Npr();
     }
-    Result evaluate(Args& args, const std::map<std::string, double>& variables) const {
-        if (isMatrix(args.inputs[0]) || isMatrix(args.inputs[1])) {
-            throw Exception("Matrices are not supported with nPr");
-        }
-        
-        if (args.inputs[0].getReal() != 0 || args.inputs[1].getReal() != 0) {
-            throw Exception("NPR with complex numbers not supported");
-        }
-
-        Factorial factorial;
-
-        double numerator = (factorial.evaluate(args, variables)).getReal();
-        double diff = args.inputs[0].getReal() - args.inputs[1].getReal();
-        std::vector<InputArgType> vec(1);
-        vec[0] = InputArgType(diff);
-        Args tempArgs;
-        tempArgs.inputs = vec;
-        double denominator = (factorial.evaluate(tempArgs, variables)).getReal();
-        return Result(numerator/denominator);
-    }
+    Result evaluate(Args& args, const std::map<std::string, double>& variables) const;
     ExpressionTreeNode differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const;
 };
 
-//Returns a root of the equation, or nan if there wasn't
-static double getZero(Args& args, const std::map<std::string, double>& variables, double xLeft, double xRight){
-    double retVal;
-
-    std::map<std::string, double> tempVariables;
-    tempVariables.insert(variables.begin(), variables.end());
-    tempVariables[args.variableName] = xLeft;
-
-    //First check to see a difference in sign
-    bool leftSign = (ParsedExpression::publicEvaluate(args.node, tempVariables)).getReal() < 0;
-    tempVariables[args.variableName] = xRight;
-    bool rightSign = (ParsedExpression::publicEvaluate(args.node, tempVariables)).getReal() < 0;
-
-    if(!(leftSign ^ rightSign))
-        return nan(""); //TODO: Will quit prematurely when there are an even number of roots...
-
-    for(int i = 0; i < 50; i++){//Error is halved on each iteration
-        retVal = xLeft + (xRight-xLeft)/2.0;//Apparently there is less subtractive cancellation when calculating this way
-        tempVariables[args.variableName] = retVal;
-        rightSign = (ParsedExpression::publicEvaluate(args.node, tempVariables)).getReal() < 0;
-        if(leftSign ^ rightSign)
-            xRight = retVal;
-        else{
-            xLeft = retVal;
-            leftSign = rightSign;
-        }
-    }
-
-    return retVal;
-}
-
-//Returns the x value of the extrema of the given function
-static double getExtrema(Args& args, const std::map<std::string, double>& variables, double xLeft, double xRight, bool max){
-    unsigned int numDivisions = 160; //Safety margin of screen width, decreases later for faster convergence
-    double step = (xRight-xLeft)/numDivisions;
-
-    //Set up to evaluate
-    std::map<std::string, double> tempVariables;
-    tempVariables.insert(variables.begin(), variables.end());
-    tempVariables[args.variableName] = xLeft;
-
-    double extreme = (ParsedExpression::publicEvaluate(args.node, tempVariables)).getReal();
-    double retVal = xLeft;
-
-    for(int i = 0; i < 30; i++){//Tuneable for precision
-        for(unsigned int j = 0; j < numDivisions; j++){
-            double y = (ParsedExpression::publicEvaluate(args.node, tempVariables)).getReal();
-            if((max && y > extreme) || (!max && y < extreme)){
-                retVal = tempVariables[args.variableName];
-                extreme = y;
-            }
-            tempVariables[args.variableName] += step;
-        }
-        numDivisions = 4; //Error halved on each iteration
-        //Clamp the ret value to the interval
-        if(retVal-step < xLeft)
-            tempVariables[args.variableName] = xLeft;
-        else if(retVal+step > xRight)
-            tempVariables[args.variableName] = xRight-2.0*step;
-        else
-            tempVariables[args.variableName] = retVal-step;//Step through the left eval point to the right eval point
-        step *= 2.0/numDivisions;
-    }
-
-    //Result at this point is guaranteed to be no lower than xLeft
-    //Result is not guaranteed to be less than xRight (possible floating point error)
-    return retVal > xRight ? xRight : retVal;
-}
-
 class LEPTON_EXPORT Operation::FnInt : public Operation {
 public:
     FnInt() {
@@ -1320,36 +1355,7 @@ public:
     Operation* clone() const {
         return new FnInt();
     }
-    Result evaluate(Args& args, const std::map<std::string, double>& variables) const {
-        if (isMatrix(args.inputs[0]) || isMatrix(args.inputs[1])) {
-            throw Exception("Matrices are not supported with nCr");
-        }
-        
-        // Simpons three point rule
-        double start = args.inputs[0].getReal();
-        double end = args.inputs[1].getReal();
-        if (start > end)
-            return 0;
-
-        std::map<std::string, double> tempVariables;
-        tempVariables.insert(variables.begin(), variables.end());
-
-        // can increase/decrease num intervals to adjust accuracy and speed
-        const std::size_t number_of_intervals = 1000;
-        const double h = (end - start) / (2 * number_of_intervals);
-        double result = 0;
-
-        for (std::size_t i = 0; i < number_of_intervals; ++i)
-        {
-            tempVariables[args.variableName] = start + 2 * i * h;
-            const double y0 = (ParsedExpression::publicEvaluate(args.node, tempVariables)).getReal(); tempVariables[args.variableName] += h;
-            const double y1 = (ParsedExpression::publicEvaluate(args.node, tempVariables)).getReal(); tempVariables[args.variableName] += h;
-            const double y2 = (ParsedExpression::publicEvaluate(args.node, tempVariables)).getReal(); tempVariables[args.variableName] += h;
-            result += h * (y0 + 4 * y1 + y2) / 3;
-        }
-
-        return Result(result);
-    }
+    Result evaluate(Args& args, const std::map<std::string, double>& variables) const;
     
     ExpressionTreeNode differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const;
 };
@@ -1370,32 +1376,7 @@ public:
     Operation* clone() const {
         return new Sigma();
     }
-    Result evaluate(Args& args, const std::map<std::string, double>& variables) const {
-        if (isMatrix(args.inputs[0]) || isMatrix(args.inputs[1])) {
-            throw Exception("Matrices are not supported with nCr");
-        }
-        
-        if (args.inputs[0].getImag() != 0 || args.inputs[1].getImag() != 0) {
-            throw Exception("Summation limits must be purely real");
-        }
-        int start = (int) args.inputs[0].getReal();
-        int end = (int) args.inputs[1].getReal();
-        if (start > end)
-            return 0;
-
-        std::map<std::string, double> tempVariables;
-        tempVariables.insert(variables.begin(), variables.end());
-
-        // double result = 0;
-        std::complex<double> result(0, 0);
-        for (;start<=end; start++)
-        {
-            tempVariables[args.variableName] = start;
-            result += ParsedExpression::publicEvaluate(args.node, tempVariables).getComplex();
-        }
-
-        return Result(result);
-    }
+    Result evaluate(Args& args, const std::map<std::string, double>& variables) const;
     
     ExpressionTreeNode differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const;
 };
@@ -1416,35 +1397,107 @@ public:
     Operation* clone() const {
         return new Prod();
     }
-    Result evaluate(Args& args, const std::map<std::string, double>& variables) const {
-        if (isMatrix(args.inputs[0]) || isMatrix(args.inputs[1])) {
-            throw Exception("Matrices are not supported with prod");
-        }
+    Result evaluate(Args& args, const std::map<std::string, double>& variables) const;
+    
+    ExpressionTreeNode differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const;
+};
 
-        if (args.inputs[0].getImag() != 0 || args.inputs[1].getImag() != 0) {
-            throw Exception("prod limits must be purely real");
-        }
-        
-        int start = (int) args.inputs[0].getReal();
-        int end = (int) args.inputs[1].getReal();
-        if (start > end)
-            return 0;
-
-        std::map<std::string, double> tempVariables;
-        tempVariables.insert(variables.begin(), variables.end());
-
-        // double result = 1;
-        tempVariables[args.variableName] = start;
-        std::complex<double> result = ParsedExpression::publicEvaluate(args.node, tempVariables).getComplex();        
-        start++;
-        for (;start<=end; start++)
-        {
-            tempVariables[args.variableName] = start;
-            result *= ParsedExpression::publicEvaluate(args.node, tempVariables).getComplex();
-        }
-        return Result(result);
+/**
+ * lim(expression, variable, point, side) is the limit of the expression as the variable approaches the
+ * point.  The side is positive to approach from above, negative from below, or 0 for both.  When it is
+ * left out, Parser supplies 0.
+ */
+class LEPTON_EXPORT Operation::Lim : public Operation {
+public:
+    Lim() {
     }
-    
+    std::string getName() const {
+        return "lim";
+    }
+    Id getId() const {
+        return LIM;
+    }
+    int getNumArguments() const {
+        return 4;
+    }
+    Operation* clone() const {
+        return new Lim();
+    }
+    Result evaluate(Args& args, const std::map<std::string, double>& variables) const;
+    ExpressionTreeNode differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const;
+};
+
+/**
+ * solve(f1, ..., fn, x1, ..., xn) finds values of the variables x1 to xn that make every fi zero, starting
+ * from their current values (or 0 for variables that have none).  It is a number for one equation and a
+ * column vector for several.  None of its arguments are evaluated by ParsedExpression, which passes the
+ * whole node in args.node.
+ */
+class LEPTON_EXPORT Operation::Solve : public Operation {
+public:
+    Solve() {
+    }
+    std::string getName() const {
+        return "solve";
+    }
+    Id getId() const {
+        return SOLVE;
+    }
+    int getNumArguments() const {
+        return -1;
+    }
+    Operation* clone() const {
+        return new Solve();
+    }
+    Result evaluate(Args& args, const std::map<std::string, double>& variables) const;
+    ExpressionTreeNode differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const;
+};
+
+/**
+ * proots(expression, variable) is every root of an expression that is a polynomial in the variable, as a
+ * matrix with one row per root holding its real and imaginary parts.
+ */
+class LEPTON_EXPORT Operation::Proots : public Operation {
+public:
+    Proots() {
+    }
+    std::string getName() const {
+        return "proots";
+    }
+    Id getId() const {
+        return PROOTS;
+    }
+    int getNumArguments() const {
+        return 2;
+    }
+    Operation* clone() const {
+        return new Proots();
+    }
+    Result evaluate(Args& args, const std::map<std::string, double>& variables) const;
+    ExpressionTreeNode differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const;
+};
+
+/**
+ * ode(f, x, y, x0, y0, x1) is y(x1) for the solution of y' = f(x, y) with y(x0) = y0.  The first three
+ * arguments are not evaluated by ParsedExpression, which passes the whole node in args.node.
+ */
+class LEPTON_EXPORT Operation::Ode : public Operation {
+public:
+    Ode() {
+    }
+    std::string getName() const {
+        return "ode";
+    }
+    Id getId() const {
+        return ODE;
+    }
+    int getNumArguments() const {
+        return 6;
+    }
+    Operation* clone() const {
+        return new Ode();
+    }
+    Result evaluate(Args& args, const std::map<std::string, double>& variables) const;
     ExpressionTreeNode differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const;
 };
 
@@ -1464,24 +1517,7 @@ public:
     Operation* clone() const {
         return new Ncr();
     }
-    Result evaluate(Args& args, const std::map<std::string, double>& variables) const {
-        if (isMatrix(args.inputs[0]) || isMatrix(args.inputs[1])) {
-            throw Exception("Matrices are not supported with nCr");
-        }
-        
-        if (args.inputs[0].getImag() != 0 || args.inputs[1].getImag() != 0) {
-            throw Exception("NCR with complex numbers not supported");
-        }
-
-        Factorial factorial;
-        Npr npr;
-        
-        std::vector<InputArgType> vec(1);
-        vec[0] = InputArgType(args.inputs[1].getReal());
-        Args tempArgs;
-        tempArgs.inputs = vec;
-        return Result((npr.evaluate(args, variables)).getReal()/(factorial.evaluate(tempArgs, variables)).getReal());
-    }
+    Result evaluate(Args& args, const std::map<std::string, double>& variables) const;
     ExpressionTreeNode differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const;
 };
 
@@ -2714,20 +2750,7 @@ public:
     Operation* clone() const {
         return new Rand();
     }
-    Result evaluate(Args& args, const std::map<std::string, double>& variables) const {
-        if (isMatrix(args.inputs[0]) || isMatrix(args.inputs[1])) {
-            throw Exception("Matrices are not supported with RNG");
-        }
-        
-        if (args.inputs[0].getImag() != 0 || args.inputs[1].getImag() != 0) {
-            throw Exception("Complex numbers not supported with RNG");
-        }
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        // set min and max
-        std::uniform_int_distribution<> dist(args.inputs[0].getReal(), args.inputs[1].getReal());
-        return Result(dist(gen));
-    }
+    Result evaluate(Args& args, const std::map<std::string, double>& variables) const;
     ExpressionTreeNode differentiate(const std::vector<ExpressionTreeNode>& children, const std::vector<ExpressionTreeNode>& childDerivs, const std::string& variable) const;
 };
 
@@ -0,0 +1,74 @@
+#ifndef LEPTON_PARALLEL_REDUCTION_H_
+#define LEPTON_PARALLEL_REDUCTION_H_
+
+#include "windowsIncludes.h"
+#include "EvaluationContext.h"
+#include <cmath>
+#include <functional>
+#include <vector>
+
+namespace Lepton {
+
+/**
+ * A reduction over a long range of terms, such as the term by term sums and products of sigma and prod.
+ *
+ * The range is cut into chunks that depend only on its length, and the results of the chunks are combined
+ * in a fixed pairwise tree, so the answer is bit for bit the same however many threads there are.  When
+ * LEPTON_THREADS is above 1 the chunks run on a pool from Eigen's CXX11 ThreadPool module.  Each chunk has
+ * its own EvaluationContext, which shares the caller's deadline and counts its work towards the caller's
+ * budget, and the work is charged to the caller once every chunk has finished.  Otherwise they run one
+ * after another on the calling thread, which is how the calculator builds it.  The pool is only used in host
+ * builds.  A reduction started from inside a chunk always runs on its own thread.
+ * src/HostChecks/ReductionBenchmark.cpp times both.
+ */
+
+class LEPTON_EXPORT ParallelReduction {
+public:
+    /**
+     * The most chunks a range is cut into.
+     */
+    static const int MAX_CHUNKS = 64;
+    /**
+     * The fewest terms in a chunk, below which handing it to another thread costs more than it saves.
+     */
+    static const int MIN_CHUNK_SIZE = 256;
+
+    /**
+     * Get how many chunks a range of count terms is cut into.
+     */
+    static int chunkCount(double count);
+    /**
+     * Set how many threads the pool has, in place of LEPTON_THREADS.  This only has an effect before the
+     * first reduction that uses the pool, and none when LEPTON_THREADS is 1.
+     */
+    static void setThreadCount(int threads);
+    /**
+     * Run task(0), ..., task(chunks-1), possibly at the same time.  If any of them throws, the exception of
+     * the lowest numbered one is rethrown once they have all finished.
+     */
+    static void run(int chunks, const std::function<void(int)>& task);
+    /**
+     * Reduce the terms with offsets 0 to count-1.
+     *
+     * @param count      the number of terms
+     * @param parallel   false to evaluate every term in order in a single chunk, for terms that share state
+     * @param evaluate   evaluate(first, end) reduces the terms with offsets in [first, end) to a T
+     * @param combine    combine(a, b) reduces two results, of which a is the one from the earlier terms
+     */
+    template <class T, class Evaluate, class Combine>
+    static T reduce(double count, bool parallel, Evaluate evaluate, Combine combine) {
+        int chunks = (parallel ? chunkCount(count) : 1);
+        std::vector<T> results(chunks);
+        run(chunks, [&](int chunk) {
+            results[chunk] = evaluate(std::floor(count*chunk/chunks), std::floor(count*(chunk+1)/chunks));
+        });
+        for (int width = 1; width < chunks; width *= 2)
+            for (int i = 0; i+width < chunks; i += 2*width)
+                results[i] = combine(results[i], results[i+width]);
+        return results[0];
+    }
+};
+
+} // namespace Lepton
+
+#endif /*LEPTON_PARALLEL_REDUCTION_H_*/
@@ -35,6 +35,7 @@
 #include "ExpressionTreeNode.h"
 #include "windowsIncludes.h"
 #include "Matrix.h"
+#include <cstdint>
 #include <map>
 #include <string>
 #include <complex>
@@ -44,7 +45,7 @@ enum DataTypeEnum {matrix, complexVal};
 class InputArgType {
 public:
         InputArgType() {};
-        InputArgType(Eigen::MatrixXd matrix) : matrix(matrix), dataTypeEnum(DataTypeEnum::matrix) {}
+        InputArgType(const SharedMatrix& matrix) : matrix(matrix), dataTypeEnum(DataTypeEnum::matrix) {}
         InputArgType(std::complex<double> complexVal) : complexVal(complexVal), 
                                                         realVal(real(complexVal)),
                                                         imaginaryVal(imag(complexVal)),
@@ -54,12 +55,15 @@ public:
                                         imaginaryVal(0),
                                         dataTypeEnum(DataTypeEnum::complexVal) {}
 
-        Eigen::MatrixXd matrix;
+        SharedMatrix matrix;
         std::complex<double> complexVal;
         double realVal;
         double imaginaryVal;
         DataTypeEnum dataTypeEnum;
 
+    const Eigen::MatrixXd& getMatrix() const {
+        return matrix.get();
+    }
     double getReal() {
         return realVal;
     }
@@ -83,7 +87,8 @@ public:
 class Result {
 public:
     Result() {}
-    Result(Eigen::MatrixXd matrix) : matrix(matrix), dataTypeEnum(DataTypeEnum::matrix) {}
+    Result(Eigen::MatrixXd matrix) : matrix(std::move(matrix)), dataTypeEnum(DataTypeEnum::matrix) {}
+    Result(const SharedMatrix& matrix) : matrix(matrix), dataTypeEnum(DataTypeEnum::matrix) {}
     Result(std::complex<double> complexVal) : complexVal(complexVal),
                                             realVal(real(complexVal)),
                                             imaginaryVal(imag(complexVal)),                                            
@@ -93,12 +98,15 @@ public:
                                 imaginaryVal(0),
                                 dataTypeEnum(DataTypeEnum::complexVal) {}
     
-    Eigen::MatrixXd matrix;
+    SharedMatrix matrix;
     std::complex<double> complexVal;
     double realVal;
     double imaginaryVal;
     DataTypeEnum dataTypeEnum;
 
+    const Eigen::MatrixXd& getMatrix() const {
+        return matrix.get();
+    }
     double getReal() {
         return realVal;
     }
@@ -108,6 +116,10 @@ public:
     std::complex<double> getComplex() {
         return complexVal;
     }
+    // Whether this is a number with no imaginary part, ignoring rounding error left by complex arithmetic (e.g. (-2)^2)
+    bool isReal() const {
+        return dataTypeEnum == DataTypeEnum::complexVal && std::abs(imaginaryVal) <= 1e-12*std::abs(realVal);
+    }
 };
 
 
@@ -148,6 +160,14 @@ public:
      *                     will be thrown.
      */
     Result evaluate(const std::map<std::string, double>& variables) const;
+    /**
+     * Evaluate the expression in 64 bit integer arithmetic for programmer mode.  Results wrap around on
+     * overflow, division truncates towards zero, and shifts are logical.  An exception is thrown if the
+     * expression contains a non-integer constant or an operation with no integer meaning.
+     *
+     * @param variables    a map specifying the values of all variables that appear in the expression
+     */
+    int64_t evaluateInteger(const std::map<std::string, int64_t>& variables) const;
     /**
      * Create a new ParsedExpression which produces the same result as this one, but is faster to evaluate.
      */
@@ -183,6 +203,7 @@ public:
     static Result publicEvaluate(const ExpressionTreeNode& node, const std::map<std::string, double>& variables);
 private:
     static Result evaluate(const ExpressionTreeNode& node, const std::map<std::string, double>& variables);
+    static int64_t evaluateInteger(const ExpressionTreeNode& node, const std::map<std::string, int64_t>& variables);
     static ExpressionTreeNode preevaluateVariables(const ExpressionTreeNode& node, const std::map<std::string, double>& variables);
     static ExpressionTreeNode precalculateConstantSubexpressions(const ExpressionTreeNode& node);
     static ExpressionTreeNode substituteSimplerExpression(const ExpressionTreeNode& node);
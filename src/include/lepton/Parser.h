@@ -33,6 +33,7 @@
  * -------------------------------------------------------------------------- */
 
 #include "windowsIncludes.h"
+#include <cstdint>
 #include <map>
 #include <string>
 #include <vector>
@@ -67,6 +68,18 @@ public:
     static void addFeatureToDisable(std::string featureName);
     static void setAngleUnit(bool degreeSet);
     static bool getAngleUnit();
+    /**
+     * Set whether plain decimal literals such as 255 are parsed as exact integers for programmer mode.
+     * Literals with a 0x, 0b or 0o prefix are always parsed as integers.
+     */
+    static void setIntegerMode(bool integerMode);
+    static bool getIntegerMode();
+    /**
+     * Get a number that changes whenever setAngleUnit() or setIntegerMode() changes how expressions are
+     * parsed.  Both are fixed into an expression when it is parsed, so one parsed under a different number
+     * must be parsed again.
+     */
+    static unsigned int getModeVersion();
     static void clearFeaturesToDisable();
 
 private:
@@ -79,6 +92,8 @@ private:
     static Operation* getFunctionOperation(const std::string& name, const std::map<std::string, CustomFunction*>& customFunctions);
     static std::vector<ParseToken> parseSingleNumber(std::string numberString);
     static std::vector<ParseToken> parseRealAndImaginary(std::string numberString);
+    static bool isIntegerLiteral(const std::string& text);
+    static int64_t parseIntegerLiteral(const std::string& text);
 };
 
 } // namespace Lepton
@@ -0,0 +1,78 @@
+#ifndef LEPTON_PIECEWISE_CHEBYSHEV_H_
+#define LEPTON_PIECEWISE_CHEBYSHEV_H_
+
+#include "windowsIncludes.h"
+#include <functional>
+#include <vector>
+
+namespace Lepton {
+
+/**
+ * A cheap stand-in for a function of one variable that is expensive to evaluate, such as one containing
+ * fnInt or sigma.  The range is split into pieces, and on each piece the function is replaced by the
+ * Chebyshev polynomial interpolating it at up to DEGREE+1 points, which for a smooth function converges very
+ * quickly as the pieces get smaller.  Evaluating the polynomial costs a few dozen multiplies.
+ *
+ * A piece is kept when the size of its last Chebyshev coefficients and a check at one point between the
+ * samples say it is within the tolerance everywhere.  Otherwise it is split in two, until the pieces
+ * would be narrower than the minimum width.  Those pieces, and any that contain a value which is not
+ * finite, are not approximated at all, and evaluate() reports that the function has to be called
+ * directly there.  This is what happens near poles, jumps and the edges of where a function is defined.
+ *
+ * Fitting a range again keeps the pieces already there that meet the tolerance and only fits the parts
+ * not covered, so a view that moves or zooms within the fitted range costs nothing.  New pieces are fitted
+ * more tightly than asked, so they still meet a tolerance that shrinks by up to that margin.
+ */
+
+class LEPTON_EXPORT PiecewiseChebyshev {
+public:
+    /**
+     * The highest degree of the polynomial on each piece.  Fitting a piece costs DEGREE/2+2 function calls
+     * when half the degree is enough, and up to DEGREE+3 otherwise.
+     */
+    static const int DEGREE = 16;
+    /**
+     * The largest number of pieces kept.  Beyond this, pieces outside the range being fitted are dropped,
+     * and pieces that would need splitting are left for the function to be called directly.
+     */
+    static const int MAX_PIECES = 48;
+    PiecewiseChebyshev();
+    /**
+     * Make sure every part of [start, end] is covered by a piece.
+     *
+     * @param function    the function to approximate
+     * @param start       the start of the range
+     * @param end         the end of the range
+     * @param tolerance   the largest error allowed.  Existing pieces whose estimated error is larger are
+     *                    fitted again.
+     * @param refinement  new pieces are fitted to tolerance/refinement
+     * @param minWidth    the narrowest piece worth approximating
+     */
+    void fit(const std::function<double(double)>& function, double start, double end, double tolerance, double refinement, double minWidth);
+    /**
+     * Evaluate the approximation at x.
+     *
+     * @return false if x is not in a piece that was approximated, in which case value is not set
+     */
+    bool evaluate(double x, double& value) const;
+    /**
+     * Forget every piece.
+     */
+    void clear();
+private:
+    struct Piece {
+        double start, end;
+        std::vector<double> coefficients; // Empty if the function must be called directly
+        double error; // The estimated largest error, 0 if there are no coefficients
+    };
+    void fitGap(const std::function<double(double)>& function, double start, double end, double lowLimit, double highLimit,
+            double minWidth, std::vector<Piece>& added) const;
+    void fitPiece(const std::function<double(double)>& function, double start, double end, double minWidth, std::vector<Piece>& added) const;
+    static double evaluateSeries(const std::vector<double>& coefficients, double t);
+    std::vector<Piece> pieces; // Sorted by start, never overlapping
+    double tolerance; // What new pieces are fitted to
+};
+
+} // namespace Lepton
+
+#endif /*LEPTON_PIECEWISE_CHEBYSHEV_H_*/
@@ -0,0 +1,62 @@
+#ifndef LEPTON_POLYNOMIAL_ROOTS_H_
+#define LEPTON_POLYNOMIAL_ROOTS_H_
+
+#include "windowsIncludes.h"
+#include "ExpressionTreeNode.h"
+#include <complex>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Lepton {
+
+/**
+ * An expression that is a polynomial in one of its variables, as used by proots.
+ *
+ * The coefficients are read from the structure of the expression, which may be built from sums, products,
+ * division by constants and whole number powers of the variable.  Subexpressions that do not use the
+ * variable are evaluated once and may be complex.  The roots are the eigenvalues of the companion matrix,
+ * found with Eigen's PolynomialSolver, and each is then polished with Newton steps on the coefficients
+ * themselves, which recovers most of the digits the eigenvalue solver loses on badly scaled polynomials.
+ */
+
+class LEPTON_EXPORT PolynomialRoots {
+public:
+    /**
+     * The highest degree that can be solved.
+     */
+    static const int MAX_DEGREE = 32;
+    /**
+     * The most Newton steps used to polish each root.
+     */
+    static const int NEWTON_STEPS = 2;
+
+    /**
+     * Create a PolynomialRoots.  This throws an exception if the expression is not a polynomial in the
+     * variable, or if it is 0 for every value.
+     *
+     * @param node        the expression
+     * @param variable    the variable it is a polynomial in
+     * @param variables   the values of every other variable in the expression
+     */
+    PolynomialRoots(const ExpressionTreeNode& node, const std::string& variable, const std::map<std::string, double>& variables);
+    int getDegree() const {
+        return coefficients.size()-1;
+    }
+    /**
+     * Get every root, repeated according to its multiplicity and sorted by real and then imaginary part.
+     */
+    std::vector<std::complex<double> > findRoots() const;
+private:
+    typedef std::vector<std::complex<double> > Coefficients; // Element k multiplies x^k
+    bool varies(const ExpressionTreeNode& subtree) const;
+    bool expand(const ExpressionTreeNode& subtree, Coefficients& result) const;
+    std::complex<double> polish(std::complex<double> root) const;
+    std::string variable;
+    const std::map<std::string, double>& variables;
+    Coefficients coefficients;
+};
+
+} // namespace Lepton
+
+#endif /*LEPTON_POLYNOMIAL_ROOTS_H_*/
@@ -0,0 +1,40 @@
+#ifndef LEPTON_SMALL_MATRIX_H_
+#define LEPTON_SMALL_MATRIX_H_
+
+#include "windowsIncludes.h"
+#include <Eigen/Dense>
+
+namespace Lepton {
+
+/**
+ * Matrix kernels that handle the shapes entered on the calculator, up to MAX_SIZE rows and columns, with
+ * fixed size Eigen matrices.  These live on the stack, their loops are unrolled, and Eigen computes their
+ * determinants and inverses in closed form from cofactors, so apart from the result nothing is allocated.
+ * Larger shapes go to the dynamic size algorithms.
+ */
+
+class LEPTON_EXPORT SmallMatrix {
+public:
+    /**
+     * The most rows or columns a matrix can have and still use the fixed size kernels.
+     */
+    static const int MAX_SIZE = 4;
+    /**
+     * Get the determinant of a square matrix.
+     */
+    static double determinant(const Eigen::MatrixXd& a);
+    /**
+     * Get the product a*b, where a has as many columns as b has rows.
+     */
+    static Eigen::MatrixXd multiply(const Eigen::MatrixXd& a, const Eigen::MatrixXd& b);
+    /**
+     * Get the inverse of a square matrix with at most MAX_SIZE rows in closed form.
+     *
+     * @return false if the matrix is larger or exactly singular, in which case inverse is not set
+     */
+    static bool inverse(const Eigen::MatrixXd& a, Eigen::MatrixXd& inverse);
+};
+
+} // namespace Lepton
+
+#endif /*LEPTON_SMALL_MATRIX_H_*/
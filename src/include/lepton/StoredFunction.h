@@ -0,0 +1,134 @@
+#ifndef LEPTON_STORED_FUNCTION_H_
+#define LEPTON_STORED_FUNCTION_H_
+
+#include "windowsIncludes.h"
+#include "CustomFunction.h"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace Lepton {
+
+class ExpressionTreeNode;
+
+/**
+ * A CustomFunction whose body is an expression entered by the user, such as the Y= functions, so that it
+ * can be called from other expressions as f1(3).
+ *
+ * The body is parsed and compiled the first time the function is called, and again only after
+ * setDefinition() changes it or the parser's angle unit or integer mode, which are fixed into it at parse
+ * time, changes.  Every clone shares the same compiled body, so calls from any parsed expression run it
+ * directly instead of re-parsing it or copying its tree.  Since the body is only
+ * parsed when needed, stored functions can call each other in any order.  A function that ends up
+ * calling itself throws an exception, as there is no conditional that could stop the recursion.
+ *
+ * Variables in the body that are not parameters are looked up in a map of global variables at each
+ * call, so the function sees their current values.
+ */
+
+class LEPTON_EXPORT StoredFunction : public CustomFunction {
+public:
+    /**
+     * Create a StoredFunction with an empty definition.
+     *
+     * @param name         the name the function is called by, used in error messages
+     * @param parameters   the names of the parameters, in the order the arguments are passed
+     * @param variables    the global variables the body may refer to.  It must outlive this object.
+     * @param functions    the functions the body may call, which may include this one.  It must outlive this object.
+     */
+    StoredFunction(const std::string& name, const std::vector<std::string>& parameters, const std::map<std::string, double>& variables,
+            const std::map<std::string, CustomFunction*>& functions);
+    /**
+     * Set the expression this function evaluates.  Every clone sees the new definition.  Setting the
+     * definition it already has does nothing, so anything computed from it stays valid.
+     */
+    void setDefinition(const std::string& definition);
+    const std::string& getDefinition() const;
+    /**
+     * Get a number that changes every time the definition or the parser mode it was parsed under changes,
+     * so callers can tell whether a value they computed through this function is still current.
+     */
+    unsigned int getVersion() const;
+    /**
+     * Find what the value of this function depends on besides its arguments: the global variables and
+     * stored matrices its body reads and the stored functions it calls, directly or through other stored
+     * functions.
+     *
+     * @param variables   the names of the global variables are added to this
+     * @param matrices    the names of the stored matrices are added to this
+     * @param functions   the name and current version of each stored function are added to this
+     */
+    void findDependencies(std::set<std::string>& variables, std::set<std::string>& matrices, std::map<std::string, unsigned int>& functions) const;
+    /**
+     * Find what an expression depends on, as findDependencies() does for the body of a function.
+     * Variables bound inside it by fnInt, sigma, prod, lim, proots, solve and ode are left out, but every
+     * other variable it reads is included, so the caller should remove any it binds itself.
+     */
+    static void findDependencies(const ExpressionTreeNode& node, const std::map<std::string, CustomFunction*>& customFunctions,
+            std::set<std::string>& variables, std::set<std::string>& matrices, std::map<std::string, unsigned int>& functions);
+    int getNumArguments() const;
+    double evaluate(const double* arguments) const;
+    double evaluateDerivative(const double* arguments, const int* derivOrder) const;
+    CustomFunction* clone() const;
+protected:
+    const std::string& getName() const;
+    /**
+     * Change the version, for subclasses whose value depends on more than the definition.
+     */
+    void markChanged();
+private:
+    friend class DependencySnapshot;
+    class Body;
+    std::shared_ptr<Body> body;
+};
+
+/**
+ * A record of the global variables, stored matrices and stored functions a computed value depended on,
+ * holding the value of each variable and the version of each matrix and function at the time, along with
+ * the parser mode.  The value is still current as long as none of them has changed.  Comparing the values
+ * themselves means the variable store needs no version counters, and storing the same value again does
+ * not count as a change.
+ */
+
+class LEPTON_EXPORT DependencySnapshot {
+public:
+    DependencySnapshot();
+    /**
+     * Record what an expression depends on now.
+     *
+     * @param node             the expression
+     * @param boundVariable    a variable the caller sets itself, which is not a dependency
+     * @param variables        the global variables.  It must outlive this object.
+     * @param functions        the functions the expression may call.  It must outlive this object.
+     */
+    void record(const ExpressionTreeNode& node, const std::string& boundVariable, const std::map<std::string, double>& variables,
+            const std::map<std::string, CustomFunction*>& functions);
+    /**
+     * Record what a stored function depends on now, including its own definition.
+     */
+    void record(const StoredFunction& function);
+    /**
+     * Get whether nothing recorded has changed since.  This is false if nothing has been recorded.
+     */
+    bool isCurrent() const;
+    /**
+     * Forget what was recorded, so that isCurrent() returns false.
+     */
+    void clear();
+private:
+    void recordValues(const std::set<std::string>& names, const std::set<std::string>& matrixNames);
+    const std::map<std::string, double>* variables;
+    const std::map<std::string, CustomFunction*>* functions;
+    std::vector<std::pair<std::string, double> > values;
+    std::vector<std::pair<std::string, uint32_t> > matrices;
+    std::map<std::string, unsigned int> versions;
+    unsigned int mode;
+    bool valid;
+};
+
+} // namespace Lepton
+
+#endif /*LEPTON_STORED_FUNCTION_H_*/
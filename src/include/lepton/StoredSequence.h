@@ -0,0 +1,56 @@
+#ifndef LEPTON_STORED_SEQUENCE_H_
+#define LEPTON_STORED_SEQUENCE_H_
+
+#include "windowsIncludes.h"
+#include "StoredFunction.h"
+#include <memory>
+#include <vector>
+
+namespace Lepton {
+
+/**
+ * A sequence u(n) defined by a recurrence such as u(n-1)+u(n-2), whose body may call the sequence itself
+ * for earlier terms, together with the seed values u(0), u(1), ... that start it.
+ *
+ * Terms are computed bottom-up into a table shared by every clone and kept between calls, so asking for
+ * u(n) costs one evaluation of the body per term not already known, and asking again costs a lookup.
+ * The table is thrown away when the definition, the seeds, or anything the body reads changes.
+ *
+ * Non-integer arguments are rounded down, so graphing u(x) gives a staircase, and arguments below 0
+ * give NaN.  The body may only ask for earlier terms.
+ */
+
+class LEPTON_EXPORT StoredSequence : public StoredFunction {
+public:
+    /**
+     * The largest number of terms that will be computed.
+     */
+    static const int MAX_TERMS = 10000;
+    /**
+     * Create a StoredSequence with an empty definition and no seeds.  The parameters are as for StoredFunction.
+     */
+    StoredSequence(const std::string& name, const std::string& parameter, const std::map<std::string, double>& variables,
+            const std::map<std::string, CustomFunction*>& functions);
+    /**
+     * Set the first terms of the sequence, which are used as they are instead of evaluating the body.
+     */
+    void setSeeds(const std::vector<double>& seeds);
+    const std::vector<double>& getSeeds() const;
+    double evaluate(const double* arguments) const;
+    double evaluateDerivative(const double* arguments, const int* derivOrder) const;
+    CustomFunction* clone() const;
+private:
+    struct Terms {
+        Terms() : filling(false) {
+        }
+        std::vector<double> seeds;
+        std::vector<double> values;
+        DependencySnapshot inputs;
+        bool filling;
+    };
+    std::shared_ptr<Terms> terms;
+};
+
+} // namespace Lepton
+
+#endif /*LEPTON_STORED_SEQUENCE_H_*/
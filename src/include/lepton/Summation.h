@@ -0,0 +1,69 @@
+#ifndef LEPTON_SUMMATION_H_
+#define LEPTON_SUMMATION_H_
+
+#include "windowsIncludes.h"
+#include "ExpressionTreeNode.h"
+#include <complex>
+#include <map>
+#include <string>
+
+namespace Lepton {
+
+/**
+ * The sum or product of an expression over consecutive integer values of one of its variables, as used
+ * by sigma and prod.
+ *
+ * The shape of the expression is examined first.  A polynomial in the index is summed in closed form from
+ * its values at degree+1 points, and an expression of the form c*q^k from its ratio q, so that the cost
+ * does not depend on the length of the range.  Anything else is evaluated at every index: sums are added
+ * with Neumaier's compensated summation, and products keep their binary exponent separately so that they
+ * only overflow if the result does.  Long ranges are split into chunks with ParallelReduction, unless the
+ * expression uses RAND or a stored function, whose state only allows the terms to be evaluated in order.
+ * Each evaluation charges one unit of work to the current EvaluationContext.
+ */
+
+class LEPTON_EXPORT Summation {
+public:
+    /**
+     * The highest degree of polynomial that is summed in closed form.  Ranges of at most MAX_DEGREE+1
+     * terms are always evaluated term by term.
+     */
+    static const int MAX_DEGREE = 16;
+
+    /**
+     * Create a Summation.
+     *
+     * @param node        the expression
+     * @param variable    the index variable
+     * @param variables   the values of every other variable in the expression
+     */
+    Summation(const ExpressionTreeNode& node, const std::string& variable, const std::map<std::string, double>& variables);
+    /**
+     * Get the sum over every integer from start to end, which are truncated to integers.  It is 0 if
+     * start > end.
+     */
+    std::complex<double> sum(double start, double end);
+    /**
+     * Get the product over every integer from start to end, which are truncated to integers.  It is 1 if
+     * start > end.
+     */
+    std::complex<double> product(double start, double end);
+private:
+    Summation(const Summation&);
+    Summation& operator=(const Summation&);
+    std::complex<double> evaluate(double k);
+    std::complex<double> evaluate(const ExpressionTreeNode& subtree, double k);
+    bool isShared(const ExpressionTreeNode& subtree) const;
+    bool varies(const ExpressionTreeNode& subtree) const;
+    int polynomialDegree(const ExpressionTreeNode& subtree);
+    bool geometricRatio(const ExpressionTreeNode& subtree, std::complex<double>& ratio);
+    bool findRatio(double start, std::complex<double>& first, std::complex<double>& ratio);
+    std::complex<double> sumPolynomial(double first, double step, double count, int degree);
+    ExpressionTreeNode node;
+    std::string variable;
+    std::map<std::string, double> variables; // Includes the index
+};
+
+} // namespace Lepton
+
+#endif /*LEPTON_SUMMATION_H_*/
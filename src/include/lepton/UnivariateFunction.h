@@ -0,0 +1,145 @@
+#ifndef LEPTON_UNIVARIATE_FUNCTION_H_
+#define LEPTON_UNIVARIATE_FUNCTION_H_
+
+#include "windowsIncludes.h"
+#include "CompiledExpression.h"
+#include "ExpressionTreeNode.h"
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Lepton {
+
+/**
+ * An expression viewed as a function of one of its variables, with the others fixed at their current
+ * values, for the numerical methods that need to evaluate it many times.  The expression is compiled
+ * once, and each evaluation charges one unit of work to the current EvaluationContext.
+ *
+ * Values that are not real are NaN.
+ */
+
+class LEPTON_EXPORT UnivariateFunction {
+public:
+    /**
+     * The most iterations a refinement may take.  Each one at least halves the interval within a few
+     * steps, so this is only reached if the function misbehaves.
+     */
+    static const int MAX_ITERATIONS = 100;
+    /**
+     * How many of the best candidates findExtremum() refines.
+     */
+    static const int MAX_CANDIDATES = 4;
+    /**
+     * The most pieces integrate() splits the interval into, which limits it to about 30 evaluations per piece.
+     */
+    static const int MAX_PIECES = 100;
+    /**
+     * The most points findLimit() evaluates on each side.
+     */
+    static const int LIMIT_STEPS = 12;
+
+    /**
+     * Create a UnivariateFunction.
+     *
+     * @param node        the expression
+     * @param variable    the variable the function is of
+     * @param variables   the values of every other variable in the expression
+     */
+    UnivariateFunction(const ExpressionTreeNode& node, const std::string& variable, const std::map<std::string, double>& variables);
+    double evaluate(double x);
+    /**
+     * Find every root in [start, end].
+     *
+     * The interval is sampled at intervals+1 evenly spaced points.  Each sign change between neighbouring
+     * samples is refined with Brent's method, and is dropped if it turns out to be a pole.  A sample
+     * closer to zero than both its neighbours is a candidate for a root where the function touches zero
+     * without crossing it, and is refined by finding the minimum of |f| there.  Two roots closer together
+     * than the spacing of the samples may be missed.
+     *
+     * @return the roots in increasing order
+     */
+    std::vector<double> findRoots(double start, double end, int intervals);
+    /**
+     * Find a root in [a, b] using Brent's method, which combines bisection with secant steps and inverse
+     * quadratic interpolation.  It is as safe as bisection but usually needs far fewer evaluations.
+     *
+     * @param fa      the value at a
+     * @param fb      the value at b, which must differ in sign from fa
+     * @param value   set to the value at the root
+     */
+    double findRoot(double a, double b, double fa, double fb, double& value);
+    /**
+     * Find the largest or smallest value in [start, end].
+     *
+     * The interval is sampled at intervals+1 evenly spaced points, and the best candidates among them are
+     * refined as findExtremum(const std::vector<double>&, ...) does.
+     *
+     * @param maximum   true to find the largest value, false for the smallest
+     * @param value     set to the value at the extremum
+     * @return where the extremum is, or NaN if the function is undefined at every sample
+     */
+    double findExtremum(double start, double end, int intervals, bool maximum, double& value);
+    /**
+     * Find the largest or smallest value in [start, end], given estimates of the function at evenly
+     * spaced points such as the pixels of a graph.  Only their order matters, so they can be rounded or
+     * clipped.  Use infinity for values too large to know and NaN where the function is undefined.
+     *
+     * Each run of samples that is higher (or lower) than the samples on both sides is a candidate.  The
+     * MAX_CANDIDATES best are refined with Brent's minimization, which combines golden section search with
+     * parabolic interpolation, and the best result is returned.  Its position is found to within about
+     * 1e-8 times the larger of |x| and the sample spacing, and its value to nearly full precision.  A
+     * peak narrower than the sample spacing may be missed.
+     *
+     * @param samples   estimates at start, start+(end-start)/(samples.size()-1), ..., end.  There must be at least 2.
+     */
+    double findExtremum(const std::vector<double>& samples, double start, double end, bool maximum, double& value);
+    /**
+     * Integrate from start to end, either of which may be infinite.  If start > end the result is negated.
+     *
+     * This is adaptive Gauss-Kronrod quadrature: each piece is integrated with the 15 point Kronrod rule,
+     * and the difference from the 7 point Gauss rule that uses every other point gives its error.  The piece
+     * with the largest error is split in two until the total error is below 1e-10 relative to the
+     * integral of |f|, or MAX_PIECES is reached.  A smooth integrand usually needs one to five pieces.
+     *
+     * The ends are stretched by a change of variable that makes the integrand vanish there, so integrable
+     * singularities at the ends, such as 1/sqrt(x) at 0, become smooth and the function is never evaluated
+     * at the ends themselves.  Infinite ranges are mapped onto finite ones the same way.
+     *
+     * @param error   set to the estimated absolute error
+     */
+    double integrate(double start, double end, double& error);
+    /**
+     * Find the limit as the variable approaches a point, which may be infinite.
+     *
+     * The function is evaluated at points approaching it geometrically, halving the distance each time, and
+     * Richardson extrapolation removes the terms of the error that grow like powers of the distance.  A
+     * function that is smooth on that side needs four to eight evaluations.  The estimate whose neighbours
+     * in the extrapolation table agree best is kept, and the approach stops when rounding starts to make
+     * them agree less, so cancellation in the function is never pushed further than it has to be.  A side
+     * whose values grow steadily in one direction has an infinite limit.
+     *
+     * @param side    positive to approach from above, negative from below, or 0 for both, in which case the
+     *                two limits must both exist and agree.  It is ignored for an infinite point.
+     * @param error   set to the estimated error
+     * @return the limit, or NaN if it does not exist or could not be found
+     */
+    double findLimit(double point, int side, double& error);
+private:
+    UnivariateFunction(const UnivariateFunction&); // The compiled expressions are bound to their own variables
+    UnivariateFunction& operator=(const UnivariateFunction&);
+    void bindVariables(CompiledExpression& compiled, double*& x);
+    double evaluateDerivative(double x);
+    bool findTouchingRoot(double a, double b, double scale, double& root);
+    double findOneSidedLimit(double point, int direction, double& error);
+    ExpressionTreeNode node;
+    std::string variable;
+    const std::map<std::string, double>& variables;
+    CompiledExpression expression, derivative;
+    double* x;
+    double* derivativeX;
+    int derivativeState; // 0 if not yet differentiated, 1 if available, -1 if it could not be computed
+};
+
+} // namespace Lepton
+
+#endif /*LEPTON_UNIVARIATE_FUNCTION_H_*/